@@ -0,0 +1,603 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <assert.h>
+#include "aio.h"
+#include "progress.h"
+
+/*
+ * Asynchronous I/O on top of Linux io_uring, used directly through its
+ * system calls so there is no dependency on liburing. Each ring belongs
+ * to a single thread: the input streams each have their own ring in the
+ * thread that reads the zone, and the output writer has one in the thread
+ * that writes it.
+ *
+ * Input files are read through a FILE* backed by a read-ahead stream
+ * (using fopencookie()), so ldns can parse from it as before. The stream
+ * keeps several large reads in flight and hands out the buffers in file
+ * order. Buffers that have been used up are dropped from the page cache
+ * and reused for the next read, so reading a large zone does not push
+ * everything else out of memory. Where io_uring is not available (older
+ * kernels, or when it has been disabled), the stream falls back to plain
+ * read() calls; on systems without fopencookie() files are simply opened
+ * with fopen().
+ */
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define AIO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/* Read-ahead of input streams */
+#define AIO_READ_BUFS		4
+#define AIO_READ_BUF_SIZE	(1024 * 1024)
+
+/* Buffer alignment */
+#define AIO_BUF_ALIGN		4096
+
+/* Size of the stdio buffer of input streams */
+#define AIO_STDIO_BUF_SIZE	(64 * 1024)
+
+#ifdef AIO_URING
+
+int ldns_mergezone_aio_init(aio_ring* ring, const unsigned entries)
+{
+	assert(ring != NULL);
+
+	struct io_uring_params	params;
+
+	memset(ring, 0, sizeof(aio_ring));
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+
+	if (ring->fd < 0)
+	{
+		return 1;
+	}
+
+	ring->sq_ring_len = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+	ring->cq_ring_len = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cq_ring_len > ring->sq_ring_len)
+		{
+			ring->sq_ring_len = ring->cq_ring_len;
+		}
+
+		ring->cq_ring_len = ring->sq_ring_len;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ?
+	                ring->sq_ring :
+	                mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if ((ring->sq_ring == MAP_FAILED) || (ring->cq_ring == MAP_FAILED) || (ring->sqes == MAP_FAILED))
+	{
+		if (ring->sq_ring != MAP_FAILED)
+		{
+			munmap(ring->sq_ring, ring->sq_ring_len);
+		}
+
+		if ((ring->cq_ring != MAP_FAILED) && (ring->cq_ring != ring->sq_ring))
+		{
+			munmap(ring->cq_ring, ring->cq_ring_len);
+		}
+
+		if (ring->sqes != MAP_FAILED)
+		{
+			munmap(ring->sqes, ring->sqes_len);
+		}
+
+		close(ring->fd);
+
+		memset(ring, 0, sizeof(aio_ring));
+
+		return 1;
+	}
+
+	ring->sq_head = (unsigned*) ((uint8_t*) ring->sq_ring + params.sq_off.head);
+	ring->sq_tail = (unsigned*) ((uint8_t*) ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = (unsigned*) ((uint8_t*) ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) ((uint8_t*) ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned*) ((uint8_t*) ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned*) ((uint8_t*) ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (unsigned*) ((uint8_t*) ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (uint8_t*) ring->cq_ring + params.cq_off.cqes;
+
+	return 0;
+}
+
+int ldns_mergezone_aio_submit(aio_ring* ring, const int op, const int fd, const struct iovec* iov, const off_t offset, const uint64_t user_data)
+{
+	assert(ring != NULL);
+	assert(iov != NULL);
+
+	unsigned		tail	= *ring->sq_tail;
+	unsigned		index	= tail & *ring->sq_mask;
+	struct io_uring_sqe*	sqe	= &((struct io_uring_sqe*) ring->sqes)[index];
+	int			rv	= 0;
+
+	/* The kernel consumes submissions straight away, so there is always room for one */
+	assert((tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) <= *ring->sq_mask);
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	/* Vectored operations are supported by every kernel that has io_uring */
+	sqe->opcode = (op == AIO_OP_READ) ? IORING_OP_READV : IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) iov;
+	sqe->len = 1;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+
+	ring->sq_array[index] = index;
+
+	/* The kernel only sees the submission once the tail has moved */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do
+	{
+		rv = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	}
+	while ((rv < 0) && (errno == EINTR));
+
+	if (rv == 1)
+	{
+		return 0;
+	}
+
+	/*
+	 * If the kernel did not take the submission, take it back, so it is
+	 * not picked up by a later call while its buffer may have been freed
+	 */
+	if (__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == tail)
+	{
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+		return 1;
+	}
+
+	/* It was taken after all, so it completes like any other */
+	return 0;
+}
+
+int ldns_mergezone_aio_wait(aio_ring* ring, uint64_t* user_data, int* res)
+{
+	assert(ring != NULL);
+	assert(user_data != NULL);
+	assert(res != NULL);
+
+	for (;;)
+	{
+		unsigned	head	= *ring->cq_head;
+
+		if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe*	cqe	= &((struct io_uring_cqe*) ring->cqes)[head & *ring->cq_mask];
+
+			*user_data = cqe->user_data;
+			*res = cqe->res;
+
+			__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+			return 0;
+		}
+
+		if ((syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR))
+		{
+			return 1;
+		}
+	}
+}
+
+void ldns_mergezone_aio_free(aio_ring* ring)
+{
+	assert(ring != NULL);
+
+	if (ring->sq_ring == NULL)
+	{
+		return;
+	}
+
+	munmap(ring->sqes, ring->sqes_len);
+
+	if (ring->cq_ring != ring->sq_ring)
+	{
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	}
+
+	munmap(ring->sq_ring, ring->sq_ring_len);
+
+	close(ring->fd);
+
+	memset(ring, 0, sizeof(aio_ring));
+}
+
+#else /* !AIO_URING */
+
+int ldns_mergezone_aio_init(aio_ring* ring, const unsigned entries)
+{
+	memset(ring, 0, sizeof(aio_ring));
+
+	return 1;
+}
+
+int ldns_mergezone_aio_submit(aio_ring* ring, const int op, const int fd, const struct iovec* iov, const off_t offset, const uint64_t user_data)
+{
+	return 1;
+}
+
+int ldns_mergezone_aio_wait(aio_ring* ring, uint64_t* user_data, int* res)
+{
+	return 1;
+}
+
+void ldns_mergezone_aio_free(aio_ring* ring)
+{
+}
+
+#endif /* AIO_URING */
+
+#ifdef __GLIBC__
+
+/* Read-ahead buffer of an input stream */
+typedef struct
+{
+	uint8_t*	data;
+	struct iovec	iov;
+	off_t		offset;
+	size_t		len;
+	int		queued;
+	int		pending;
+}
+aio_input_buf;
+
+/* Input stream */
+typedef struct
+{
+	int		fd;
+	off_t		size;
+	off_t		next_offset;
+	off_t		dropped;
+	int		use_ring;
+	aio_ring	ring;
+	aio_input_buf	bufs[AIO_READ_BUFS];
+	int		cur;
+	size_t		cur_pos;
+}
+aio_input;
+
+/* Queue a read of the next part of the file into a buffer */
+static int ldns_mergezone_aio_input_queue(aio_input* in, const int buf)
+{
+	aio_input_buf*	b	= &in->bufs[buf];
+
+	b->offset = in->next_offset;
+	b->iov.iov_base = b->data;
+	b->iov.iov_len = ((in->size - in->next_offset) < AIO_READ_BUF_SIZE) ? (size_t) (in->size - in->next_offset) : AIO_READ_BUF_SIZE;
+	b->len = 0;
+	b->queued = 1;
+	b->pending = 1;
+
+	in->next_offset += b->iov.iov_len;
+
+	return ldns_mergezone_aio_submit(&in->ring, AIO_OP_READ, in->fd, &b->iov, b->offset, buf);
+}
+
+/* Wait until the read into the specified buffer has completed */
+static int ldns_mergezone_aio_input_wait(aio_input* in, const int buf)
+{
+	while (in->bufs[buf].pending)
+	{
+		aio_input_buf*	b	= NULL;
+		uint64_t	done	= 0;
+		int		res	= 0;
+
+		if (ldns_mergezone_aio_wait(&in->ring, &done, &res) != 0)
+		{
+			return 1;
+		}
+
+		assert(done < AIO_READ_BUFS);
+
+		b = &in->bufs[done];
+		b->pending = 0;
+
+		if (res < 0)
+		{
+			errno = -res;
+
+			return 1;
+		}
+
+		b->len = res;
+
+		/* Complete a short read the simple way */
+		while (b->len < b->iov.iov_len)
+		{
+			ssize_t	rv	= pread(in->fd, &b->data[b->len], b->iov.iov_len - b->len, b->offset + b->len);
+
+			if ((rv < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+
+			if (rv <= 0)
+			{
+				return 1;
+			}
+
+			b->len += rv;
+		}
+	}
+
+	return 0;
+}
+
+/* Drop the part of the file that has been read from the page cache */
+static void ldns_mergezone_aio_input_drop(aio_input* in, const off_t upto)
+{
+	if ((upto - in->dropped) >= (AIO_READ_BUFS * AIO_READ_BUF_SIZE))
+	{
+		posix_fadvise(in->fd, in->dropped, upto - in->dropped, POSIX_FADV_DONTNEED);
+
+		in->dropped = upto;
+	}
+}
+
+static ssize_t ldns_mergezone_aio_input_read(void* cookie, char* dst, size_t len)
+{
+	aio_input*	in	= (aio_input*) cookie;
+	aio_input_buf*	b	= NULL;
+
+	if (!in->use_ring)
+	{
+		ssize_t	rv	= 0;
+
+		do
+		{
+			rv = read(in->fd, dst, len);
+		}
+		while ((rv < 0) && (errno == EINTR));
+
+		if (rv > 0)
+		{
+			in->next_offset += rv;
+
+			ldns_mergezone_aio_input_drop(in, in->next_offset);
+
+			PROGRESS_BYTES(rv);
+		}
+
+		return rv;
+	}
+
+	for (;;)
+	{
+		b = &in->bufs[in->cur];
+
+		if (!b->queued)
+		{
+			/* End of file */
+			return 0;
+		}
+
+		if (ldns_mergezone_aio_input_wait(in, in->cur) != 0)
+		{
+			return -1;
+		}
+
+		if (in->cur_pos < b->len)
+		{
+			break;
+		}
+
+		/* This buffer has been used up, reuse it for the next part of the file */
+		b->queued = 0;
+
+		ldns_mergezone_aio_input_drop(in, b->offset + b->len);
+
+		if ((in->next_offset < in->size) && (ldns_mergezone_aio_input_queue(in, in->cur) != 0))
+		{
+			b->pending = 0;
+
+			return -1;
+		}
+
+		in->cur = (in->cur + 1) % AIO_READ_BUFS;
+		in->cur_pos = 0;
+	}
+
+	if (len > (b->len - in->cur_pos))
+	{
+		len = b->len - in->cur_pos;
+	}
+
+	memcpy(dst, &b->data[in->cur_pos], len);
+
+	in->cur_pos += len;
+
+	PROGRESS_BYTES(len);
+
+	return len;
+}
+
+/* Reap the completions of all outstanding reads, whether they failed or not; returns 1 if that is not possible */
+static int ldns_mergezone_aio_input_drain(aio_input* in)
+{
+	int	i	= 0;
+
+	for (i = 0; i < AIO_READ_BUFS; i++)
+	{
+		while (in->bufs[i].pending)
+		{
+			uint64_t	done	= 0;
+			int		res	= 0;
+
+			if (ldns_mergezone_aio_wait(&in->ring, &done, &res) != 0)
+			{
+				return 1;
+			}
+
+			assert(done < AIO_READ_BUFS);
+
+			in->bufs[done].pending = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int ldns_mergezone_aio_input_close(void* cookie)
+{
+	aio_input*	in	= (aio_input*) cookie;
+	int		i	= 0;
+	int		rv	= 0;
+
+	/* Outstanding reads must complete before their buffers are freed */
+	if (in->use_ring && (ldns_mergezone_aio_input_drain(in) != 0))
+	{
+		fprintf(stderr, "Failed to wait for outstanding reads, leaving their buffers allocated\n");
+	}
+
+	for (i = 0; i < AIO_READ_BUFS; i++)
+	{
+		/* The kernel may still write into a buffer whose read never completed */
+		if (!in->bufs[i].pending)
+		{
+			free(in->bufs[i].data);
+		}
+	}
+
+	if (in->use_ring)
+	{
+		ldns_mergezone_aio_free(&in->ring);
+	}
+
+	rv = close(in->fd);
+
+	free(in);
+
+	return rv;
+}
+
+FILE* ldns_mergezone_aio_fopen(const char* path)
+{
+	assert(path != NULL);
+
+	cookie_io_functions_t	funcs	= { ldns_mergezone_aio_input_read, NULL, NULL, ldns_mergezone_aio_input_close };
+	aio_input*		in	= (aio_input*) calloc(1, sizeof(aio_input));
+	struct stat		st;
+	FILE*			fp	= NULL;
+	int			i	= 0;
+
+	assert(in != NULL);
+
+	if ((in->fd = open(path, O_RDONLY)) < 0)
+	{
+		free(in);
+
+		return NULL;
+	}
+
+	posix_fadvise(in->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* Read-ahead only makes sense for regular files */
+	if ((fstat(in->fd, &st) == 0) && S_ISREG(st.st_mode) && (ldns_mergezone_aio_init(&in->ring, AIO_READ_BUFS) == 0))
+	{
+		in->use_ring = 1;
+		in->size = st.st_size;
+
+		for (i = 0; i < AIO_READ_BUFS; i++)
+		{
+			if (posix_memalign((void**) &in->bufs[i].data, AIO_BUF_ALIGN, AIO_READ_BUF_SIZE) != 0)
+			{
+				in->bufs[i].data = NULL;
+
+				ldns_mergezone_aio_input_close(in);
+
+				return NULL;
+			}
+		}
+
+		for (i = 0; (i < AIO_READ_BUFS) && (in->next_offset < in->size); i++)
+		{
+			if (ldns_mergezone_aio_input_queue(in, i) != 0)
+			{
+				in->bufs[i].pending = 0;
+
+				ldns_mergezone_aio_input_close(in);
+
+				return NULL;
+			}
+		}
+	}
+
+	if ((fp = fopencookie(in, "r", funcs)) == NULL)
+	{
+		ldns_mergezone_aio_input_close(in);
+
+		return NULL;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, AIO_STDIO_BUF_SIZE);
+
+	return fp;
+}
+
+#else /* !__GLIBC__ */
+
+FILE* ldns_mergezone_aio_fopen(const char* path)
+{
+	return fopen(path, "r");
+}
+
+#endif /* __GLIBC__ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_AIO_H
+#define _LDNS_MERGEZONE_AIO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Operations */
+#define AIO_OP_READ	0
+#define AIO_OP_WRITE	1
+
+/* An io_uring instance, used from a single thread */
+typedef struct
+{
+	int		fd;
+	unsigned*	sq_head;
+	unsigned*	sq_tail;
+	unsigned*	sq_mask;
+	unsigned*	sq_array;
+	void*		sqes;
+	unsigned*	cq_head;
+	unsigned*	cq_tail;
+	unsigned*	cq_mask;
+	void*		cqes;
+	void*		sq_ring;
+	size_t		sq_ring_len;
+	void*		cq_ring;
+	size_t		cq_ring_len;
+	size_t		sqes_len;
+}
+aio_ring;
+
+/* Set up a ring; returns 1 if io_uring is not available, in which case the caller should fall back to plain I/O */
+int ldns_mergezone_aio_init(aio_ring* ring, const unsigned entries);
+
+/* Queue a read or write of a single buffer at the specified offset */
+int ldns_mergezone_aio_submit(aio_ring* ring, const int op, const int fd, const struct iovec* iov, const off_t offset, const uint64_t user_data);
+
+/* Wait for the next completion; res is the number of bytes transferred or a negative errno value */
+int ldns_mergezone_aio_wait(aio_ring* ring, uint64_t* user_data, int* res);
+
+/* Clean up; all submitted operations must have completed */
+void ldns_mergezone_aio_free(aio_ring* ring);
+
+/* Open a file for sequential reading with several large reads in flight; the result can be used like any other FILE* */
+FILE* ldns_mergezone_aio_fopen(const char* path);
+
+#endif /* !_LDNS_MERGEZONE_AIO_H */
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "b64.h"
+
+/*
+ * Base64 encoding of signatures and public keys accounts for most of the
+ * bytes written to a signed zone. Besides a plain table driven encoder,
+ * there are SSSE3 and AVX2 encoders that turn 12 or 24 input bytes into
+ * 16 or 32 characters at a time, after W. Mula and D. Lemire, "Faster
+ * Base64 Encoding and Decoding Using AVX2 Instructions". The vector
+ * encoders load 4 bytes more than they consume, so they stop when fewer
+ * than 16 (SSSE3) or 28 (AVX2) input bytes are left and leave the rest,
+ * including the padding, to the scalar encoder.
+ *
+ * The decoders work the same way in reverse: 16 or 32 characters are
+ * checked against the alphabet and turned into 12 or 24 bytes at a time.
+ * The last group of four characters, which may hold padding, is always
+ * left to the scalar decoder. Decoding is strict: characters outside the
+ * alphabet, misplaced or missing padding and set bits in the padding all
+ * make it fail. The implementation is picked the first time it is needed,
+ * based on what the CPU supports.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define B64_X86
+#include <immintrin.h>
+#endif
+
+static const char b64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* 6-bit value of each character, 0xff if it is not in the alphabet */
+static const uint8_t b64_values[256] =
+{
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static size_t ldns_mergezone_b64_encode_scalar(const uint8_t* src, const size_t len, char* dst)
+{
+	size_t	i	= 0;
+	char*	out	= dst;
+
+	for (i = 0; (i + 3) <= len; i += 3)
+	{
+		uint32_t	v	= (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+
+		*out++ = b64_alphabet[(v >> 18) & 0x3f];
+		*out++ = b64_alphabet[(v >> 12) & 0x3f];
+		*out++ = b64_alphabet[(v >> 6) & 0x3f];
+		*out++ = b64_alphabet[v & 0x3f];
+	}
+
+	if (i < len)
+	{
+		uint32_t	v	= src[i] << 16;
+
+		if ((i + 1) < len)
+		{
+			v |= src[i + 1] << 8;
+		}
+
+		*out++ = b64_alphabet[(v >> 18) & 0x3f];
+		*out++ = b64_alphabet[(v >> 12) & 0x3f];
+		*out++ = ((i + 1) < len) ? b64_alphabet[(v >> 6) & 0x3f] : '=';
+		*out++ = '=';
+	}
+
+	return out - dst;
+}
+
+static int ldns_mergezone_b64_decode_scalar(const char* src, const size_t len, uint8_t* dst, size_t* dst_len)
+{
+	const uint8_t*	in	= (const uint8_t*) src;
+	uint8_t*	out	= dst;
+	size_t		i	= 0;
+
+	if ((len % 4) != 0)
+	{
+		return 1;
+	}
+
+	for (i = 0; i < len; i += 4)
+	{
+		uint8_t		a	= b64_values[in[i]];
+		uint8_t		b	= b64_values[in[i + 1]];
+		uint8_t		c	= b64_values[in[i + 2]];
+		uint8_t		d	= b64_values[in[i + 3]];
+		uint32_t	v	= 0;
+
+		if ((a | b | c | d) & 0xc0)
+		{
+			break;
+		}
+
+		v = (a << 18) | (b << 12) | (c << 6) | d;
+
+		*out++ = v >> 16;
+		*out++ = v >> 8;
+		*out++ = v;
+	}
+
+	if (i < len)
+	{
+		/* Only the last group may hold padding, which must not leave any bits set */
+		uint8_t	a	= b64_values[in[i]];
+		uint8_t	b	= b64_values[in[i + 1]];
+		uint8_t	c	= b64_values[in[i + 2]];
+
+		if (((i + 4) != len) || ((a | b) & 0xc0) || (in[i + 3] != '='))
+		{
+			return 1;
+		}
+
+		if (in[i + 2] == '=')
+		{
+			if (b & 0x0f)
+			{
+				return 1;
+			}
+
+			*out++ = (a << 2) | (b >> 4);
+		}
+		else
+		{
+			if (c & 0xc3)
+			{
+				return 1;
+			}
+
+			*out++ = (a << 2) | (b >> 4);
+			*out++ = (b << 4) | (c >> 2);
+		}
+	}
+
+	*dst_len = out - dst;
+
+	return 0;
+}
+
+#ifdef B64_X86
+
+/* Spread 12 bytes over 16 bytes holding one 6-bit index each */
+__attribute__((target("ssse3")))
+static inline __m128i ldns_mergezone_b64_split_ssse3(const __m128i in)
+{
+	const __m128i	shuffled	= _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	const __m128i	t0		= _mm_and_si128(shuffled, _mm_set1_epi32(0x0fc0fc00));
+	const __m128i	t1		= _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	const __m128i	t2		= _mm_and_si128(shuffled, _mm_set1_epi32(0x003f03f0));
+	const __m128i	t3		= _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+	return _mm_or_si128(t1, t3);
+}
+
+/* Map 6-bit indices to characters by adding the offset for their range of the alphabet */
+__attribute__((target("ssse3")))
+static inline __m128i ldns_mergezone_b64_lookup_ssse3(const __m128i indices)
+{
+	const __m128i	offsets		= _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+						        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i		range		= _mm_subs_epu8(indices, _mm_set1_epi8(51));
+
+	range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+	return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+__attribute__((target("ssse3")))
+static size_t ldns_mergezone_b64_encode_ssse3(const uint8_t* src, const size_t len, char* dst)
+{
+	size_t	i	= 0;
+
+	for (i = 0; (i + 16) <= len; i += 12)
+	{
+		const __m128i	in	= _mm_loadu_si128((const __m128i*) &src[i]);
+
+		_mm_storeu_si128((__m128i*) &dst[(i / 3) * 4], ldns_mergezone_b64_lookup_ssse3(ldns_mergezone_b64_split_ssse3(in)));
+	}
+
+	return ((i / 3) * 4) + ldns_mergezone_b64_encode_scalar(&src[i], len - i, &dst[(i / 3) * 4]);
+}
+
+/* Turn 16 characters into 6-bit values, returns 0 if any of them is not in the alphabet */
+__attribute__((target("ssse3")))
+static inline int ldns_mergezone_b64_values_ssse3(const __m128i in, __m128i* values)
+{
+	const __m128i	upper	= _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), in));
+	const __m128i	lower	= _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), in));
+	const __m128i	digit	= _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), in));
+	const __m128i	plus	= _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+	const __m128i	slash	= _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+	__m128i		shift	= _mm_and_si128(upper, _mm_set1_epi8(-'A'));
+
+	shift = _mm_or_si128(shift, _mm_and_si128(lower, _mm_set1_epi8(26 - 'a')));
+	shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(52 - '0')));
+	shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(62 - '+')));
+	shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(63 - '/')));
+
+	*values = _mm_add_epi8(in, shift);
+
+	return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)))) == 0xffff;
+}
+
+/* Pack 16 6-bit values into the first 12 bytes */
+__attribute__((target("ssse3")))
+static inline __m128i ldns_mergezone_b64_pack_ssse3(const __m128i values)
+{
+	const __m128i	pairs	= _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+	const __m128i	quads	= _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+
+	return _mm_shuffle_epi8(quads, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+static int ldns_mergezone_b64_decode_ssse3(const char* src, const size_t len, uint8_t* dst, size_t* dst_len)
+{
+	size_t	limit	= (len >= 4) ? len - 4 : 0;
+	size_t	i	= 0;
+	size_t	o	= 0;
+	size_t	tail	= 0;
+
+	for (i = 0; (i + 16) <= limit; i += 16, o += 12)
+	{
+		__m128i	values;
+
+		if (!ldns_mergezone_b64_values_ssse3(_mm_loadu_si128((const __m128i*) &src[i]), &values))
+		{
+			return 1;
+		}
+
+		_mm_storeu_si128((__m128i*) &dst[o], ldns_mergezone_b64_pack_ssse3(values));
+	}
+
+	if (ldns_mergezone_b64_decode_scalar(&src[i], len - i, &dst[o], &tail) != 0)
+	{
+		return 1;
+	}
+
+	*dst_len = o + tail;
+
+	return 0;
+}
+
+__attribute__((target("avx2")))
+static int ldns_mergezone_b64_decode_avx2(const char* src, const size_t len, uint8_t* dst, size_t* dst_len)
+{
+	size_t	limit	= (len >= 4) ? len - 4 : 0;
+	size_t	i	= 0;
+	size_t	o	= 0;
+	size_t	tail	= 0;
+
+	for (i = 0; (i + 32) <= limit; i += 32, o += 24)
+	{
+		const __m256i	in	= _mm256_loadu_si256((const __m256i*) &src[i]);
+		const __m256i	upper	= _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+		const __m256i	lower	= _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+		const __m256i	digit	= _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+		const __m256i	plus	= _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+		const __m256i	slash	= _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+		__m256i		shift	= _mm256_and_si256(upper, _mm256_set1_epi8(-'A'));
+		__m256i		values;
+
+		if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, _mm256_or_si256(plus, slash)))) != -1)
+		{
+			return 1;
+		}
+
+		shift = _mm256_or_si256(shift, _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')));
+		shift = _mm256_or_si256(shift, _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')));
+
+		values = _mm256_add_epi8(in, shift);
+		values = _mm256_madd_epi16(_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+		values = _mm256_shuffle_epi8(values, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+								      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+		/* Move the 12 bytes of the upper lane next to those of the lower lane */
+		values = _mm256_permutevar8x32_epi32(values, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+		_mm256_storeu_si256((__m256i*) &dst[o], values);
+	}
+
+	if (ldns_mergezone_b64_decode_scalar(&src[i], len - i, &dst[o], &tail) != 0)
+	{
+		return 1;
+	}
+
+	*dst_len = o + tail;
+
+	return 0;
+}
+
+__attribute__((target("avx2")))
+static size_t ldns_mergezone_b64_encode_avx2(const uint8_t* src, const size_t len, char* dst)
+{
+	const __m256i	shuffle		= _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+							   1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i	offsets		= _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+							   '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+							   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+							   '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	size_t		i		= 0;
+
+	for (i = 0; (i + 28) <= len; i += 24)
+	{
+		/* Each 128-bit lane gets 12 input bytes */
+		const __m256i	in	= _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) &src[i])),
+							  _mm_loadu_si128((const __m128i*) &src[i + 12]), 1);
+		const __m256i	shuffled = _mm256_shuffle_epi8(in, shuffle);
+		const __m256i	t1	= _mm256_mulhi_epu16(_mm256_and_si256(shuffled, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		const __m256i	t3	= _mm256_mullo_epi16(_mm256_and_si256(shuffled, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		const __m256i	indices	= _mm256_or_si256(t1, t3);
+		__m256i		range	= _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+
+		range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+		_mm256_storeu_si256((__m256i*) &dst[(i / 3) * 4], _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range)));
+	}
+
+	return ((i / 3) * 4) + ldns_mergezone_b64_encode_scalar(&src[i], len - i, &dst[(i / 3) * 4]);
+}
+
+#endif /* B64_X86 */
+
+/* Available implementations, fastest first */
+typedef struct
+{
+	const char*	name;
+	b64_encoder	encode;
+	b64_decoder	decode;
+	int		(*supported)(void);
+}
+b64_impl;
+
+static int ldns_mergezone_b64_always(void)
+{
+	return 1;
+}
+
+#ifdef B64_X86
+static int ldns_mergezone_b64_have_avx2(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2");
+}
+
+static int ldns_mergezone_b64_have_ssse3(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("ssse3");
+}
+#endif /* B64_X86 */
+
+static const b64_impl b64_impls[] =
+{
+#ifdef B64_X86
+	{ "avx2",	ldns_mergezone_b64_encode_avx2,		ldns_mergezone_b64_decode_avx2,		ldns_mergezone_b64_have_avx2 },
+	{ "ssse3",	ldns_mergezone_b64_encode_ssse3,	ldns_mergezone_b64_decode_ssse3,	ldns_mergezone_b64_have_ssse3 },
+#endif /* B64_X86 */
+	{ "scalar",	ldns_mergezone_b64_encode_scalar,	ldns_mergezone_b64_decode_scalar,	ldns_mergezone_b64_always },
+	{ NULL,		NULL,					NULL,					NULL }
+};
+
+/* The implementation in use, picked on first use */
+static const b64_impl*	b64_selected	= NULL;
+
+static const b64_impl* ldns_mergezone_b64_select(void)
+{
+	const b64_impl*	impl	= __atomic_load_n(&b64_selected, __ATOMIC_ACQUIRE);
+
+	if (impl == NULL)
+	{
+		/* Threads that race here all pick the same implementation */
+		for (impl = b64_impls; !impl->supported(); impl++);
+
+		__atomic_store_n(&b64_selected, impl, __ATOMIC_RELEASE);
+	}
+
+	return impl;
+}
+
+size_t ldns_mergezone_b64_encode(const uint8_t* src, const size_t len, char* dst)
+{
+	return ldns_mergezone_b64_select()->encode(src, len, dst);
+}
+
+int ldns_mergezone_b64_decode(const char* src, const size_t len, uint8_t* dst, size_t* dst_len)
+{
+	return ldns_mergezone_b64_select()->decode(src, len, dst, dst_len);
+}
+
+const char* ldns_mergezone_b64_impl(void)
+{
+	return ldns_mergezone_b64_select()->name;
+}
+
+/* Find an implementation by name, returns NULL if it does not exist or is not supported */
+static const b64_impl* ldns_mergezone_b64_find(const char* impl)
+{
+	const b64_impl*	i	= NULL;
+
+	for (i = b64_impls; i->name != NULL; i++)
+	{
+		if (strcmp(i->name, impl) == 0)
+		{
+			return i->supported() ? i : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+b64_encoder ldns_mergezone_b64_encoder(const char* impl)
+{
+	const b64_impl*	i	= ldns_mergezone_b64_find(impl);
+
+	return (i != NULL) ? i->encode : NULL;
+}
+
+b64_decoder ldns_mergezone_b64_decoder(const char* impl)
+{
+	const b64_impl*	i	= ldns_mergezone_b64_find(impl);
+
+	return (i != NULL) ? i->decode : NULL;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_B64_H
+#define _LDNS_MERGEZONE_B64_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Number of characters needed to encode the specified number of bytes, without a terminating zero */
+#define B64_ENCODED_LEN(len)	((((len) + 2) / 3) * 4)
+
+/* Maximum number of bytes that the specified number of characters decode to */
+#define B64_DECODED_MAX(len)	(((len) / 4) * 3)
+
+/* Number of bytes a decoder may write past the decoded data */
+#define B64_DECODE_SLACK	32
+
+/* Base64 encoder; writes B64_ENCODED_LEN(len) characters without terminating them and returns that number */
+typedef size_t (*b64_encoder)(const uint8_t* src, const size_t len, char* dst);
+
+/* Base64 decoder; the input must not contain white space, dst must have room for B64_DECODED_MAX(len) + B64_DECODE_SLACK bytes */
+typedef int (*b64_decoder)(const char* src, const size_t len, uint8_t* dst, size_t* dst_len);
+
+/* Encode using the fastest implementation the CPU supports */
+size_t ldns_mergezone_b64_encode(const uint8_t* src, const size_t len, char* dst);
+
+/* Decode using the fastest implementation the CPU supports; returns 1 on invalid characters or padding */
+int ldns_mergezone_b64_decode(const char* src, const size_t len, uint8_t* dst, size_t* dst_len);
+
+/* Get the name of the implementation used by ldns_mergezone_b64_encode() and ldns_mergezone_b64_decode() */
+const char* ldns_mergezone_b64_impl(void);
+
+/* Get a specific implementation ("scalar", "ssse3" or "avx2"), returns NULL if the CPU does not support it */
+b64_encoder ldns_mergezone_b64_encoder(const char* impl);
+
+/* Get a specific decoder, returns NULL if the CPU does not support it */
+b64_decoder ldns_mergezone_b64_decoder(const char* impl);
+
+#endif /* !_LDNS_MERGEZONE_B64_H */
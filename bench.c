@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "hash.h"
+#include "sort.h"
+#include "b64.h"
+#include "format.h"
+#include "reader.h"
+#include "uthash.h"
+
+/*
+ * Micro-benchmarks for the building blocks on the hot paths of a merge.
+ * Run without arguments to run all benchmarks, or name the benchmarks to
+ * run on the command line.
+ */
+
+#define BENCH_NAMES		(1 << 12)
+#define BENCH_ROUNDS		1024
+#define BENCH_SORT_RECS		(1 << 18)
+#define BENCH_SORT_ROUNDS	8
+#define BENCH_B64_LEN		256
+#define BENCH_B64_ROUNDS	(1 << 20)
+#define BENCH_FORMAT_RECS	(1 << 12)
+#define BENCH_FORMAT_ROUNDS	64
+#define BENCH_LINE_LEN		1024
+
+typedef struct
+{
+	uint8_t		wire[256];
+	size_t		wire_len;
+	char		text[1024];
+	size_t		text_len;
+}
+bench_name;
+
+static bench_name*	bench_names	= NULL;
+static volatile uint64_t bench_sink	= 0;
+static uint8_t*		bench_sort_arena	= NULL;
+static sort_rec*	bench_sort_recs		= NULL;
+static size_t		bench_sort_bytes	= 0;
+static ldns_rr**	bench_format_rrs	= NULL;
+static char*		bench_rrsig_lines	= NULL;
+
+static double bench_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void bench_report(const char* name, const double ops, const double bytes, const double secs)
+{
+	printf("%-24s %10.2f ns/op %10.1f MB/s\n", name, (secs * 1e9) / ops, (bytes / (1024.0 * 1024.0)) / secs);
+}
+
+/* Generate mixed case owner names below example.com in wire and in text format */
+static void bench_make_names(void)
+{
+	static const char*	zone_labels[]	= { "example", "com" };
+	size_t			i		= 0;
+
+	if (bench_names != NULL)
+	{
+		return;
+	}
+
+	bench_names = (bench_name*) malloc(BENCH_NAMES * sizeof(bench_name));
+
+	srand(42);
+
+	for (i = 0; i < BENCH_NAMES; i++)
+	{
+		bench_name*	name	= &bench_names[i];
+		int		labels	= 1 + (rand() % 3);
+		int		l	= 0;
+		size_t		j	= 0;
+
+		name->wire_len = 0;
+
+		/* The hash table key used to be "<type>_<owner>" */
+		name->text_len = sprintf(name->text, "%u_", 1 + (rand() % 64));
+
+		for (l = 0; l < labels + 2; l++)
+		{
+			char	label[64];
+			size_t	label_len	= 0;
+
+			if (l < labels)
+			{
+				label_len = 3 + (rand() % 12);
+
+				for (j = 0; j < label_len; j++)
+				{
+					label[j] = ((rand() % 8) == 0 ? 'A' : 'a') + (rand() % 26);
+				}
+			}
+			else
+			{
+				label_len = strlen(zone_labels[l - labels]);
+
+				memcpy(label, zone_labels[l - labels], label_len);
+			}
+
+			name->wire[name->wire_len++] = (uint8_t) label_len;
+			memcpy(&name->wire[name->wire_len], label, label_len);
+			name->wire_len += label_len;
+
+			memcpy(&name->text[name->text_len], label, label_len);
+			name->text_len += label_len;
+			name->text[name->text_len++] = '.';
+		}
+
+		name->wire[name->wire_len++] = 0;
+		name->text[name->text_len] = '\0';
+	}
+}
+
+static void bench_hash_jenkins(void)
+{
+	double		start	= 0;
+	double		bytes	= 0;
+	size_t		i	= 0;
+	int		r	= 0;
+
+	bench_make_names();
+
+	start = bench_now();
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		for (i = 0; i < BENCH_NAMES; i++)
+		{
+			unsigned	hashv	= 0;
+			unsigned	bkt	= 0;
+			size_t		len	= strlen(bench_names[i].text);
+
+			HASH_JEN(bench_names[i].text, len, 1024, hashv, bkt);
+
+			bench_sink += hashv + bkt;
+			bytes += len;
+		}
+	}
+
+	bench_report("hash-jenkins-text", (double) BENCH_ROUNDS * BENCH_NAMES, bytes, bench_now() - start);
+}
+
+static void bench_hash_owner(void)
+{
+	double		start	= 0;
+	double		bytes	= 0;
+	size_t		i	= 0;
+	int		r	= 0;
+
+	bench_make_names();
+
+	start = bench_now();
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		for (i = 0; i < BENCH_NAMES; i++)
+		{
+			bench_sink += ldns_mergezone_hash_owner(i & 0x3f, bench_names[i].wire, bench_names[i].wire_len);
+
+			bytes += bench_names[i].wire_len;
+		}
+	}
+
+	bench_report("hash-owner-wire", (double) BENCH_ROUNDS * BENCH_NAMES, bytes, bench_now() - start);
+}
+
+/* Generate A records in random order, with a random label in front of the generated names */
+static void bench_make_sort_recs(void)
+{
+	size_t	i	= 0;
+	size_t	pos	= 0;
+
+	if (bench_sort_recs != NULL)
+	{
+		return;
+	}
+
+	bench_make_names();
+
+	bench_sort_arena = (uint8_t*) malloc(BENCH_SORT_RECS * (sizeof(bench_names[0].wire) + 32));
+	bench_sort_recs = (sort_rec*) malloc(BENCH_SORT_RECS * sizeof(sort_rec));
+
+	for (i = 0; i < BENCH_SORT_RECS; i++)
+	{
+		bench_name*	name	= &bench_names[rand() % BENCH_NAMES];
+		uint8_t*	wire	= &bench_sort_arena[pos];
+		size_t		len	= 0;
+
+		len = 1 + sprintf((char*) &wire[1], "r%u", (unsigned) rand());
+		wire[0] = (uint8_t) (len - 1);
+
+		memcpy(&wire[len], name->wire, name->wire_len);
+		len += name->wire_len;
+
+		/* Type A, class IN, TTL 3600, 4 bytes of RDATA */
+		memcpy(&wire[len], "\x00\x01\x00\x01\x00\x00\x0e\x10\x00\x04", 10);
+		len += 10;
+
+		memcpy(&wire[len], &i, 4);
+		len += 4;
+
+		bench_sort_recs[i].wire = wire;
+		bench_sort_recs[i].len = (uint32_t) len;
+
+		bench_sort_bytes += len;
+		pos += len;
+	}
+}
+
+static int bench_sort_compare(const void* a, const void* b)
+{
+	const sort_rec*	left	= (const sort_rec*) a;
+	const sort_rec*	right	= (const sort_rec*) b;
+	int		rv	= ldns_mergezone_sort_rec_compare(left->wire, left->len, right->wire, right->len);
+
+	return (rv != 0) ? rv : (left->wire < right->wire) ? -1 : (left->wire > right->wire);
+}
+
+static void bench_sort(const char* name, const int radix)
+{
+	sort_rec*	recs	= NULL;
+	double		secs	= 0;
+	double		start	= 0;
+	int		r	= 0;
+
+	bench_make_sort_recs();
+
+	recs = (sort_rec*) malloc(BENCH_SORT_RECS * sizeof(sort_rec));
+
+	for (r = 0; r < BENCH_SORT_ROUNDS; r++)
+	{
+		memcpy(recs, bench_sort_recs, BENCH_SORT_RECS * sizeof(sort_rec));
+
+		start = bench_now();
+
+		if (radix)
+		{
+			ldns_mergezone_sort_recs(recs, BENCH_SORT_RECS);
+		}
+		else
+		{
+			qsort(recs, BENCH_SORT_RECS, sizeof(sort_rec), bench_sort_compare);
+		}
+
+		secs += bench_now() - start;
+
+		bench_sink += (uintptr_t) recs[0].wire;
+	}
+
+	free(recs);
+
+	bench_report(name, (double) BENCH_SORT_ROUNDS * BENCH_SORT_RECS, (double) BENCH_SORT_ROUNDS * bench_sort_bytes, secs);
+}
+
+static void bench_sort_qsort(void)
+{
+	bench_sort("sort-qsort", 0);
+}
+
+static void bench_sort_radix(void)
+{
+	bench_sort("sort-radix", 1);
+}
+
+/* Encode with ldns, for comparison */
+static size_t bench_b64_ntop(const uint8_t* src, const size_t len, char* dst)
+{
+	return ldns_b64_ntop(src, len, dst, B64_ENCODED_LEN(len) + 1);
+}
+
+static void bench_b64(const char* name, b64_encoder encode)
+{
+	uint8_t		sig[BENCH_B64_LEN];
+	char		text[B64_ENCODED_LEN(BENCH_B64_LEN) + 1];
+	double		start	= 0;
+	size_t		i	= 0;
+
+	if (encode == NULL)
+	{
+		printf("%-24s not supported on this CPU\n", name);
+
+		return;
+	}
+
+	for (i = 0; i < BENCH_B64_LEN; i++)
+	{
+		sig[i] = rand();
+	}
+
+	start = bench_now();
+
+	for (i = 0; i < BENCH_B64_ROUNDS; i++)
+	{
+		bench_sink += encode(sig, BENCH_B64_LEN, text);
+
+		sig[i % BENCH_B64_LEN] += text[i % sizeof(text)];
+	}
+
+	bench_report(name, BENCH_B64_ROUNDS, (double) BENCH_B64_ROUNDS * BENCH_B64_LEN, bench_now() - start);
+}
+
+static void bench_b64_ldns(void)
+{
+	bench_b64("b64-ldns", bench_b64_ntop);
+}
+
+static void bench_b64_scalar(void)
+{
+	bench_b64("b64-scalar", ldns_mergezone_b64_encoder("scalar"));
+}
+
+static void bench_b64_ssse3(void)
+{
+	bench_b64("b64-ssse3", ldns_mergezone_b64_encoder("ssse3"));
+}
+
+static void bench_b64_avx2(void)
+{
+	bench_b64("b64-avx2", ldns_mergezone_b64_encoder("avx2"));
+}
+
+/* Generate RRSIG records with 2048-bit signatures */
+static void bench_make_format_rrs(void)
+{
+	uint8_t		sig[BENCH_B64_LEN];
+	char		sig_text[B64_ENCODED_LEN(BENCH_B64_LEN) + 1];
+	char*		rr_text	= NULL;
+	size_t		i	= 0;
+	size_t		j	= 0;
+
+	if (bench_format_rrs != NULL)
+	{
+		return;
+	}
+
+	bench_make_names();
+
+	bench_format_rrs = (ldns_rr**) calloc(BENCH_FORMAT_RECS, sizeof(ldns_rr*));
+	bench_rrsig_lines = (char*) malloc(BENCH_FORMAT_RECS * BENCH_LINE_LEN);
+
+	for (i = 0; i < BENCH_FORMAT_RECS; i++)
+	{
+		for (j = 0; j < BENCH_B64_LEN; j++)
+		{
+			sig[j] = rand();
+		}
+
+		sig_text[ldns_mergezone_b64_encode(sig, BENCH_B64_LEN, sig_text)] = '\0';
+
+		rr_text = &bench_rrsig_lines[i * BENCH_LINE_LEN];
+
+		/* Skip the "<type>_" prefix of the name */
+		snprintf(rr_text, BENCH_LINE_LEN, "%s 3600 IN RRSIG A 8 3 3600 20170201000000 20170101000000 12345 example.com. %s",
+		         strchr(bench_names[i % BENCH_NAMES].text, '_') + 1, sig_text);
+
+		if (ldns_rr_new_frm_str(&bench_format_rrs[i], rr_text, 0, NULL, NULL) != LDNS_STATUS_OK)
+		{
+			fprintf(stderr, "Failed to create RRSIG for benchmark\n");
+
+			exit(1);
+		}
+	}
+}
+
+static void bench_format(const char* name, const int use_ldns)
+{
+	ldns_buffer*	text	= ldns_buffer_new(LDNS_MAX_LINELEN);
+	double		bytes	= 0;
+	double		start	= 0;
+	size_t		i	= 0;
+	int		r	= 0;
+
+	bench_make_format_rrs();
+
+	start = bench_now();
+
+	for (r = 0; r < BENCH_FORMAT_ROUNDS; r++)
+	{
+		for (i = 0; i < BENCH_FORMAT_RECS; i++)
+		{
+			ldns_buffer_clear(text);
+
+			if (use_ldns)
+			{
+				ldns_rr2buffer_str(text, bench_format_rrs[i]);
+			}
+			else
+			{
+				ldns_mergezone_format_rr(text, bench_format_rrs[i]);
+			}
+
+			bytes += ldns_buffer_position(text);
+		}
+	}
+
+	bench_report(name, (double) BENCH_FORMAT_ROUNDS * BENCH_FORMAT_RECS, bytes, bench_now() - start);
+
+	ldns_buffer_free(text);
+}
+
+static void bench_format_ldns(void)
+{
+	bench_format("format-rrsig-ldns", 1);
+}
+
+static void bench_format_b64(void)
+{
+	bench_format("format-rrsig", 0);
+}
+
+/* Decode with ldns, for comparison */
+static int bench_b64_pton(const char* src, const size_t len, uint8_t* dst, size_t* dst_len)
+{
+	int	rv	= ldns_b64_pton(src, dst, B64_DECODED_MAX(len));
+
+	*dst_len = (rv < 0) ? 0 : rv;
+
+	return (rv < 0) ? 1 : 0;
+}
+
+static void bench_b64_dec(const char* name, b64_decoder decode)
+{
+	uint8_t		sig[BENCH_B64_LEN + B64_DECODE_SLACK];
+	char		text[B64_ENCODED_LEN(BENCH_B64_LEN) + 1];
+	size_t		sig_len	= 0;
+	double		start	= 0;
+	size_t		i	= 0;
+
+	if (decode == NULL)
+	{
+		printf("%-24s not supported on this CPU\n", name);
+
+		return;
+	}
+
+	for (i = 0; i < BENCH_B64_LEN; i++)
+	{
+		sig[i] = rand();
+	}
+
+	text[ldns_mergezone_b64_encode(sig, BENCH_B64_LEN, text)] = '\0';
+
+	start = bench_now();
+
+	for (i = 0; i < BENCH_B64_ROUNDS; i++)
+	{
+		if (decode(text, B64_ENCODED_LEN(BENCH_B64_LEN), sig, &sig_len) != 0)
+		{
+			fprintf(stderr, "Failed to decode base64 in benchmark\n");
+
+			exit(1);
+		}
+
+		bench_sink += sig[i % BENCH_B64_LEN];
+	}
+
+	bench_report(name, BENCH_B64_ROUNDS, (double) BENCH_B64_ROUNDS * B64_ENCODED_LEN(BENCH_B64_LEN), bench_now() - start);
+}
+
+static void bench_b64_dec_ldns(void)
+{
+	bench_b64_dec("b64dec-ldns", bench_b64_pton);
+}
+
+static void bench_b64_dec_scalar(void)
+{
+	bench_b64_dec("b64dec-scalar", ldns_mergezone_b64_decoder("scalar"));
+}
+
+static void bench_b64_dec_ssse3(void)
+{
+	bench_b64_dec("b64dec-ssse3", ldns_mergezone_b64_decoder("ssse3"));
+}
+
+static void bench_b64_dec_avx2(void)
+{
+	bench_b64_dec("b64dec-avx2", ldns_mergezone_b64_decoder("avx2"));
+}
+
+/* Parse RRSIG records with ldns only, or through the zone reader */
+static void bench_parse(const char* name, const int use_ldns)
+{
+	zone_reader	reader;
+	char		line[BENCH_LINE_LEN];
+	ldns_rr*	rr	= NULL;
+	double		bytes	= 0;
+	double		start	= 0;
+	size_t		i	= 0;
+	int		r	= 0;
+
+	bench_make_format_rrs();
+
+	memset(&reader, 0, sizeof(zone_reader));
+
+	reader.name = name;
+	reader.default_ttl = 3600;
+
+	start = bench_now();
+
+	for (r = 0; r < BENCH_FORMAT_ROUNDS / 4; r++)
+	{
+		for (i = 0; i < BENCH_FORMAT_RECS; i++)
+		{
+			strcpy(line, &bench_rrsig_lines[i * BENCH_LINE_LEN]);
+
+			bytes += strlen(line);
+
+			if ((use_ldns && (ldns_rr_new_frm_str(&rr, line, reader.default_ttl, NULL, NULL) != LDNS_STATUS_OK)) ||
+			    (!use_ldns && (ldns_mergezone_reader_parse(&reader, line, 0, &rr) != 0)))
+			{
+				fprintf(stderr, "Failed to parse RRSIG in benchmark\n");
+
+				exit(1);
+			}
+
+			ldns_rr_free(rr);
+		}
+	}
+
+	bench_report(name, (double) (BENCH_FORMAT_ROUNDS / 4) * BENCH_FORMAT_RECS, bytes, bench_now() - start);
+
+	ldns_rdf_deep_free(reader.prev);
+}
+
+static void bench_parse_ldns(void)
+{
+	bench_parse("parse-rrsig-ldns", 1);
+}
+
+static void bench_parse_b64(void)
+{
+	bench_parse("parse-rrsig", 0);
+}
+
+typedef struct
+{
+	const char*	name;
+	void		(*run)(void);
+}
+bench_ent;
+
+static const bench_ent benchmarks[] =
+{
+	{ "hash-jenkins-text",	bench_hash_jenkins },
+	{ "hash-owner-wire",	bench_hash_owner },
+	{ "sort-qsort",		bench_sort_qsort },
+	{ "sort-radix",		bench_sort_radix },
+	{ "b64-ldns",		bench_b64_ldns },
+	{ "b64-scalar",		bench_b64_scalar },
+	{ "b64-ssse3",		bench_b64_ssse3 },
+	{ "b64-avx2",		bench_b64_avx2 },
+	{ "format-rrsig-ldns",	bench_format_ldns },
+	{ "format-rrsig",	bench_format_b64 },
+	{ "b64dec-ldns",	bench_b64_dec_ldns },
+	{ "b64dec-scalar",	bench_b64_dec_scalar },
+	{ "b64dec-ssse3",	bench_b64_dec_ssse3 },
+	{ "b64dec-avx2",	bench_b64_dec_avx2 },
+	{ "parse-rrsig-ldns",	bench_parse_ldns },
+	{ "parse-rrsig",	bench_parse_b64 },
+	{ NULL,			NULL }
+};
+
+int main(int argc, char* argv[])
+{
+	const bench_ent*	b	= NULL;
+	int			i	= 0;
+	int			rv	= 0;
+
+	if (argc == 1)
+	{
+		for (b = benchmarks; b->name != NULL; b++)
+		{
+			b->run();
+		}
+	}
+
+	for (i = 1; i < argc; i++)
+	{
+		for (b = benchmarks; b->name != NULL; b++)
+		{
+			if (strcmp(b->name, argv[i]) == 0)
+			{
+				b->run();
+
+				break;
+			}
+		}
+
+		if (b->name == NULL)
+		{
+			fprintf(stderr, "Unknown benchmark %s\n", argv[i]);
+
+			rv = 1;
+		}
+	}
+
+	free(bench_names);
+	free(bench_sort_recs);
+	free(bench_sort_arena);
+
+	if (bench_format_rrs != NULL)
+	{
+		size_t	i	= 0;
+
+		for (i = 0; i < BENCH_FORMAT_RECS; i++)
+		{
+			ldns_rr_free(bench_format_rrs[i]);
+		}
+
+		free(bench_format_rrs);
+		free(bench_rrsig_lines);
+	}
+
+	return rv;
+}
@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "merge.h"
+#include "sort.h"
+#include "b64.h"
+
+/*
+ * Performance regression gate. A fixed corpus of zones is generated from
+ * the test zones: the records of the template zone are followed by a
+ * fixed set of generated names, each with A, AAAA and TXT records and an
+ * RRSIG for each of them. Only the DNSKEY RRset signatures are validated
+ * when merging, so the generated signatures are filler of the right size
+ * with the parameters of the template signatures. Each zone is merged a
+ * few times in a child process, and the best wall time, the records per
+ * second it amounts to and the peak resident memory of the runs are
+ * compared against a committed baseline. The check fails if any metric is
+ * worse than the baseline by more than the tolerance, or if a baseline
+ * that has been recorded has no value for it. A baseline that has not
+ * been recorded yet is reported, but does not fail the check. With -w the
+ * results are written as the new baseline instead, together with a
+ * description of the system they were measured on; numbers measured on
+ * another system are not comparable, which the check warns about.
+ */
+
+/* Number of times each zone is merged, the best run counts */
+#define CHECK_RUNS		3
+
+/* Default tolerance if the baseline does not specify one */
+#define CHECK_TOLERANCE		0.10
+
+/* Length of a text line in the generated zones */
+#define CHECK_LINE_LEN		1024
+
+/* An entry of the corpus */
+typedef struct
+{
+	const char*	name;
+	size_t		names;
+	int		low_memory;
+	int		sort;
+}
+check_zone;
+
+/* Results of merging a zone */
+typedef struct
+{
+	double		wall_seconds;
+	double		records_per_second;
+	double		peak_rss_bytes;
+}
+check_result;
+
+/* A metric, whether lower values are better and the number of decimals to show */
+typedef struct
+{
+	const char*	name;
+	int		lower_is_better;
+	int		decimals;
+}
+check_metric;
+
+static const check_zone check_corpus[] =
+{
+	{ "small", 20000, 0, 0 },
+	{ "small-low-memory", 20000, 1, 0 },
+	{ "small-sorted", 20000, 0, 1 },
+	{ "medium", 200000, 0, 0 },
+	{ NULL, 0, 0, 0 }
+};
+
+static const check_metric check_metrics[] =
+{
+	{ "wall_seconds", 1, 3 },
+	{ "records_per_second", 0, 0 },
+	{ "peak_rss_bytes", 1, 0 },
+	{ NULL, 0, 0 }
+};
+
+static double check_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static double check_metric_value(const check_result* result, const int metric)
+{
+	switch(metric)
+	{
+	case 0:
+		return result->wall_seconds;
+	case 1:
+		return result->records_per_second;
+	default:
+		return result->peak_rss_bytes;
+	}
+}
+
+/* Describe the system the benchmark runs on, as recorded in the baseline */
+static void check_describe_system(char* desc, const size_t len)
+{
+	struct utsname	uts;
+
+	if (uname(&uts) != 0)
+	{
+		memset(&uts, 0, sizeof(uts));
+	}
+
+	snprintf(desc, len, "%s %s %s, %ld CPUs, compiler %s", uts.sysname, uts.release, uts.machine, sysconf(_SC_NPROCESSORS_ONLN), __VERSION__);
+}
+
+/* Write the template zone, then the generated names with signatures like the template's SOA signature; returns the number of records */
+static size_t check_write_zone(FILE* out, const char* template_file, const size_t names)
+{
+	FILE*		in		= fopen(template_file, "r");
+	char		line[CHECK_LINE_LEN];
+	char		b64[CHECK_LINE_LEN];
+	uint8_t		sig[CHECK_LINE_LEN];
+	unsigned	algo		= 0;
+	unsigned	tag		= 0;
+	char		expiration[32];
+	char		inception[32];
+	char		signer[256];
+	char		sig_text[CHECK_LINE_LEN];
+	size_t		sig_len		= 0;
+	size_t		recs		= 0;
+	uint32_t	seed		= 42;
+	size_t		i		= 0;
+	size_t		j		= 0;
+	size_t		t		= 0;
+
+	static const char*	types[]	= { "A", "AAAA", "TXT" };
+
+	if (in == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for reading\n", template_file);
+
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), in) != NULL)
+	{
+		fputs(line, out);
+
+		if ((line[0] != '\n') && (line[0] != ';') && (line[0] != '$'))
+		{
+			recs++;
+		}
+
+		if ((sig_len == 0) && (sscanf(line, "%*s %*s %*s RRSIG SOA %u %*u %*u %31s %31s %u %255s %1023s", &algo, expiration, inception, &tag, signer, sig_text) == 6))
+		{
+			size_t	len	= strlen(sig_text);
+
+			sig_len = (len / 4) * 3 - ((sig_text[len - 1] == '=') ? 1 : 0) - ((sig_text[len - 2] == '=') ? 1 : 0);
+		}
+	}
+
+	fclose(in);
+
+	if (sig_len == 0)
+	{
+		fprintf(stderr, "No signature over the SOA record in %s to use as template\n", template_file);
+
+		return 0;
+	}
+
+	for (i = 0; i < names; i++)
+	{
+		for (t = 0; t < 3; t++)
+		{
+			/* The same records every time, with different filler signatures for each algorithm */
+			uint32_t	data	= (uint32_t) (i * 2654435761u) ^ (uint32_t) t;
+
+			switch(t)
+			{
+			case 0:
+				fprintf(out, "host%zu.%s\t3600\tIN\tA\t10.%u.%u.%u\n", i, signer, (data >> 16) & 0xff, (data >> 8) & 0xff, data & 0xff);
+				break;
+			case 1:
+				fprintf(out, "host%zu.%s\t3600\tIN\tAAAA\t2001:db8::%x:%x\n", i, signer, (data >> 16) & 0xffff, data & 0xffff);
+				break;
+			default:
+				fprintf(out, "host%zu.%s\t3600\tIN\tTXT\t\"generated record %08x\"\n", i, signer, data);
+			}
+
+			for (j = 0; j < sig_len; j++)
+			{
+				seed = seed * 1103515245 + 12345;
+				sig[j] = (uint8_t) (seed >> 16);
+			}
+
+			b64[ldns_mergezone_b64_encode(sig, sig_len, b64)] = '\0';
+
+			fprintf(out, "host%zu.%s\t3600\tIN\tRRSIG\t%s %u 3 3600 %s %s %u %s %s\n", i, signer, types[t], algo, expiration, inception, tag, signer, b64);
+
+			recs += 2;
+		}
+	}
+
+	return recs;
+}
+
+/* Generate a corpus zone from a template */
+static size_t check_generate(const char* path, const char* template_file, const size_t names)
+{
+	FILE*	out	= fopen(path, "w");
+	size_t	recs	= 0;
+
+	if (out == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+
+		return 0;
+	}
+
+	recs = check_write_zone(out, template_file, names);
+
+	if ((fclose(out) != 0) && (recs > 0))
+	{
+		fprintf(stderr, "Failed to write %s\n", path);
+
+		recs = 0;
+	}
+
+	return recs;
+}
+
+/* Merge a zone in a child process, so its peak memory use can be measured on its own */
+static int check_run(const check_zone* zone, const char* from, const char* to, const char* out, check_result* result)
+{
+	struct rusage	usage;
+	double		start	= check_now();
+	int		status	= 0;
+	pid_t		pid	= fork();
+
+	if (pid < 0)
+	{
+		fprintf(stderr, "Failed to start merge\n");
+
+		return 1;
+	}
+
+	if (pid == 0)
+	{
+		_exit(ldns_mergezone_merge(from, to, out, 1, 0, zone->sort ? SORT_DEFAULT_MEM_LIMIT : 0, zone->low_memory));
+	}
+
+	if ((wait4(pid, &status, 0, &usage) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+	{
+		fprintf(stderr, "Merging zone %s failed\n", zone->name);
+
+		return 1;
+	}
+
+	result->wall_seconds = check_now() - start;
+
+	/* Linux and the BSDs report this in kilobytes */
+	result->peak_rss_bytes = (double) usage.ru_maxrss * 1024;
+
+	return 0;
+}
+
+/* Look up a metric of a zone in the baseline; returns 1 if it is not there */
+static int check_baseline_value(const char* baseline, const char* zone, const char* metric, double* value)
+{
+	char		key[128];
+	const char*	obj	= NULL;
+	const char*	end	= NULL;
+	const char*	val	= NULL;
+
+	snprintf(key, sizeof(key), "\"%s\":", zone);
+
+	if ((baseline == NULL) || ((obj = strstr(baseline, key)) == NULL) || ((end = strchr(obj, '}')) == NULL))
+	{
+		return 1;
+	}
+
+	snprintf(key, sizeof(key), "\"%s\":", metric);
+
+	if (((val = strstr(obj, key)) == NULL) || (val > end))
+	{
+		return 1;
+	}
+
+	*value = strtod(val + strlen(key), NULL);
+
+	return 0;
+}
+
+/* Read the baseline file, returns NULL if there is none */
+static char* check_read_baseline(const char* baseline_file)
+{
+	FILE*	fp	= fopen(baseline_file, "r");
+	char*	data	= NULL;
+	long	len	= 0;
+
+	if (fp == NULL)
+	{
+		return NULL;
+	}
+
+	if ((fseek(fp, 0, SEEK_END) == 0) && ((len = ftell(fp)) >= 0) && (fseek(fp, 0, SEEK_SET) == 0))
+	{
+		data = (char*) malloc(len + 1);
+
+		if ((data != NULL) && (fread(data, 1, len, fp) == (size_t) len))
+		{
+			data[len] = '\0';
+		}
+		else
+		{
+			free(data);
+
+			data = NULL;
+		}
+	}
+
+	fclose(fp);
+
+	return data;
+}
+
+static int check_write_baseline(const char* baseline_file, const double tolerance, const check_result* results)
+{
+	FILE*	fp	= fopen(baseline_file, "w");
+	char	desc[256];
+	size_t	z	= 0;
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", baseline_file);
+
+		return 1;
+	}
+
+	check_describe_system(desc, sizeof(desc));
+
+	fprintf(fp, "{\n\t\"reference\": \"%s\",\n\t\"tolerance\": %.2f,\n\t\"zones\": {\n", desc, tolerance);
+
+	for (z = 0; check_corpus[z].name != NULL; z++)
+	{
+		fprintf(fp, "\t\t\"%s\": { \"wall_seconds\": %.3f, \"records_per_second\": %.0f, \"peak_rss_bytes\": %.0f }%s\n",
+			check_corpus[z].name, results[z].wall_seconds, results[z].records_per_second, results[z].peak_rss_bytes,
+			(check_corpus[z + 1].name != NULL) ? "," : "");
+	}
+
+	fprintf(fp, "\t}\n}\n");
+
+	if (fclose(fp) != 0)
+	{
+		fprintf(stderr, "Failed to write %s\n", baseline_file);
+
+		return 1;
+	}
+
+	printf("Wrote new baseline to %s\n", baseline_file);
+
+	return 0;
+}
+
+/* Compare the results against the baseline and print the differences; returns 1 if there are regressions or metrics without a recorded baseline */
+static int check_compare(const char* baseline, double tolerance, const check_result* results)
+{
+	const char*	tol		= (baseline != NULL) ? strstr(baseline, "\"tolerance\":") : NULL;
+	const char*	ref		= (baseline != NULL) ? strstr(baseline, "\"reference\": \"") : NULL;
+	const char*	ref_end		= NULL;
+	char		desc[256];
+	int		worse		= 0;
+	int		missing		= 0;
+	size_t		z		= 0;
+	int		m		= 0;
+
+	check_describe_system(desc, sizeof(desc));
+
+	/* A baseline is only recorded by -w, which always names the system it ran on */
+	if ((ref == NULL) || ((ref_end = strchr(ref + strlen("\"reference\": \""), '"')) == NULL))
+	{
+		printf("%-18s %-20s %14s\n", "zone", "metric", "current");
+
+		for (z = 0; check_corpus[z].name != NULL; z++)
+		{
+			for (m = 0; check_metrics[m].name != NULL; m++)
+			{
+				printf("%-18s %-20s %14.*f\n", check_corpus[z].name, check_metrics[m].name, check_metrics[m].decimals, check_metric_value(&results[z], m));
+			}
+		}
+
+		printf("\nNO BASELINE has been recorded yet, nothing was compared; run make bench-baseline on the reference system and commit the result\n");
+
+		return 0;
+	}
+
+	ref += strlen("\"reference\": \"");
+
+	if (((size_t) (ref_end - ref) != strlen(desc)) || (strncmp(ref, desc, ref_end - ref) != 0))
+	{
+		printf("Warning: the baseline was recorded on another system, the results are not comparable\n");
+		printf("         baseline: %.*s\n", (int) (ref_end - ref), ref);
+		printf("         current:  %s\n\n", desc);
+	}
+
+	if ((tolerance < 0) && (tol != NULL))
+	{
+		tolerance = strtod(tol + strlen("\"tolerance\":"), NULL);
+	}
+
+	if (tolerance < 0)
+	{
+		tolerance = CHECK_TOLERANCE;
+	}
+
+	printf("%-18s %-20s %14s %14s %9s\n", "zone", "metric", "baseline", "current", "change");
+
+	for (z = 0; check_corpus[z].name != NULL; z++)
+	{
+		for (m = 0; check_metrics[m].name != NULL; m++)
+		{
+			double	current		= check_metric_value(&results[z], m);
+			double	base		= 0;
+			double	change		= 0;
+
+			if ((check_baseline_value(baseline, check_corpus[z].name, check_metrics[m].name, &base) != 0) || (base <= 0))
+			{
+				printf("%-18s %-20s %14s %14.*f  NO BASELINE\n", check_corpus[z].name, check_metrics[m].name, "-", check_metrics[m].decimals, current);
+
+				missing++;
+
+				continue;
+			}
+
+			change = (current - base) / base;
+
+			printf("%-18s %-20s %14.*f %14.*f %+8.1f%%", check_corpus[z].name, check_metrics[m].name, check_metrics[m].decimals, base, check_metrics[m].decimals, current, change * 100);
+
+			if ((check_metrics[m].lower_is_better && (change > tolerance)) || (!check_metrics[m].lower_is_better && (change < -tolerance)))
+			{
+				printf("  REGRESSION");
+
+				worse++;
+			}
+
+			printf("\n");
+		}
+	}
+
+	if (worse > 0)
+	{
+		printf("\n%d metric(s) are more than %.0f%% worse than the baseline\n", worse, tolerance * 100);
+	}
+
+	if (missing > 0)
+	{
+		printf("\n%d metric(s) have no baseline, run make bench-baseline on the reference system again and commit the result\n", missing);
+	}
+
+	if ((worse > 0) || (missing > 0))
+	{
+		return 1;
+	}
+
+	printf("\nAll metrics are within %.0f%% of the baseline\n", tolerance * 100);
+
+	return 0;
+}
+
+void usage(void)
+{
+	printf("Usage: ldns-mergezone-bench-check [-b <baseline>] [-z <dir>] [-t <tolerance>] [-w]\n");
+	printf("\n");
+	printf("\t-b <baseline>  Baseline file (default: bench-baseline.json)\n");
+	printf("\t-z <dir>       Directory with the template zones (default: testzones)\n");
+	printf("\t-t <tolerance> Fraction by which a metric may be worse than the baseline\n");
+	printf("\t               (default: as specified in the baseline, or %.2f)\n", CHECK_TOLERANCE);
+	printf("\t-w             Write the results as the new baseline\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char*	baseline_file	= "bench-baseline.json";
+	const char*	template_dir	= "testzones";
+	char*		baseline	= NULL;
+	double		tolerance	= -1;
+	int		write_baseline	= 0;
+	check_result	results[sizeof(check_corpus) / sizeof(check_zone)];
+	char		tmp_dir[256];
+	char		from[512];
+	char		to[512];
+	char		out[512];
+	char		from_template[512];
+	char		to_template[512];
+	const char*	tmp		= getenv("TMPDIR");
+	size_t		recs		= 0;
+	size_t		z		= 0;
+	int		run		= 0;
+	int		c		= 0;
+	int		rv		= 0;
+
+	while ((c = getopt(argc, argv, "b:z:t:wh")) != -1)
+	{
+		switch(c)
+		{
+		case 'b':
+			baseline_file = optarg;
+			break;
+		case 'z':
+			template_dir = optarg;
+			break;
+		case 't':
+			tolerance = strtod(optarg, NULL);
+			break;
+		case 'w':
+			write_baseline = 1;
+			break;
+		case 'h':
+		default:
+			usage();
+			return 0;
+		}
+	}
+
+	snprintf(tmp_dir, sizeof(tmp_dir), "%s/ldns-mergezone-bench-XXXXXX", ((tmp == NULL) || (*tmp == '\0')) ? "/tmp" : tmp);
+
+	if (mkdtemp(tmp_dir) == NULL)
+	{
+		fprintf(stderr, "Failed to create temporary directory\n");
+
+		return 1;
+	}
+
+	snprintf(from_template, sizeof(from_template), "%s/from1.zone", template_dir);
+	snprintf(to_template, sizeof(to_template), "%s/to1.zone", template_dir);
+	snprintf(from, sizeof(from), "%s/from.zone", tmp_dir);
+	snprintf(to, sizeof(to), "%s/to.zone", tmp_dir);
+	snprintf(out, sizeof(out), "%s/out.zone", tmp_dir);
+
+	memset(results, 0, sizeof(results));
+
+	for (z = 0; (rv == 0) && (check_corpus[z].name != NULL); z++)
+	{
+		const check_zone*	zone	= &check_corpus[z];
+
+		/* Zones of the same size are only generated once */
+		if ((z == 0) || (check_corpus[z - 1].names != zone->names))
+		{
+			if (((recs = check_generate(from, from_template, zone->names)) == 0) ||
+			    (check_generate(to, to_template, zone->names) == 0))
+			{
+				rv = 1;
+
+				break;
+			}
+		}
+
+		printf("Merging zone %s (%zu records)\n", zone->name, recs);
+
+		fflush(stdout);
+
+		for (run = 0; (rv == 0) && (run < CHECK_RUNS); run++)
+		{
+			check_result	result;
+
+			if (check_run(zone, from, to, out, &result) != 0)
+			{
+				rv = 1;
+
+				break;
+			}
+
+			if ((run == 0) || (result.wall_seconds < results[z].wall_seconds))
+			{
+				results[z].wall_seconds = result.wall_seconds;
+			}
+
+			if ((run == 0) || (result.peak_rss_bytes < results[z].peak_rss_bytes))
+			{
+				results[z].peak_rss_bytes = result.peak_rss_bytes;
+			}
+		}
+
+		/* Throughput of the best run */
+		if (results[z].wall_seconds > 0)
+		{
+			results[z].records_per_second = recs / results[z].wall_seconds;
+		}
+	}
+
+	unlink(from);
+	unlink(to);
+	unlink(out);
+	rmdir(tmp_dir);
+
+	if (rv != 0)
+	{
+		return rv;
+	}
+
+	printf("\n");
+
+	if (write_baseline)
+	{
+		return check_write_baseline(baseline_file, (tolerance < 0) ? CHECK_TOLERANCE : tolerance, results);
+	}
+
+	baseline = check_read_baseline(baseline_file);
+
+	rv = check_compare(baseline, tolerance, results);
+
+	free(baseline);
+
+	return rv;
+}
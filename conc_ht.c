@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "conc_ht.h"
+
+/*
+ * Open addressing with linear probing, sized up front to at most half full.
+ * Slots only ever go from empty to occupied, which makes insertion with a
+ * single compare-and-swap per slot safe without locks: two threads inserting
+ * the same key walk the same probe sequence, so whichever loses the race for
+ * a slot finds the winner's item there and reports it as a duplicate.
+ *
+ * Until the table is frozen, slots are read with acquire semantics to pair
+ * with the release on insertion. After freezing, which happens once all
+ * inserting threads have been joined, lookups use plain loads.
+ */
+
+/* Initialise a table that can hold the specified number of items */
+int ldns_mergezone_conc_ht_init(conc_ht* ht, const size_t max_items)
+{
+	assert(ht != NULL);
+
+	size_t	slots	= 16;
+
+	while (slots < (2 * max_items))
+	{
+		slots <<= 1;
+	}
+
+	ht->slots = (conc_ht_handle**) calloc(slots, sizeof(conc_ht_handle*));
+	ht->mask = slots - 1;
+	ht->frozen = 0;
+
+	if (ht->slots == NULL)
+	{
+		fprintf(stderr, "Failed to allocate hash table with %zd slots\n", slots);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Insert an item, returns 1 and the item with the same key if there is one; safe to call from many threads */
+int ldns_mergezone_conc_ht_insert(conc_ht* ht, conc_ht_handle* item, const void* key, conc_ht_keycmp keycmp, conc_ht_handle** existing)
+{
+	assert(ht != NULL);
+	assert(!ht->frozen);
+	assert(item != NULL);
+	assert(existing != NULL);
+
+	size_t	pos	= item->hash & ht->mask;
+	size_t	probes	= 0;
+
+	for (probes = 0; probes <= ht->mask; probes++)
+	{
+		conc_ht_handle*	cur	= __atomic_load_n(&ht->slots[pos], __ATOMIC_ACQUIRE);
+
+		if ((cur == NULL) && __atomic_compare_exchange_n(&ht->slots[pos], &cur, item, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		{
+			*existing = NULL;
+
+			return 0;
+		}
+
+		/* The slot is occupied, possibly by another thread just now */
+		if ((cur->hash == item->hash) && (keycmp(cur, key) == 0))
+		{
+			*existing = cur;
+
+			return 1;
+		}
+
+		pos = (pos + 1) & ht->mask;
+	}
+
+	/* Cannot happen if the table was sized for the number of items inserted */
+	assert(0 == 1);
+
+	*existing = NULL;
+
+	return 1;
+}
+
+/* Switch the table to read-only mode once all inserting threads have been joined */
+void ldns_mergezone_conc_ht_freeze(conc_ht* ht)
+{
+	assert(ht != NULL);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	ht->frozen = 1;
+}
+
+/* Find the item with the specified hash and key */
+conc_ht_handle* ldns_mergezone_conc_ht_find(const conc_ht* ht, const uint64_t hash, const void* key, conc_ht_keycmp keycmp)
+{
+	assert(ht != NULL);
+
+	size_t		pos	= hash & ht->mask;
+	conc_ht_handle*	cur	= NULL;
+
+	for (;;)
+	{
+		cur = ht->frozen ? ht->slots[pos] : __atomic_load_n(&ht->slots[pos], __ATOMIC_ACQUIRE);
+
+		if (cur == NULL)
+		{
+			return NULL;
+		}
+
+		if ((cur->hash == hash) && (keycmp(cur, key) == 0))
+		{
+			return cur;
+		}
+
+		pos = (pos + 1) & ht->mask;
+	}
+}
+
+/* Clean up; items are owned by the caller */
+void ldns_mergezone_conc_ht_free(conc_ht* ht)
+{
+	assert(ht != NULL);
+
+	free(ht->slots);
+
+	ht->slots = NULL;
+	ht->mask = 0;
+}
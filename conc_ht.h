@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_CONC_HT_H
+#define _LDNS_MERGEZONE_CONC_HT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Handle for an item in a concurrent hash table, must be the first member of the item */
+typedef struct
+{
+	uint64_t	hash;
+}
+conc_ht_handle;
+
+/* Key comparison function; return 0 if the item has the specified key */
+typedef int (*conc_ht_keycmp)(const conc_ht_handle* item, const void* key);
+
+/* Concurrent hash table */
+typedef struct
+{
+	conc_ht_handle**	slots;
+	size_t			mask;
+	int			frozen;
+}
+conc_ht;
+
+/* Initialise a table that can hold the specified number of items */
+int ldns_mergezone_conc_ht_init(conc_ht* ht, const size_t max_items);
+
+/* Insert an item, returns 1 and the item with the same key if there is one; safe to call from many threads */
+int ldns_mergezone_conc_ht_insert(conc_ht* ht, conc_ht_handle* item, const void* key, conc_ht_keycmp keycmp, conc_ht_handle** existing);
+
+/* Switch the table to read-only mode once all inserting threads have been joined */
+void ldns_mergezone_conc_ht_freeze(conc_ht* ht);
+
+/* Find the item with the specified hash and key */
+conc_ht_handle* ldns_mergezone_conc_ht_find(const conc_ht* ht, const uint64_t hash, const void* key, conc_ht_keycmp keycmp);
+
+/* Clean up; items are owned by the caller */
+void ldns_mergezone_conc_ht_free(conc_ht* ht);
+
+#endif /* !_LDNS_MERGEZONE_CONC_HT_H */
@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "conform.h"
+#include "dname.h"
+#include "reader.h"
+#include "verbose.h"
+
+/*
+ * The checker keeps state for a single owner name at a time, so memory use
+ * is bounded by the number of RRsets at one owner name. This assumes that
+ * records for an owner name are grouped together, which is what signers
+ * produce and what the merge preserves.
+ *
+ * A zone merged from more than two zones is signed with the "from"
+ * algorithm and several "to" algorithms, which are kept in a table indexed
+ * by algorithm. When the algorithms are inferred from the zone, the lowest
+ * one is taken as the "from" algorithm, which only matters for the DNSKEY
+ * RRset of output types 1 and 3.
+ */
+
+/* Algorithm pair state */
+#define CONFORM_ALGOS_UNKNOWN	0
+#define CONFORM_ALGOS_INFERRED	1
+#define CONFORM_ALGOS_SUPPLIED	2
+
+/* Report a conformance violation for an RRset at the current owner name */
+static void ldns_mergezone_conform_violation(conform_ctx* ctx, const uint16_t type, const char* fmt, ...)
+{
+	char*	owner_name	= ldns_rdf2str(ctx->cur_owner);
+	char*	type_name	= ldns_rr_type2str((ldns_rr_type) type);
+	va_list	args;
+
+	fprintf(stderr, "Conformance violation at %s %s: ", owner_name, type_name);
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+
+	fprintf(stderr, "\n");
+
+	free(owner_name);
+	free(type_name);
+
+	ctx->violations++;
+}
+
+/* Find or add the state for the RRset of the specified type at the current owner */
+static conform_rrset* ldns_mergezone_conform_get_rrset(conform_ctx* ctx, const uint16_t type)
+{
+	size_t	i	= 0;
+
+	for (i = 0; i < ctx->rrset_count; i++)
+	{
+		if (ctx->rrsets[i].type == type)
+		{
+			return &ctx->rrsets[i];
+		}
+	}
+
+	if (ctx->rrset_count == ctx->rrset_alloc)
+	{
+		ctx->rrset_alloc = (ctx->rrset_alloc == 0) ? 16 : ctx->rrset_alloc * 2;
+		ctx->rrsets = (conform_rrset*) realloc(ctx->rrsets, ctx->rrset_alloc * sizeof(conform_rrset));
+
+		assert(ctx->rrsets != NULL);
+	}
+
+	memset(&ctx->rrsets[ctx->rrset_count], 0, sizeof(conform_rrset));
+	ctx->rrsets[ctx->rrset_count].type = type;
+
+	return &ctx->rrsets[ctx->rrset_count++];
+}
+
+/* Count the distinct algorithms in a per-algorithm table, returns the first one found */
+static int ldns_mergezone_conform_distinct_algos(const uint8_t* table, int* first)
+{
+	int	algo		= 0;
+	int	distinct	= 0;
+
+	for (algo = 0; algo < 256; algo++)
+	{
+		if (table[algo] == 0)
+		{
+			continue;
+		}
+
+		if (distinct == 0)
+		{
+			*first = algo;
+		}
+
+		distinct++;
+	}
+
+	return distinct;
+}
+
+/* Check if the zone is signed with an algorithm */
+static int ldns_mergezone_conform_signing_algo(const conform_ctx* ctx, const int algo)
+{
+	return (algo == ctx->from_algo) || (ctx->to_algos[algo] != 0);
+}
+
+/* Check if the output zone type requires keys with an algorithm in the DNSKEY RRset */
+static int ldns_mergezone_conform_key_algo(const conform_ctx* ctx, const int algo)
+{
+	switch(ctx->out_type)
+	{
+	case 1:
+		return (algo == ctx->from_algo);
+	case 3:
+		return (ctx->to_algos[algo] != 0);
+	default:
+		return ldns_mergezone_conform_signing_algo(ctx, algo);
+	}
+}
+
+/* Check the RRSIGs for an RRset; DNSKEY RRsets may have more than one RRSIG per algorithm */
+static void ldns_mergezone_conform_check_sigs(conform_ctx* ctx, conform_rrset* rrset)
+{
+	int	first		= 0;
+	int	distinct	= ldns_mergezone_conform_distinct_algos(rrset->sig_count, &first);
+	int	algo		= 0;
+
+	if (ctx->have_algos == CONFORM_ALGOS_UNKNOWN)
+	{
+		if (distinct < 2)
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "signed with %d algorithm(s), expected at least 2", distinct);
+
+			return;
+		}
+
+		ctx->from_algo = first;
+
+		for (algo = first + 1; algo < 256; algo++)
+		{
+			if (rrset->sig_count[algo] > 0)
+			{
+				ctx->to_algos[algo] = 1;
+				ctx->to_count++;
+			}
+		}
+
+		ctx->have_algos = CONFORM_ALGOS_INFERRED;
+
+		VERBOSE("Merged zone is signed using %d algorithms\n", distinct);
+	}
+
+	for (algo = 0; algo < 256; algo++)
+	{
+		if (ldns_mergezone_conform_signing_algo(ctx, algo))
+		{
+			if (rrset->sig_count[algo] == 0)
+			{
+				ldns_mergezone_conform_violation(ctx, rrset->type, "no RRSIG with algorithm %d", algo);
+			}
+			else if ((rrset->sig_count[algo] > 1) && (rrset->type != LDNS_RR_TYPE_DNSKEY))
+			{
+				ldns_mergezone_conform_violation(ctx, rrset->type, "%u RRSIGs with algorithm %d, expected exactly one", rrset->sig_count[algo], algo);
+			}
+		}
+		else if (rrset->sig_count[algo] > 0)
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "RRSIG with unexpected algorithm %d", algo);
+		}
+	}
+}
+
+/* Check the DNSKEY RRset against the requirements for the output zone type */
+static void ldns_mergezone_conform_check_dnskey(conform_ctx* ctx, conform_rrset* rrset)
+{
+	int	first		= 0;
+	int	distinct	= 0;
+	int	algo		= 0;
+
+	ctx->dnskey_rrsets++;
+
+	if (ctx->dnskey_rrsets > 1)
+	{
+		ldns_mergezone_conform_violation(ctx, rrset->type, "DNSKEY RRset appears more than once");
+	}
+
+	ldns_mergezone_conform_check_sigs(ctx, rrset);
+
+	if (ctx->have_algos == CONFORM_ALGOS_UNKNOWN)
+	{
+		/* Already reported by the signature check */
+		return;
+	}
+
+	distinct = ldns_mergezone_conform_distinct_algos(ctx->dnskey_algos, &first);
+
+	if ((ctx->have_algos == CONFORM_ALGOS_INFERRED) && (ctx->out_type != 2))
+	{
+		/* We cannot tell "from" and "to" apart, only that the keys of one algorithm or of all but one are there */
+		size_t	expect	= (ctx->out_type == 1) ? 1 : ctx->to_count;
+
+		for (algo = 0; algo < 256; algo++)
+		{
+			if ((ctx->dnskey_algos[algo] != 0) && !ldns_mergezone_conform_signing_algo(ctx, algo))
+			{
+				ldns_mergezone_conform_violation(ctx, rrset->type, "key with algorithm %d, which the zone is not signed with", algo);
+			}
+		}
+
+		if ((size_t) distinct != expect)
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "keys with %d algorithm(s), expected %zu for output type %d", distinct, expect, ctx->out_type);
+		}
+
+		return;
+	}
+
+	for (algo = 0; algo < 256; algo++)
+	{
+		if ((ctx->dnskey_algos[algo] != 0) && !ldns_mergezone_conform_key_algo(ctx, algo))
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "unexpected key with algorithm %d for output type %d", algo, ctx->out_type);
+		}
+		else if ((ctx->dnskey_algos[algo] == 0) && ldns_mergezone_conform_key_algo(ctx, algo))
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "no key with algorithm %d for output type %d", algo, ctx->out_type);
+		}
+	}
+}
+
+/* Check all RRsets at the current owner name and reset the owner state */
+static void ldns_mergezone_conform_flush_owner(conform_ctx* ctx)
+{
+	size_t	i		= 0;
+	int	has_soa		= 0;
+	int	has_ns		= 0;
+	int	owner_signed	= 0;
+
+	if (ctx->cur_owner == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < ctx->rrset_count; i++)
+	{
+		int	algo	= 0;
+
+		if (ctx->rrsets[i].type == LDNS_RR_TYPE_SOA) has_soa = 1;
+		if (ctx->rrsets[i].type == LDNS_RR_TYPE_NS) has_ns = 1;
+
+		for (algo = 0; (algo < 256) && !owner_signed; algo++)
+		{
+			owner_signed = (ctx->rrsets[i].sig_count[algo] > 0);
+		}
+	}
+
+	for (i = 0; i < ctx->rrset_count; i++)
+	{
+		conform_rrset*	rrset	= &ctx->rrsets[i];
+
+		ctx->checked_rrsets++;
+
+		if (rrset->rr_count == 0)
+		{
+			ldns_mergezone_conform_violation(ctx, rrset->type, "RRSIG(s) without the RRset they cover");
+		}
+		else if (rrset->type == LDNS_RR_TYPE_DNSKEY)
+		{
+			ldns_mergezone_conform_check_dnskey(ctx, rrset);
+		}
+		else if (!owner_signed)
+		{
+			/* Glue or otherwise occluded data is not signed */
+		}
+		else if ((rrset->type == LDNS_RR_TYPE_NS) && has_ns && !has_soa)
+		{
+			/* The NS RRset at a delegation point is not signed */
+		}
+		else
+		{
+			ldns_mergezone_conform_check_sigs(ctx, rrset);
+		}
+	}
+
+	ldns_rdf_deep_free(ctx->cur_owner);
+
+	ctx->cur_owner = NULL;
+	ctx->rrset_count = 0;
+
+	memset(ctx->dnskey_algos, 0, sizeof(ctx->dnskey_algos));
+}
+
+/* Initialise the checker with to_count "to" algorithms; pass 0 for unknown algorithms to infer them from the zone */
+void ldns_mergezone_conform_init(conform_ctx* ctx, const int out_type, const int from_algo, const int* to_algos, const size_t to_count)
+{
+	assert(ctx != NULL);
+	assert((out_type >= 1) && (out_type <= 3));
+
+	memset(ctx, 0, sizeof(conform_ctx));
+
+	ctx->out_type = out_type;
+	ctx->have_algos = CONFORM_ALGOS_UNKNOWN;
+
+	ldns_mergezone_conform_set_algos(ctx, from_algo, to_algos, to_count);
+}
+
+/* Set the "from" and "to" algorithms once they are known */
+void ldns_mergezone_conform_set_algos(conform_ctx* ctx, const int from_algo, const int* to_algos, const size_t to_count)
+{
+	size_t	i	= 0;
+
+	assert(ctx != NULL);
+
+	if ((from_algo <= 0) || (to_count == 0))
+	{
+		return;
+	}
+
+	assert(to_algos != NULL);
+
+	for (i = 0; i < to_count; i++)
+	{
+		if ((to_algos[i] <= 0) || (to_algos[i] > 255))
+		{
+			return;
+		}
+	}
+
+	memset(ctx->to_algos, 0, sizeof(ctx->to_algos));
+
+	ctx->from_algo = from_algo;
+	ctx->to_count = to_count;
+
+	for (i = 0; i < to_count; i++)
+	{
+		ctx->to_algos[to_algos[i]] = 1;
+	}
+
+	ctx->have_algos = CONFORM_ALGOS_SUPPLIED;
+}
+
+/* Feed the next record of the merged zone to the checker */
+void ldns_mergezone_conform_add_rr(conform_ctx* ctx, const ldns_rr* rr)
+{
+	assert(ctx != NULL);
+	assert(rr != NULL);
+
+	uint16_t	type	= ldns_rr_get_type(rr);
+	conform_rrset*	rrset	= NULL;
+
+	ctx->records++;
+
+	if ((ctx->cur_owner == NULL) || !ldns_mergezone_dname_rdf_equal(ctx->cur_owner, ldns_rr_owner(rr)))
+	{
+		ldns_mergezone_conform_flush_owner(ctx);
+
+		ctx->cur_owner = ldns_rdf_clone(ldns_rr_owner(rr));
+	}
+
+	if (type == LDNS_RR_TYPE_RRSIG)
+	{
+		assert(ldns_rr_rd_count(rr) == 9);
+
+		uint8_t	algo	= ldns_rdf2native_int8(ldns_rr_rdf(rr, 1));
+
+		rrset = ldns_mergezone_conform_get_rrset(ctx, ldns_rdf2native_int16(ldns_rr_rdf(rr, 0)));
+
+		if (rrset->sig_count[algo] < UINT8_MAX)
+		{
+			rrset->sig_count[algo]++;
+		}
+	}
+	else
+	{
+		rrset = ldns_mergezone_conform_get_rrset(ctx, type);
+
+		rrset->rr_count++;
+
+		if (type == LDNS_RR_TYPE_DNSKEY)
+		{
+			assert(ldns_rr_rd_count(rr) == 4);
+
+			ctx->dnskey_algos[ldns_rdf2native_int8(ldns_rr_rdf(rr, 2))] = 1;
+		}
+	}
+}
+
+/* Finish checking, returns 0 if the zone conforms */
+int ldns_mergezone_conform_finish(conform_ctx* ctx)
+{
+	assert(ctx != NULL);
+
+	ldns_mergezone_conform_flush_owner(ctx);
+
+	if (ctx->dnskey_rrsets == 0)
+	{
+		fprintf(stderr, "Conformance violation: merged zone has no DNSKEY RRset\n");
+
+		ctx->violations++;
+	}
+
+	free(ctx->rrsets);
+
+	ctx->rrsets = NULL;
+	ctx->rrset_count = 0;
+	ctx->rrset_alloc = 0;
+
+	VERBOSE("Checked %zd records in %zd RRsets, found %zd conformance violation(s)\n", ctx->records, ctx->checked_rrsets, ctx->violations);
+
+	return (ctx->violations == 0) ? 0 : 1;
+}
+
+/* Clean up without finishing, for when the merge failed */
+void ldns_mergezone_conform_free(conform_ctx* ctx)
+{
+	assert(ctx != NULL);
+
+	ldns_rdf_deep_free(ctx->cur_owner);
+	free(ctx->rrsets);
+
+	ctx->cur_owner = NULL;
+	ctx->rrsets = NULL;
+	ctx->rrset_count = 0;
+	ctx->rrset_alloc = 0;
+}
+
+/* Check a merged zone on disk in a single streaming pass */
+int ldns_mergezone_conform_check_file(const char* zone_file, const int out_type)
+{
+	ldns_rr*	rr	= NULL;
+	int		rv	= 0;
+	zone_reader	reader;
+	conform_ctx	ctx;
+
+	if (ldns_mergezone_reader_open(&reader, zone_file) != 0)
+	{
+		return 1;
+	}
+
+	ldns_mergezone_conform_init(&ctx, out_type, 0, NULL, 0);
+
+	while ((rv = ldns_mergezone_reader_next_rr(&reader, &rr)) == 0)
+	{
+		if (rr == NULL)
+		{
+			break;
+		}
+
+		ldns_mergezone_conform_add_rr(&ctx, rr);
+		ldns_rr_free(rr);
+	}
+
+	ldns_mergezone_reader_close(&reader);
+
+	if (ldns_mergezone_conform_finish(&ctx) != 0)
+	{
+		rv = 1;
+	}
+
+	return rv;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_CONFORM_H
+#define _LDNS_MERGEZONE_CONFORM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* State for a single RRset at the owner name currently being checked */
+typedef struct
+{
+	uint16_t	type;
+	size_t		rr_count;
+	uint8_t		sig_count[256];
+}
+conform_rrset;
+
+/* Conformance checker state */
+typedef struct
+{
+	int		out_type;
+	int		from_algo;
+	uint8_t		to_algos[256];
+	size_t		to_count;
+	int		have_algos;
+	ldns_rdf*	cur_owner;
+	conform_rrset*	rrsets;
+	size_t		rrset_count;
+	size_t		rrset_alloc;
+	uint8_t		dnskey_algos[256];
+	size_t		dnskey_rrsets;
+	size_t		records;
+	size_t		checked_rrsets;
+	size_t		violations;
+}
+conform_ctx;
+
+/* Initialise the checker with to_count "to" algorithms; pass 0 for unknown algorithms to infer them from the zone */
+void ldns_mergezone_conform_init(conform_ctx* ctx, const int out_type, const int from_algo, const int* to_algos, const size_t to_count);
+
+/* Set the "from" and "to" algorithms once they are known */
+void ldns_mergezone_conform_set_algos(conform_ctx* ctx, const int from_algo, const int* to_algos, const size_t to_count);
+
+/* Feed the next record of the merged zone to the checker */
+void ldns_mergezone_conform_add_rr(conform_ctx* ctx, const ldns_rr* rr);
+
+/* Finish checking, returns 0 if the zone conforms */
+int ldns_mergezone_conform_finish(conform_ctx* ctx);
+
+/* Clean up without finishing, for when the merge failed */
+void ldns_mergezone_conform_free(conform_ctx* ctx);
+
+/* Check a merged zone on disk in a single streaming pass */
+int ldns_mergezone_conform_check_file(const char* zone_file, const int out_type);
+
+#endif /* !_LDNS_MERGEZONE_CONFORM_H */
@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "diff.h"
+#include "sort.h"
+#include "format.h"
+#include "reader.h"
+#include "verbose.h"
+#include "progress.h"
+#include "metrics.h"
+
+/*
+ * Both zones are read as a stream and walked side by side in canonical
+ * order, the same way two sorted runs are merged: a record that is only
+ * in the old zone is deleted, a record that is only in the new zone is
+ * added. Records that only differ in their TTL are both deleted and
+ * added, since IXFR has no other way to change a TTL. Only the current
+ * record of each zone is kept in memory.
+ *
+ * Merged zones are in canonical order if the "from" zone was sorted (-s),
+ * so the zones are first compared as they are. As soon as a record turns
+ * up out of order, the comparison is abandoned and both zones are sorted
+ * into temporary files, after which the comparison is started over.
+ *
+ * Deleted records go straight to the output file; added records are
+ * collected in a temporary file and copied to the output at the end.
+ */
+
+/* Size at which formatted output is written out */
+#define DIFF_OUT_CHUNK	(256 * 1024)
+
+/* Zone being compared */
+typedef struct
+{
+	zone_reader	reader;
+	ldns_rr*	soa;
+	ldns_rr*	rr;
+	uint8_t*	wire;
+	size_t		wire_len;
+	uint8_t*	prev;
+	size_t		prev_len;
+	int		sorted;
+}
+diff_input;
+
+/* Output with formatting buffer */
+typedef struct
+{
+	FILE*		fp;
+	ldns_buffer*	text;
+	const char*	name;
+}
+diff_output;
+
+/* Read the next record of a zone; rr is NULL at the end of the zone */
+static int ldns_mergezone_diff_next(diff_input* in)
+{
+	free(in->prev);
+	ldns_rr_free(in->rr);
+
+	in->prev = in->wire;
+	in->prev_len = in->wire_len;
+	in->rr = NULL;
+	in->wire = NULL;
+	in->wire_len = 0;
+
+	if (ldns_mergezone_reader_next_rr(&in->reader, &in->rr) != 0)
+	{
+		return 1;
+	}
+
+	if (in->rr == NULL)
+	{
+		return 0;
+	}
+
+	/* A second SOA record is dropped when the zone is sorted */
+	if (ldns_rr_get_type(in->rr) == LDNS_RR_TYPE_SOA)
+	{
+		in->sorted = 0;
+
+		return 0;
+	}
+
+	if (ldns_rr2wire(&in->wire, in->rr, LDNS_SECTION_ANSWER, &in->wire_len) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to convert record from %s to wire format\n", in->reader.name);
+
+		return 1;
+	}
+
+	if ((in->prev != NULL) && (ldns_mergezone_sort_rec_compare(in->prev, in->prev_len, in->wire, in->wire_len) > 0))
+	{
+		in->sorted = 0;
+	}
+
+	return 0;
+}
+
+/* Open a zone and read its SOA record, which must come first in canonical order */
+static int ldns_mergezone_diff_open(diff_input* in, const char* zone_file)
+{
+	in->sorted = 1;
+
+	if (ldns_mergezone_reader_open(&in->reader, zone_file) != 0)
+	{
+		return 1;
+	}
+
+	if (ldns_mergezone_reader_next_rr(&in->reader, &in->soa) != 0)
+	{
+		return 1;
+	}
+
+	if ((in->soa == NULL) || (ldns_rr_get_type(in->soa) != LDNS_RR_TYPE_SOA))
+	{
+		in->sorted = 0;
+
+		return 0;
+	}
+
+	return ldns_mergezone_diff_next(in);
+}
+
+/* Clean up */
+static void ldns_mergezone_diff_close(diff_input* in)
+{
+	ldns_mergezone_reader_close(&in->reader);
+
+	ldns_rr_free(in->soa);
+	ldns_rr_free(in->rr);
+
+	free(in->wire);
+	free(in->prev);
+}
+
+/* Write the formatted records to the output file */
+static int ldns_mergezone_diff_flush(diff_output* out)
+{
+	if (fwrite(ldns_buffer_begin(out->text), 1, ldns_buffer_position(out->text), out->fp) != ldns_buffer_position(out->text))
+	{
+		fprintf(stderr, "Failed to write to %s\n", out->name);
+
+		return 1;
+	}
+
+	ldns_buffer_clear(out->text);
+
+	return 0;
+}
+
+/* Append a record to the output */
+static int ldns_mergezone_diff_write_rr(diff_output* out, const ldns_rr* rr)
+{
+	if (ldns_mergezone_format_rr(out->text, rr) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to format record\n");
+
+		return 1;
+	}
+
+	if (ldns_buffer_position(out->text) >= DIFF_OUT_CHUNK)
+	{
+		return ldns_mergezone_diff_flush(out);
+	}
+
+	return 0;
+}
+
+/* Compare two records in canonical order, and then on their TTL */
+static int ldns_mergezone_diff_compare(const diff_input* old_in, const diff_input* new_in)
+{
+	int	rv	= ldns_mergezone_sort_rec_compare(old_in->wire, old_in->wire_len, new_in->wire, new_in->wire_len);
+
+	if (rv != 0)
+	{
+		return rv;
+	}
+
+	if (ldns_rr_ttl(old_in->rr) != ldns_rr_ttl(new_in->rr))
+	{
+		return (ldns_rr_ttl(old_in->rr) < ldns_rr_ttl(new_in->rr)) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* Copy the added records from the temporary file to the output */
+static int ldns_mergezone_diff_copy_added(diff_output* out, FILE* added_fp)
+{
+	char	buf[DIFF_OUT_CHUNK];
+	size_t	len	= 0;
+
+	if (fflush(added_fp) != 0)
+	{
+		fprintf(stderr, "Failed to write to temporary file\n");
+
+		return 1;
+	}
+
+	rewind(added_fp);
+
+	while ((len = fread(buf, 1, sizeof(buf), added_fp)) > 0)
+	{
+		if (fwrite(buf, 1, len, out->fp) != len)
+		{
+			fprintf(stderr, "Failed to write to %s\n", out->name);
+
+			return 1;
+		}
+	}
+
+	if (ferror(added_fp))
+	{
+		fprintf(stderr, "Failed to read from temporary file\n");
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Check that the serial of the new zone is newer (RFC 1982) */
+static int ldns_mergezone_diff_check_serial(const ldns_rr* old_soa, const ldns_rr* new_soa)
+{
+	uint32_t	old_serial	= ldns_rdf2native_int32(ldns_rr_rdf(old_soa, 2));
+	uint32_t	new_serial	= ldns_rdf2native_int32(ldns_rr_rdf(new_soa, 2));
+
+	if ((int32_t) (new_serial - old_serial) <= 0)
+	{
+		fprintf(stderr, "Serial %u of the new zone is not newer than serial %u of the old zone\n", new_serial, old_serial);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Compare two zones and write the difference; sets *sorted to 0 and stops if either zone is not in canonical order */
+static int ldns_mergezone_diff_sorted(const char* old_zone, const char* new_zone, const char* diff_file, int* sorted)
+{
+	diff_input	old_in;
+	diff_input	new_in;
+	diff_output	out;
+	diff_output	added;
+	size_t		deleted_count	= 0;
+	size_t		added_count	= 0;
+	int		cmp		= 0;
+	int		rv		= 0;
+
+	memset(&old_in, 0, sizeof(diff_input));
+	memset(&new_in, 0, sizeof(diff_input));
+	memset(&out, 0, sizeof(diff_output));
+	memset(&added, 0, sizeof(diff_output));
+
+	*sorted = 1;
+
+	if ((ldns_mergezone_diff_open(&old_in, old_zone) != 0) || (ldns_mergezone_diff_open(&new_in, new_zone) != 0))
+	{
+		ldns_mergezone_diff_close(&old_in);
+		ldns_mergezone_diff_close(&new_in);
+
+		return 1;
+	}
+
+	if (!old_in.sorted || !new_in.sorted)
+	{
+		*sorted = 0;
+	}
+	else if ((rv = ldns_mergezone_diff_check_serial(old_in.soa, new_in.soa)) == 0)
+	{
+		out.name = diff_file;
+		out.text = ldns_buffer_new(DIFF_OUT_CHUNK + LDNS_MAX_LINELEN);
+		added.name = "temporary file";
+		added.text = ldns_buffer_new(DIFF_OUT_CHUNK + LDNS_MAX_LINELEN);
+
+		assert((out.text != NULL) && (added.text != NULL));
+
+		if ((out.fp = fopen(diff_file, "w")) == NULL)
+		{
+			fprintf(stderr, "Failed to open %s for writing\n", diff_file);
+
+			rv = 1;
+		}
+		else if ((added.fp = ldns_mergezone_sort_tmpfile()) == NULL)
+		{
+			rv = 1;
+		}
+	}
+
+	/* The deleted records are preceded by the new and the old SOA record */
+	if ((rv == 0) && *sorted)
+	{
+		rv = ldns_mergezone_diff_write_rr(&out, new_in.soa) || ldns_mergezone_diff_write_rr(&out, old_in.soa);
+	}
+
+	while ((rv == 0) && *sorted && ((old_in.rr != NULL) || (new_in.rr != NULL)))
+	{
+		if (!old_in.sorted || !new_in.sorted)
+		{
+			*sorted = 0;
+
+			break;
+		}
+
+		if (old_in.rr == NULL)
+		{
+			cmp = 1;
+		}
+		else if (new_in.rr == NULL)
+		{
+			cmp = -1;
+		}
+		else
+		{
+			cmp = ldns_mergezone_diff_compare(&old_in, &new_in);
+		}
+
+		if (cmp < 0)
+		{
+			deleted_count++;
+
+			rv = ldns_mergezone_diff_write_rr(&out, old_in.rr) || ldns_mergezone_diff_next(&old_in);
+		}
+		else if (cmp > 0)
+		{
+			added_count++;
+
+			rv = ldns_mergezone_diff_write_rr(&added, new_in.rr) || ldns_mergezone_diff_next(&new_in);
+		}
+		else
+		{
+			rv = ldns_mergezone_diff_next(&old_in) || ldns_mergezone_diff_next(&new_in);
+		}
+	}
+
+	/* The added records are preceded and followed by the new SOA record */
+	if ((rv == 0) && *sorted)
+	{
+		rv = ldns_mergezone_diff_write_rr(&out, new_in.soa) ||
+		     ldns_mergezone_diff_flush(&out) ||
+		     ldns_mergezone_diff_flush(&added) ||
+		     ldns_mergezone_diff_copy_added(&out, added.fp) ||
+		     ldns_mergezone_diff_write_rr(&out, new_in.soa) ||
+		     ldns_mergezone_diff_flush(&out);
+	}
+
+	if (added.fp != NULL)
+	{
+		fclose(added.fp);
+	}
+
+	if (out.fp != NULL)
+	{
+		if ((fclose(out.fp) != 0) && (rv == 0))
+		{
+			fprintf(stderr, "Failed to write to %s\n", diff_file);
+
+			rv = 1;
+		}
+
+		if ((rv != 0) || !*sorted)
+		{
+			unlink(diff_file);
+		}
+	}
+
+	if (out.text != NULL)
+	{
+		ldns_buffer_free(out.text);
+	}
+
+	if (added.text != NULL)
+	{
+		ldns_buffer_free(added.text);
+	}
+
+	if ((rv == 0) && *sorted)
+	{
+		VERBOSE("Difference between %s and %s has %zd deleted and %zd added records\n", old_zone, new_zone, deleted_count, added_count);
+
+		ldns_mergezone_metrics_set(METRIC_DIFF_RECORDS, "change", "deleted", deleted_count);
+		ldns_mergezone_metrics_set(METRIC_DIFF_RECORDS, "change", "added", added_count);
+	}
+
+	ldns_mergezone_diff_close(&old_in);
+	ldns_mergezone_diff_close(&new_in);
+
+	return rv;
+}
+
+/* Compare a new zone with the previously published version and write the difference as an IXFR response */
+int ldns_mergezone_diff_zone_files(const char* old_zone, const char* new_zone, const char* diff_file, const size_t mem_limit)
+{
+	char*	sorted_old	= NULL;
+	char*	sorted_new	= NULL;
+	int	sorted		= 0;
+	int	rv		= 0;
+
+	assert(old_zone != NULL);
+	assert(new_zone != NULL);
+	assert(diff_file != NULL);
+
+	ldns_mergezone_progress_phase("diff", 0, 0);
+
+	if ((rv = ldns_mergezone_diff_sorted(old_zone, new_zone, diff_file, &sorted)) != 0)
+	{
+		return rv;
+	}
+
+	if (sorted)
+	{
+		return 0;
+	}
+
+	VERBOSE("Zones %s and %s are not both in canonical order, sorting them first\n", old_zone, new_zone);
+
+	if (ldns_mergezone_sort_zone_tmpfile(old_zone, mem_limit, &sorted_old) != 0)
+	{
+		return 1;
+	}
+
+	if (ldns_mergezone_sort_zone_tmpfile(new_zone, mem_limit, &sorted_new) != 0)
+	{
+		unlink(sorted_old);
+		free(sorted_old);
+
+		return 1;
+	}
+
+	ldns_mergezone_progress_phase("diff sorted zones", 0, 0);
+
+	rv = ldns_mergezone_diff_sorted(sorted_old, sorted_new, diff_file, &sorted);
+
+	if ((rv == 0) && !sorted)
+	{
+		fprintf(stderr, "Sorted zones are not in canonical order\n");
+
+		rv = 1;
+	}
+
+	unlink(sorted_old);
+	unlink(sorted_new);
+
+	free(sorted_old);
+	free(sorted_new);
+
+	return rv;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "digest.h"
+#include "zonemd.h"
+#include "hash.h"
+
+/*
+ * The digest is the sum of two independent 64-bit hashes of each record
+ * in canonical wire format, so it does not depend on the order in which
+ * the records are read. Records that differ between zones signed with
+ * different algorithms (the SOA, DNSKEY and RRSIG records) are left out,
+ * so the digests of the two input zones must be equal. So is the ZONEMD
+ * record, which like the SOA only has a meaning at the apex: each signer
+ * computes it over its own signatures.
+ */
+
+/* Seeds of the two hashes */
+#define DIGEST_SEED_0	0x6c646e732d6d7a31ULL
+#define DIGEST_SEED_1	0x9e3779b97f4a7c15ULL
+
+/* Initialise an empty digest */
+void ldns_mergezone_digest_init(zone_digest* digest)
+{
+	assert(digest != NULL);
+
+	memset(digest, 0, sizeof(zone_digest));
+
+	digest->wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+
+	assert(digest->wire != NULL);
+}
+
+/* Check if a record is included in the digest (i.e. it is not an SOA, DNSKEY, RRSIG or ZONEMD record) */
+int ldns_mergezone_digest_covers(const ldns_rr* rr)
+{
+	switch((int) ldns_rr_get_type(rr))
+	{
+	case LDNS_RR_TYPE_SOA:
+	case LDNS_RR_TYPE_DNSKEY:
+	case LDNS_RR_TYPE_RRSIG:
+	case ZONEMD_RR_TYPE:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+/* Add a record to the digest if it is included */
+int ldns_mergezone_digest_add_rr(zone_digest* digest, const ldns_rr* rr)
+{
+	assert(digest != NULL);
+	assert(rr != NULL);
+
+	if (!ldns_mergezone_digest_covers(rr))
+	{
+		return 0;
+	}
+
+	ldns_buffer_clear(digest->wire);
+
+	if (ldns_rr2buffer_wire_canonical(digest->wire, rr, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to convert record to canonical wire format\n");
+
+		return 1;
+	}
+
+	digest->sum[0] += ldns_mergezone_hash_bytes(ldns_buffer_begin(digest->wire), ldns_buffer_position(digest->wire), DIGEST_SEED_0);
+	digest->sum[1] += ldns_mergezone_hash_bytes(ldns_buffer_begin(digest->wire), ldns_buffer_position(digest->wire), DIGEST_SEED_1);
+	digest->count++;
+
+	return 0;
+}
+
+/* Check if two digests are equal */
+int ldns_mergezone_digest_equal(const zone_digest* left, const zone_digest* right)
+{
+	assert(left != NULL);
+	assert(right != NULL);
+
+	return (left->count == right->count) && (left->sum[0] == right->sum[0]) && (left->sum[1] == right->sum[1]);
+}
+
+/* Clean up */
+void ldns_mergezone_digest_free(zone_digest* digest)
+{
+	assert(digest != NULL);
+
+	if (digest->wire != NULL)
+	{
+		ldns_buffer_free(digest->wire);
+	}
+
+	digest->wire = NULL;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_DIGEST_H
+#define _LDNS_MERGEZONE_DIGEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* Order-independent digest of the records of a zone that are not specific to how it was signed */
+typedef struct
+{
+	uint64_t	sum[2];
+	size_t		count;
+	ldns_buffer*	wire;
+}
+zone_digest;
+
+/* Initialise an empty digest */
+void ldns_mergezone_digest_init(zone_digest* digest);
+
+/* Check if a record is included in the digest (i.e. it is not an SOA, DNSKEY, RRSIG or ZONEMD record) */
+int ldns_mergezone_digest_covers(const ldns_rr* rr);
+
+/* Add a record to the digest if it is included */
+int ldns_mergezone_digest_add_rr(zone_digest* digest, const ldns_rr* rr);
+
+/* Check if two digests are equal */
+int ldns_mergezone_digest_equal(const zone_digest* left, const zone_digest* right);
+
+/* Clean up */
+void ldns_mergezone_digest_free(zone_digest* digest);
+
+#endif /* !_LDNS_MERGEZONE_DIGEST_H */
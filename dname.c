@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "dname.h"
+
+/*
+ * Owner names are compared and folded on their wire format. Label length
+ * octets are at most 63 and can therefore never be mistaken for an upper
+ * case ASCII letter, so a whole name can be folded in one go. The vector
+ * code paths are selected at compile time; SSE2 is always available on
+ * x86-64, AVX2 is used when building with -mavx2 (or -march=native).
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Maximum number of labels in a wire-format name */
+#define DNAME_MAX_LABELS	128
+
+static inline uint8_t ldns_mergezone_fold(const uint8_t c)
+{
+	return ((c >= 'A') && (c <= 'Z')) ? (c | 0x20) : c;
+}
+
+#if defined(__AVX2__)
+static inline __m256i ldns_mergezone_fold256(const __m256i v)
+{
+	__m256i	upper	= _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+
+	return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i ldns_mergezone_fold128(const __m128i v)
+{
+	__m128i	upper	= _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+
+	return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+/* Return the offset of the first octet that differs between a and b ignoring case, or len */
+static size_t ldns_mergezone_dname_mismatch(const uint8_t* a, const uint8_t* b, const size_t len)
+{
+	size_t	i	= 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i		va	= ldns_mergezone_fold256(_mm256_loadu_si256((const __m256i*) (a + i)));
+		__m256i		vb	= ldns_mergezone_fold256(_mm256_loadu_si256((const __m256i*) (b + i)));
+		uint32_t	neq	= ~((uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+
+		if (neq != 0)
+		{
+			return i + __builtin_ctz(neq);
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i		va	= ldns_mergezone_fold128(_mm_loadu_si128((const __m128i*) (a + i)));
+		__m128i		vb	= ldns_mergezone_fold128(_mm_loadu_si128((const __m128i*) (b + i)));
+		uint32_t	neq	= ~((uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xffff;
+
+		if (neq != 0)
+		{
+			return i + __builtin_ctz(neq);
+		}
+	}
+#endif
+
+	for (; i < len; i++)
+	{
+		if (ldns_mergezone_fold(a[i]) != ldns_mergezone_fold(b[i]))
+		{
+			return i;
+		}
+	}
+
+	return len;
+}
+
+/* Record the offset of each label in a wire-format name, returns the number of labels */
+static int ldns_mergezone_dname_labels(const uint8_t* name, const size_t len, uint8_t* offsets)
+{
+	size_t	pos	= 0;
+	int	count	= 0;
+
+	while ((pos < len) && (name[pos] != 0) && (count < DNAME_MAX_LABELS))
+	{
+		if (pos + 1 + name[pos] > len)
+		{
+			/* Truncated label, ignore the remainder */
+			break;
+		}
+
+		offsets[count++] = (uint8_t) pos;
+
+		pos += 1 + name[pos];
+	}
+
+	return count;
+}
+
+/* Convert a wire-format name to lower case; dst and src may be the same */
+void ldns_mergezone_dname_tolower(uint8_t* dst, const uint8_t* src, const size_t len)
+{
+	assert((dst != NULL) || (len == 0));
+	assert((src != NULL) || (len == 0));
+
+	size_t	i	= 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= len; i += 32)
+	{
+		_mm256_storeu_si256((__m256i*) (dst + i), ldns_mergezone_fold256(_mm256_loadu_si256((const __m256i*) (src + i))));
+	}
+#endif
+
+#if defined(__SSE2__)
+	for (; i + 16 <= len; i += 16)
+	{
+		_mm_storeu_si128((__m128i*) (dst + i), ldns_mergezone_fold128(_mm_loadu_si128((const __m128i*) (src + i))));
+	}
+#endif
+
+	for (; i < len; i++)
+	{
+		dst[i] = ldns_mergezone_fold(src[i]);
+	}
+}
+
+/* Check if two wire-format names are equal, ignoring case */
+int ldns_mergezone_dname_equal(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len)
+{
+	if (left_len != right_len)
+	{
+		return 0;
+	}
+
+	return ldns_mergezone_dname_mismatch(left, right, left_len) == left_len;
+}
+
+/* Compare two wire-format names in canonical order (RFC 4034 section 6.1) */
+int ldns_mergezone_dname_compare(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len)
+{
+	uint8_t	left_offsets[DNAME_MAX_LABELS];
+	uint8_t	right_offsets[DNAME_MAX_LABELS];
+	int	left_labels	= ldns_mergezone_dname_labels(left, left_len, left_offsets);
+	int	right_labels	= ldns_mergezone_dname_labels(right, right_len, right_offsets);
+
+	/* Compare labels from the root down */
+	while ((left_labels > 0) && (right_labels > 0))
+	{
+		const uint8_t*	left_label	= left + left_offsets[--left_labels];
+		const uint8_t*	right_label	= right + right_offsets[--right_labels];
+		size_t		min_len		= (left_label[0] < right_label[0]) ? left_label[0] : right_label[0];
+		size_t		diff		= ldns_mergezone_dname_mismatch(left_label + 1, right_label + 1, min_len);
+
+		if (diff < min_len)
+		{
+			return (ldns_mergezone_fold(left_label[1 + diff]) < ldns_mergezone_fold(right_label[1 + diff])) ? -1 : 1;
+		}
+
+		if (left_label[0] != right_label[0])
+		{
+			return (left_label[0] < right_label[0]) ? -1 : 1;
+		}
+	}
+
+	/* The name with fewer labels sorts first */
+	if (left_labels == right_labels)
+	{
+		return 0;
+	}
+
+	return (left_labels < right_labels) ? -1 : 1;
+}
+
+/* Check if two name rdfs are equal, ignoring case */
+int ldns_mergezone_dname_rdf_equal(const ldns_rdf* left, const ldns_rdf* right)
+{
+	assert(left != NULL);
+	assert(right != NULL);
+
+	return ldns_mergezone_dname_equal(ldns_rdf_data(left), ldns_rdf_size(left), ldns_rdf_data(right), ldns_rdf_size(right));
+}
+
+/* Compare two name rdfs in canonical order */
+int ldns_mergezone_dname_rdf_compare(const ldns_rdf* left, const ldns_rdf* right)
+{
+	assert(left != NULL);
+	assert(right != NULL);
+
+	return ldns_mergezone_dname_compare(ldns_rdf_data(left), ldns_rdf_size(left), ldns_rdf_data(right), ldns_rdf_size(right));
+}
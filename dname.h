@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_DNAME_H
+#define _LDNS_MERGEZONE_DNAME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* Convert a wire-format name to lower case; dst and src may be the same */
+void ldns_mergezone_dname_tolower(uint8_t* dst, const uint8_t* src, const size_t len);
+
+/* Check if two wire-format names are equal, ignoring case */
+int ldns_mergezone_dname_equal(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len);
+
+/* Compare two wire-format names in canonical order (RFC 4034 section 6.1) */
+int ldns_mergezone_dname_compare(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len);
+
+/* Check if two name rdfs are equal, ignoring case */
+int ldns_mergezone_dname_rdf_equal(const ldns_rdf* left, const ldns_rdf* right);
+
+/* Compare two name rdfs in canonical order */
+int ldns_mergezone_dname_rdf_compare(const ldns_rdf* left, const ldns_rdf* right);
+
+#endif /* !_LDNS_MERGEZONE_DNAME_H */
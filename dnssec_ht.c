@@ -34,82 +34,532 @@
 #include <string.h>
 #include <ldns/ldns.h>
 #include <assert.h>
+#include <pthread.h>
 #include "dnssec_ht.h"
+#include "conc_ht.h"
+#include "dname.h"
+#include "hash.h"
+#include "reader.h"
+#include "digest.h"
+#include "threads.h"
 #include "verbose.h"
-#include "uthash.h"
+#include "trace.h"
+
+/*
+ * The RRSIG index is populated by several worker threads, each taking a
+ * slice of the zone. Workers first count the RRSIGs in their slice so the
+ * index and its entries can be allocated once; they then insert directly
+ * into the lock-free index. Once all workers are done the index is frozen,
+ * after which lookups during the merge need no synchronisation.
+ *
+ * The merge marks each entry it matches. As an entry exists for every
+ * type covered and owner name, a second RRSIG for the same RRset anywhere
+ * in the "from" zone finds its entry marked, however the records of the
+ * zone are ordered, without keeping any state for the "from" zone.
+ *
+ * Indexed RRSIGs are not kept as ldns records, which take about a dozen
+ * allocations each. Instead, they are packed in wire format into a single
+ * arena, in zone order, and the ldns records are freed. The counting pass
+ * also sums the wire size of each slice, so every worker knows where its
+ * part of the arena starts. A matching RRSIG is only turned back into an
+ * ldns record when it is merged into the output.
+ */
+
+/* Do not bother starting a thread for fewer records than this */
+#define DNSSEC_HT_MIN_RECS_PER_THREAD	16384
+
+/* State for a thread populating part of the hash table */
+typedef struct
+{
+	dnssec_ht*	ht;
+	ldns_rr_list*	zone_rrs;
+	size_t		first;
+	size_t		last;
+	size_t		rrsig_count;
+	rrsig_ht_ent*	ents;
+	size_t		wire_size;
+	uint8_t*	wire;
+	ldns_buffer*	wire_buf;
+	ldns_rr_list*	dnskeys;
+	ldns_rr_list*	dnskey_rrsigs;
+	int		rv;
+	int		started;
+	pthread_t	thread;
+}
+dnssec_ht_worker;
+
+/* Compare the key of a hash table entry, returns 0 if it matches */
+static int ldns_mergezone_rrsig_key_cmp(const conc_ht_handle* item, const void* key)
+{
+	const rrsig_ht_key*	left	= &((const rrsig_ht_ent*) item)->type_and_owner;
+	const rrsig_ht_key*	right	= (const rrsig_ht_key*) key;
+
+	if (left->type_covered != right->type_covered)
+	{
+		return 1;
+	}
+
+	return ldns_mergezone_dname_equal(left->owner, left->owner_len, right->owner, right->owner_len) ? 0 : 1;
+}
+
+/* Build the hash table key for an RRSIG, returns the hash of the key */
+static uint64_t ldns_mergezone_rrsig_key(const ldns_rr* rrsig, rrsig_ht_key* key)
+{
+	ldns_rdf*	owner	= ldns_rr_owner(rrsig);
+
+	key->type_covered = ldns_rdf2native_int16(ldns_rr_rdf(rrsig, 0));
+	key->owner_len = ldns_rdf_size(owner);
+	key->owner = ldns_rdf_data(owner);
+
+	return ldns_mergezone_hash_owner(key->type_covered, key->owner, key->owner_len);
+}
+
+/* Describe an RRSIG by the type it covers and its owner, the caller must free the result */
+static char* ldns_mergezone_rrsig_desc(const ldns_rr* rrsig)
+{
+	char*	owner_name	= ldns_rdf2str(ldns_rr_owner(rrsig));
+	char*	desc		= (char*) malloc(strlen(owner_name) + 8);
+
+	sprintf(desc, "%u_%s", ldns_rdf2native_int16(ldns_rr_rdf(rrsig, 0)), owner_name);
+
+	free(owner_name);
+
+	return desc;
+}
+
+/* Check if a record is an RRSIG that goes in the hash table (i.e. not over a DNSKEY RRset) */
+static int ldns_mergezone_is_indexed_rrsig(const ldns_rr* rr)
+{
+	if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_RRSIG)
+	{
+		return 0;
+	}
+
+	assert(ldns_rr_rd_count(rr) == 9);
+
+	return ldns_rdf2native_int16(ldns_rr_rdf(rr, 0)) != LDNS_RR_TYPE_DNSKEY;
+}
+
+/* Count the RRSIGs that go in the hash table in a slice of the zone */
+static void* ldns_mergezone_dnssec_ht_count(void* arg)
+{
+	dnssec_ht_worker*	worker	= (dnssec_ht_worker*) arg;
+	size_t			i	= 0;
+	uint64_t		start	= 0;
+
+	TRACE_BEGIN(start);
+
+	for (i = worker->first; i < worker->last; i++)
+	{
+		ldns_rr*	rr	= ldns_rr_list_rr(worker->zone_rrs, i);
+
+		if (ldns_mergezone_is_indexed_rrsig(rr))
+		{
+			worker->rrsig_count++;
+			worker->wire_size += ldns_rr_uncompressed_size(rr);
+		}
+	}
+
+	TRACE_END(start, "index", "count");
+
+	return NULL;
+}
+
+/* Pack an RRSIG in wire format into the arena, returns 0 on success */
+static int ldns_mergezone_dnssec_ht_pack(dnssec_ht_worker* worker, const ldns_rr* rrsig, uint8_t* wire, uint32_t* wire_len)
+{
+	ldns_buffer_clear(worker->wire_buf);
+
+	if ((ldns_rr2buffer_wire(worker->wire_buf, rrsig, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK) ||
+	    (ldns_buffer_position(worker->wire_buf) != ldns_rr_uncompressed_size(rrsig)))
+	{
+		char*	desc	= ldns_mergezone_rrsig_desc(rrsig);
+
+		fprintf(stderr, "Failed to convert RRSIG for %s to wire format\n", desc);
+
+		free(desc);
+
+		return 1;
+	}
+
+	*wire_len = ldns_buffer_position(worker->wire_buf);
+
+	memcpy(wire, ldns_buffer_begin(worker->wire_buf), *wire_len);
+
+	return 0;
+}
+
+/* Add the DNSSEC data in a slice of the zone to the hash table */
+static void* ldns_mergezone_dnssec_ht_index(void* arg)
+{
+	dnssec_ht_worker*	worker		= (dnssec_ht_worker*) arg;
+	size_t			i		= 0;
+	size_t			ent		= 0;
+	size_t			wire_pos	= 0;
+	uint64_t		start		= 0;
+
+	TRACE_BEGIN(start);
+
+	for (i = worker->first; i < worker->last; i++)
+	{
+		ldns_rr*	rr	= ldns_rr_list_rr(worker->zone_rrs, i);
+
+		if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY)
+		{
+			ldns_rr_list_push_rr(worker->dnskeys, rr);
+		}
+		else if (ldns_mergezone_is_indexed_rrsig(rr))
+		{
+			rrsig_ht_ent*	htent		= &worker->ents[ent++];
+			conc_ht_handle*	existing	= NULL;
+			uint8_t*	wire		= &worker->wire[wire_pos];
+
+			if (ldns_mergezone_dnssec_ht_pack(worker, rr, wire, &htent->wire_len) != 0)
+			{
+				worker->rv = 1;
+
+				return NULL;
+			}
+
+			/* The wire format starts with the owner name, so the key can refer to the arena */
+			htent->hh.hash = ldns_mergezone_rrsig_key(rr, &htent->type_and_owner);
+			htent->type_and_owner.owner = wire;
+
+			wire_pos += htent->wire_len;
+
+			if (ldns_mergezone_conc_ht_insert(&worker->ht->rrsig_ht, &htent->hh, &htent->type_and_owner, ldns_mergezone_rrsig_key_cmp, &existing) != 0)
+			{
+				char*	desc	= ldns_mergezone_rrsig_desc(rr);
+
+				fprintf(stderr, "Found second RRSIG for %s\n", desc);
+
+				free(desc);
+
+				worker->rv = 1;
+
+				return NULL;
+			}
+
+			/* The RRSIG now lives in the arena */
+			ldns_rr_list_set_rr(worker->zone_rrs, NULL, i);
+			ldns_rr_free(rr);
+		}
+		else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG)
+		{
+			ldns_rr_list_push_rr(worker->dnskey_rrsigs, rr);
+		}
+	}
+
+	assert(ent == worker->rrsig_count);
+	assert(wire_pos == worker->wire_size);
+
+	TRACE_END(start, "index", "index");
+
+	return NULL;
+}
+
+/* Run the specified function on all workers, in parallel if there is more than one */
+static void ldns_mergezone_dnssec_ht_run(dnssec_ht_worker* workers, const int num_workers, void* (*fn)(void*))
+{
+	int	i	= 0;
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].started = (num_workers > 1) && (pthread_create(&workers[i].thread, NULL, fn, &workers[i]) == 0);
+
+		if (!workers[i].started)
+		{
+			fn(&workers[i]);
+		}
+	}
+
+	for (i = 0; i < num_workers; i++)
+	{
+		if (workers[i].started)
+		{
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+}
+
+/* Free the workers and their lists and buffers, but not the records in the lists */
+static void ldns_mergezone_dnssec_ht_free_workers(dnssec_ht_worker* workers, const int num_workers)
+{
+	int	i	= 0;
+
+	for (i = 0; i < num_workers; i++)
+	{
+		ldns_rr_list_free(workers[i].dnskeys);
+		ldns_rr_list_free(workers[i].dnskey_rrsigs);
+		ldns_buffer_free(workers[i].wire_buf);
+	}
+
+	free(workers);
+}
+
+/* Keep a record if it is needed for the hash table, add it to the digest otherwise; takes ownership of the record */
+static int ldns_mergezone_dnssec_zone_add_rr(ldns_zone* zone, zone_digest* digest, ldns_rr* rr, size_t* kept)
+{
+	int	rv	= 0;
+
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA)
+	{
+		/* Like ldns, keep the first SOA record and ignore the rest */
+		if (ldns_zone_soa(zone) == NULL)
+		{
+			ldns_zone_set_soa(zone, rr);
+
+			(*kept)++;
+		}
+		else
+		{
+			ldns_rr_free(rr);
+		}
+	}
+	else if (ldns_mergezone_digest_covers(rr))
+	{
+		rv = ldns_mergezone_digest_add_rr(digest, rr);
+
+		ldns_rr_free(rr);
+	}
+	else
+	{
+		ldns_zone_push_rr(zone, rr);
+
+		(*kept)++;
+	}
+
+	return rv;
+}
+
+/* Read a zone keeping only the records needed for the hash table; all other records except the SOA are added to the digest */
+int ldns_mergezone_read_dnssec_zone(const char* zone_file, ldns_zone** zone, zone_digest* digest)
+{
+	assert(zone_file != NULL);
+	assert(zone != NULL);
+	assert(digest != NULL);
+
+	zone_reader	reader;
+	ldns_rr*	rr	= NULL;
+	size_t		total	= 0;
+	size_t		kept	= 0;
+	int		rv	= 0;
+
+	if (ldns_mergezone_reader_open(&reader, zone_file) != 0)
+	{
+		return 1;
+	}
+
+	*zone = ldns_zone_new();
+
+	while ((rv = ldns_mergezone_reader_next_rr(&reader, &rr)) == 0)
+	{
+		if (rr == NULL)
+		{
+			break;
+		}
+
+		total++;
+
+		if ((rv = ldns_mergezone_dnssec_zone_add_rr(*zone, digest, rr, &kept)) != 0)
+		{
+			break;
+		}
+	}
+
+	ldns_mergezone_reader_close(&reader);
+
+	if (rv != 0)
+	{
+		ldns_zone_deep_free(*zone);
+
+		*zone = NULL;
+
+		return 1;
+	}
+
+	VERBOSE("Kept %zd of %zd records of %s in memory\n", kept, total, zone_file);
+
+	return 0;
+}
+
+/* Copy the records of a zone in memory that are needed for the hash table; all other records except the SOA are added to the digest */
+int ldns_mergezone_copy_dnssec_zone(const ldns_zone* in, ldns_zone** zone, zone_digest* digest)
+{
+	assert(in != NULL);
+	assert(zone != NULL);
+	assert(digest != NULL);
+
+	ldns_rr_list*	rrs	= ldns_zone_rrs(in);
+	size_t		kept	= 0;
+	size_t		i	= 0;
+	int		rv	= 0;
+
+	*zone = ldns_zone_new();
+
+	if (ldns_zone_soa(in) != NULL)
+	{
+		rv = ldns_mergezone_dnssec_zone_add_rr(*zone, digest, ldns_rr_clone(ldns_zone_soa(in)), &kept);
+	}
+
+	for (i = 0; (rv == 0) && (i < ldns_rr_list_rr_count(rrs)); i++)
+	{
+		const ldns_rr*	rr	= ldns_rr_list_rr(rrs, i);
+
+		/* Records that only go into the digest do not have to be copied */
+		if ((ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) && ldns_mergezone_digest_covers(rr))
+		{
+			rv = ldns_mergezone_digest_add_rr(digest, rr);
+		}
+		else
+		{
+			rv = ldns_mergezone_dnssec_zone_add_rr(*zone, digest, ldns_rr_clone(rr), &kept);
+		}
+	}
+
+	if (rv != 0)
+	{
+		ldns_zone_deep_free(*zone);
+
+		*zone = NULL;
+
+		return 1;
+	}
+
+	VERBOSE("Kept %zd of %zd records of the zone in memory\n", kept, ldns_rr_list_rr_count(rrs) + ((ldns_zone_soa(in) != NULL) ? 1 : 0));
+
+	return 0;
+}
 
-/* Populate hash table with DNSSEC data from this zone */
 int ldns_mergezone_populate_dnssec_ht(ldns_zone* zone, dnssec_ht* ht)
 {
 	assert(zone != NULL);
 	assert(ht != NULL);
 
-	size_t		i		= 0;
-	ldns_rr_list*	zone_rrs	= ldns_zone_rrs(zone);
+	ldns_rr_list*		zone_rrs	= ldns_zone_rrs(zone);
+	size_t			total		= ldns_rr_list_rr_count(zone_rrs);
+	int			num_workers	= get_threads();
+	dnssec_ht_worker*	workers		= NULL;
+	size_t			ent_offset	= 0;
+	size_t			wire_offset	= 0;
+	size_t			kept		= 0;
+	size_t			j		= 0;
+	int			i		= 0;
+	int			rv		= 0;
+
+	if ((total / DNSSEC_HT_MIN_RECS_PER_THREAD) < (size_t) num_workers)
+	{
+		num_workers = (total / DNSSEC_HT_MIN_RECS_PER_THREAD) + 1;
+	}
 
 	/* Initialise hash table */
-	ht->rrsig_ht = NULL;
+	memset(ht, 0, sizeof(dnssec_ht));
+
 	ht->dnskeys = ldns_rr_list_new();
 	ht->dnskey_rrsigs = ldns_rr_list_new();
 
-	for (i = 0; i < ldns_rr_list_rr_count(zone_rrs); i++)
-	{
-		ldns_rr*	rr	= ldns_rr_list_rr(zone_rrs, i);
+	workers = (dnssec_ht_worker*) calloc(num_workers, sizeof(dnssec_ht_worker));
 
-		if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY)
+	assert(workers != NULL);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].ht = ht;
+		workers[i].zone_rrs = zone_rrs;
+		workers[i].first = (total * i) / num_workers;
+		workers[i].last = (total * (i + 1)) / num_workers;
+		workers[i].dnskeys = ldns_rr_list_new();
+		workers[i].dnskey_rrsigs = ldns_rr_list_new();
+		workers[i].wire_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+
+		if (workers[i].wire_buf == NULL)
 		{
-			ldns_rr_list_push_rr(ht->dnskeys, rr);
+			fprintf(stderr, "Failed to allocate wire format buffer for indexing\n");
+
+			ldns_mergezone_dnssec_ht_free_workers(workers, num_workers);
+
+			return 1;
 		}
-		else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG)
-		{
-			assert(ldns_rr_rd_count(rr) == 9);
+	}
 
-			uint16_t	type_covered	= ldns_rdf2native_int16(ldns_rr_rdf(rr, 0));
+	VERBOSE("Indexing %zd records using %d thread(s)\n", total, num_workers);
 
-			if (type_covered == LDNS_RR_TYPE_DNSKEY)
-			{
-				ldns_rr_list_push_rr(ht->dnskey_rrsigs, rr);
-			}
-			else
-			{
-				char		type_and_owner[1024]	= { 0 };
-				char*		owner_name		= ldns_rdf2str(ldns_rr_owner(rr));
-				rrsig_ht_ent*	htent			= NULL;
+	/* Size the hash table and its entries up front */
+	ldns_mergezone_dnssec_ht_run(workers, num_workers, ldns_mergezone_dnssec_ht_count);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		ht->rrsig_count += workers[i].rrsig_count;
+		ht->rrsig_wire_size += workers[i].wire_size;
+	}
+
+	ht->rrsig_ents = (rrsig_ht_ent*) calloc(ht->rrsig_count + 1, sizeof(rrsig_ht_ent));
+	ht->rrsig_wire = (uint8_t*) malloc(ht->rrsig_wire_size + 1);
+
+	if ((ht->rrsig_ents == NULL) || (ht->rrsig_wire == NULL) || (ldns_mergezone_conc_ht_init(&ht->rrsig_ht, ht->rrsig_count) != 0))
+	{
+		fprintf(stderr, "Failed to allocate hash table for %zd RRSIG records\n", ht->rrsig_count);
 
-				snprintf(type_and_owner, 1024, "%u_%s", type_covered, owner_name);
+		ldns_mergezone_dnssec_ht_free_workers(workers, num_workers);
 
-				free(owner_name);
+		return 1;
+	}
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].ents = &ht->rrsig_ents[ent_offset];
+		workers[i].wire = &ht->rrsig_wire[wire_offset];
 
-				HASH_FIND_STR(ht->rrsig_ht, type_and_owner, htent);
+		ent_offset += workers[i].rrsig_count;
+		wire_offset += workers[i].wire_size;
+	}
+
+	ldns_mergezone_dnssec_ht_run(workers, num_workers, ldns_mergezone_dnssec_ht_index);
 
-				if (htent != NULL)
-				{
-					fprintf(stderr, "Found second RRSIG for %s\n", type_and_owner);
+	ldns_mergezone_conc_ht_freeze(&ht->rrsig_ht);
 
-					return 1;
-				}
+	/* Collect DNSKEYs and their signatures in zone order */
+	for (i = 0; i < num_workers; i++)
+	{
+		for (j = 0; j < ldns_rr_list_rr_count(workers[i].dnskeys); j++)
+		{
+			ldns_rr_list_push_rr(ht->dnskeys, ldns_rr_list_rr(workers[i].dnskeys, j));
+		}
 
-				htent = (rrsig_ht_ent*) malloc(sizeof(rrsig_ht_ent));
+		for (j = 0; j < ldns_rr_list_rr_count(workers[i].dnskey_rrsigs); j++)
+		{
+			ldns_rr_list_push_rr(ht->dnskey_rrsigs, ldns_rr_list_rr(workers[i].dnskey_rrsigs, j));
+		}
 
-				memset(htent, 0, sizeof(rrsig_ht_ent));
+		if (workers[i].rv != 0)
+		{
+			rv = 1;
+		}
+	}
 
-				strcpy(htent->type_and_owner, type_and_owner);
+	ldns_mergezone_dnssec_ht_free_workers(workers, num_workers);
 
-				htent->rr = rr;
+	/* Close the gaps left in the zone by the RRSIGs that were moved to the arena */
+	for (j = 0; j < total; j++)
+	{
+		ldns_rr*	rr	= ldns_rr_list_rr(zone_rrs, j);
 
-				HASH_ADD_STR(ht->rrsig_ht, type_and_owner, htent);
-			}
+		if (rr != NULL)
+		{
+			ldns_rr_list_set_rr(zone_rrs, rr, kept++);
 		}
 	}
 
+	ldns_rr_list_set_rr_count(zone_rrs, kept);
+
 	VERBOSE("Zone has %zd DNSKEY records\n", ldns_rr_list_rr_count(ht->dnskeys));
 	VERBOSE("Zone has %zd DNSKEY RRSIG records\n", ldns_rr_list_rr_count(ht->dnskey_rrsigs));
-	VERBOSE("Zone has %d other RRSIG records\n", HASH_COUNT(ht->rrsig_ht));
+	VERBOSE("Zone has %zd other RRSIG records (%zd bytes in wire format)\n", ht->rrsig_count, ht->rrsig_wire_size);
 
-	return 0;
+	return rv;
 }
 
-/* Find matching RRSIG */
+/* Find matching RRSIG, the caller must free the record that is found; fails if an RRSIG for the same type and owner was matched before */
 int ldns_mergezone_find_rrsig_match(dnssec_ht* ht, ldns_rr* find, ldns_rr** found)
 {
 	assert(ht != NULL);
@@ -118,29 +568,64 @@ int ldns_mergezone_find_rrsig_match(dnssec_ht* ht, ldns_rr* find, ldns_rr** foun
 	assert(ldns_rr_get_type(find) == LDNS_RR_TYPE_RRSIG);
 	assert(ldns_rr_rd_count(find) == 9);
 
-	char		type_and_owner[1024]	= { 0 };
-	char*		owner_name		= ldns_rdf2str(ldns_rr_owner(find));
-	uint16_t	type_covered		= ldns_rdf2native_int16(ldns_rr_rdf(find, 0));
+	rrsig_ht_key	type_and_owner;
+	uint64_t	hash			= ldns_mergezone_rrsig_key(find, &type_and_owner);
 	rrsig_ht_ent*	htent			= NULL;
+	size_t		pos			= 0;
 
-	snprintf(type_and_owner, 1024, "%u_%s", type_covered, owner_name);
+	htent = (rrsig_ht_ent*) ldns_mergezone_conc_ht_find(&ht->rrsig_ht, hash, &type_and_owner, ldns_mergezone_rrsig_key_cmp);
 
-	free(owner_name);
+	if (htent == NULL)
+	{
+		char*	desc	= ldns_mergezone_rrsig_desc(find);
 
-	HASH_FIND_STR(ht->rrsig_ht, type_and_owner, htent);
+		fprintf(stderr, "Failed to find matching RRSIG for %s\n", desc);
 
-	if (htent == NULL)
+		free(desc);
+
+		*found = NULL;
+
+		return 1;
+	}
+
+	*found = NULL;
+
+	if (htent->matched)
+	{
+		char*	desc	= ldns_mergezone_rrsig_desc(find);
+
+		fprintf(stderr, "Found second RRSIG for %s in the \"From\" zone\n", desc);
+
+		free(desc);
+
+		return 1;
+	}
+
+	htent->matched = 1;
+
+	if (ldns_wire2rr(found, htent->type_and_owner.owner, htent->wire_len, &pos, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
 	{
-		fprintf(stderr, "Failed to find matching RRSIG for %s\n", type_and_owner);
+		char*	desc	= ldns_mergezone_rrsig_desc(find);
+
+		fprintf(stderr, "Failed to convert matching RRSIG for %s from wire format\n", desc);
+
+		free(desc);
+
+		ldns_rr_free(*found);
 
 		*found = NULL;
 
 		return 1;
 	}
 
-	*found = htent->rr;
+	if (be_verbose)
+	{
+		char*	desc	= ldns_mergezone_rrsig_desc(find);
+
+		VERBOSE("Found matching RRSIG for %s\n", desc);
 
-	VERBOSE("Found matching RRSIG for %s\n", type_and_owner);
+		free(desc);
+	}
 
 	return 0;
 }
@@ -168,21 +653,18 @@ void ldns_mergezone_dnssec_ht_free(dnssec_ht* ht)
 	assert(ht->dnskeys != NULL);
 	assert(ht->dnskey_rrsigs != NULL);
 
-	rrsig_ht_ent*	ht_it	= NULL;
-	rrsig_ht_ent*	ht_tmp	= NULL;
-
 	ldns_rr_list_free(ht->dnskeys);
 	ldns_rr_list_free(ht->dnskey_rrsigs);
 
-	HASH_ITER(hh, ht->rrsig_ht, ht_it, ht_tmp)
-	{
-		HASH_DEL(ht->rrsig_ht, ht_it);
+	ldns_mergezone_conc_ht_free(&ht->rrsig_ht);
 
-		free(ht_it);
-	}
+	free(ht->rrsig_ents);
+	free(ht->rrsig_wire);
 
 	ht->dnskeys = NULL;
 	ht->dnskey_rrsigs = NULL;
-	ht->rrsig_ht = NULL;
+	ht->rrsig_ents = NULL;
+	ht->rrsig_count = 0;
+	ht->rrsig_wire = NULL;
+	ht->rrsig_wire_size = 0;
 }
-
@@ -36,29 +36,50 @@
 #include <stdint.h>
 #include <string.h>
 #include <ldns/ldns.h>
-#include "uthash.h"
+#include "conc_ht.h"
+#include "digest.h"
 
-/* Hash table entry type */
+/* Hash table key: the type covered and a reference to the wire-format owner name */
 typedef struct
 {
-	char		type_and_owner[1024];
-	ldns_rr*	rr;
-	UT_hash_handle	hh;
+	uint16_t	type_covered;
+	uint16_t	owner_len;
+	const uint8_t*	owner;
+}
+rrsig_ht_key;
+
+/* Hash table entry type; the owner in the key is the start of the RRSIG in wire format */
+typedef struct
+{
+	conc_ht_handle	hh;
+	rrsig_ht_key	type_and_owner;
+	uint32_t	wire_len;
+	uint32_t	matched;
 }
 rrsig_ht_ent;
 
 typedef struct
 {
-	rrsig_ht_ent*	rrsig_ht;
+	conc_ht		rrsig_ht;
+	rrsig_ht_ent*	rrsig_ents;
+	size_t		rrsig_count;
+	uint8_t*	rrsig_wire;
+	size_t		rrsig_wire_size;
 	ldns_rr_list*	dnskeys;
 	ldns_rr_list*	dnskey_rrsigs;
 }
 dnssec_ht;
 
-/* Populate hash table with DNSSEC data from this zone */
+/* Read a zone keeping only the records needed for the hash table; all other records except the SOA are added to the digest */
+int ldns_mergezone_read_dnssec_zone(const char* zone_file, ldns_zone** zone, zone_digest* digest);
+
+/* Copy the records of a zone in memory that are needed for the hash table; all other records except the SOA are added to the digest */
+int ldns_mergezone_copy_dnssec_zone(const ldns_zone* in, ldns_zone** zone, zone_digest* digest);
+
+/* Populate hash table with DNSSEC data from this zone; indexed RRSIGs are moved out of the zone */
 int ldns_mergezone_populate_dnssec_ht(ldns_zone* zone, dnssec_ht* ht);
 
-/* Find matching RRSIG */
+/* Find matching RRSIG, the caller must free the record that is found; fails if an RRSIG for the same type and owner was matched before */
 int ldns_mergezone_find_rrsig_match(dnssec_ht* ht, ldns_rr* find, ldns_rr** found);
 
 /* Get DNSKEYs */
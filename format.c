@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include "format.h"
+#include "b64.h"
+
+/*
+ * Most of the text written for a signed zone is base64, in the signature
+ * of RRSIG records and the public key of DNSKEY records. ldns formats these
+ * through a temporary allocation and a scalar encoder, so for these two
+ * types the record is formatted here, field by field using ldns, except
+ * for the base64 field, which is encoded straight into the output buffer.
+ * The key comment ldns adds to DNSKEY records is reproduced as well. All
+ * other records, and any output format options not handled here, are left
+ * to ldns.
+ */
+
+/* Output format flags handled here */
+#define FORMAT_FLAGS	LDNS_COMMENT_KEY
+
+/* Index of the base64 field for the types formatted here, -1 for other types */
+static int ldns_mergezone_format_b64_field(const ldns_rr* rr)
+{
+	switch(ldns_rr_get_type(rr))
+	{
+	case LDNS_RR_TYPE_RRSIG:
+		return (ldns_rr_rd_count(rr) == 9) ? 8 : -1;
+	case LDNS_RR_TYPE_DNSKEY:
+		return (ldns_rr_rd_count(rr) == 4) ? 3 : -1;
+	default:
+		return -1;
+	}
+}
+
+/* Append base64 data */
+static ldns_status ldns_mergezone_format_b64(ldns_buffer* text, const ldns_rdf* rdf)
+{
+	size_t	len	= B64_ENCODED_LEN(ldns_rdf_size(rdf));
+
+	if (!ldns_buffer_reserve(text, len))
+	{
+		return LDNS_STATUS_MEM_ERR;
+	}
+
+	ldns_buffer_skip(text, ldns_mergezone_b64_encode(ldns_rdf_data(rdf), ldns_rdf_size(rdf), (char*) ldns_buffer_current(text)));
+
+	return LDNS_STATUS_OK;
+}
+
+/* Append the comment ldns adds to DNSKEY records */
+static void ldns_mergezone_format_key_comment(ldns_buffer* text, const ldns_rr* rr, const int fmt_flags)
+{
+	uint16_t	flags	= ldns_rdf2native_int16(ldns_rr_rdf(rr, 0));
+
+	if (!(fmt_flags & LDNS_COMMENT_KEY))
+	{
+		return;
+	}
+
+	ldns_buffer_printf(text, " ;{");
+
+	if (fmt_flags & LDNS_COMMENT_KEY_ID)
+	{
+		ldns_buffer_printf(text, "id = %u", (unsigned int) ldns_calc_keytag(rr));
+	}
+
+	if ((fmt_flags & LDNS_COMMENT_KEY_TYPE) && (flags & LDNS_KEY_ZONE_KEY))
+	{
+		ldns_buffer_printf(text, (flags & LDNS_KEY_SEP_KEY) ? " (ksk)" : " (zsk)");
+
+		if (fmt_flags & LDNS_COMMENT_KEY_SIZE)
+		{
+			ldns_buffer_printf(text, ", ");
+		}
+	}
+	else if (fmt_flags & (LDNS_COMMENT_KEY_ID | LDNS_COMMENT_KEY_SIZE))
+	{
+		ldns_buffer_printf(text, ", ");
+	}
+
+	if (fmt_flags & LDNS_COMMENT_KEY_SIZE)
+	{
+		ldns_buffer_printf(text, "size = %db", (int) ldns_rr_dnskey_key_size(rr));
+	}
+
+	ldns_buffer_printf(text, "}");
+}
+
+/* Append a record in presentation format to the buffer; produces the same text as ldns_rr2buffer_str() */
+ldns_status ldns_mergezone_format_rr(ldns_buffer* text, const ldns_rr* rr)
+{
+	int		b64_field	= ldns_mergezone_format_b64_field(rr);
+	int		fmt_flags	= ldns_output_format_default->flags;
+	ldns_status	status		= LDNS_STATUS_OK;
+	int		i		= 0;
+
+	if ((b64_field < 0) ||
+	    (ldns_rr_owner(rr) == NULL) ||
+	    ldns_rr_is_question(rr) ||
+	    (ldns_output_format_default->data != NULL) ||
+	    ((fmt_flags & ~FORMAT_FLAGS) != 0) ||
+	    (ldns_rdf_get_type(ldns_rr_rdf(rr, b64_field)) != LDNS_RDF_TYPE_B64) ||
+	    (ldns_rdf_size(ldns_rr_rdf(rr, b64_field)) == 0))
+	{
+		return ldns_rr2buffer_str(text, rr);
+	}
+
+	if ((status = ldns_rdf2buffer_str(text, ldns_rr_owner(rr))) != LDNS_STATUS_OK)
+	{
+		return status;
+	}
+
+	ldns_buffer_printf(text, "\t%d\t", ldns_rr_ttl(rr));
+
+	if ((status = ldns_rr_class2buffer_str(text, ldns_rr_get_class(rr))) != LDNS_STATUS_OK)
+	{
+		return status;
+	}
+
+	ldns_buffer_printf(text, "\t");
+
+	if ((status = ldns_rr_type2buffer_str(text, ldns_rr_get_type(rr))) != LDNS_STATUS_OK)
+	{
+		return status;
+	}
+
+	ldns_buffer_printf(text, "\t");
+
+	for (i = 0; i < b64_field; i++)
+	{
+		if ((status = ldns_rdf2buffer_str(text, ldns_rr_rdf(rr, i))) != LDNS_STATUS_OK)
+		{
+			return status;
+		}
+
+		ldns_buffer_printf(text, " ");
+	}
+
+	if ((status = ldns_mergezone_format_b64(text, ldns_rr_rdf(rr, b64_field))) != LDNS_STATUS_OK)
+	{
+		return status;
+	}
+
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY)
+	{
+		ldns_mergezone_format_key_comment(text, rr, fmt_flags);
+	}
+
+	ldns_buffer_printf(text, "\n");
+
+	return ldns_buffer_status(text);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hash.h"
+
+/*
+ * A fast non-cryptographic hash in the style of wyhash: the input is
+ * consumed 16 bytes at a time and mixed with 64x64->128 bit multiplies.
+ * The owner name variant folds upper case ASCII to lower case on each
+ * 64-bit word as it is loaded, so names that only differ in case hash
+ * to the same value without first making a lower case copy.
+ */
+
+static const uint64_t hash_secret[4] =
+{
+	0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+static inline uint64_t ldns_mergezone_hash_mix(const uint64_t a, const uint64_t b)
+{
+	__uint128_t	r	= (__uint128_t) a * b;
+
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t ldns_mergezone_hash_read64(const uint8_t* p)
+{
+	uint64_t	v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static inline uint64_t ldns_mergezone_hash_read32(const uint8_t* p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+/* Read 1 to 3 bytes */
+static inline uint64_t ldns_mergezone_hash_read_small(const uint8_t* p, const size_t len)
+{
+	return (((uint64_t) p[0]) << 16) | (((uint64_t) p[len >> 1]) << 8) | p[len - 1];
+}
+
+/* Lower case all ASCII letters in a 64-bit word */
+static inline uint64_t ldns_mergezone_hash_fold(const uint64_t v)
+{
+	uint64_t	heptets		= v & 0x7f7f7f7f7f7f7f7full;
+	uint64_t	above_z		= heptets + 0x2525252525252525ull;
+	uint64_t	from_a		= heptets + 0x3f3f3f3f3f3f3f3full;
+	uint64_t	is_upper	= ~v & (from_a ^ above_z) & 0x8080808080808080ull;
+
+	return v | (is_upper >> 2);
+}
+
+static inline uint64_t ldns_mergezone_hash_core(const uint8_t* p, const size_t len, uint64_t seed, const int fold)
+{
+	uint64_t	a	= 0;
+	uint64_t	b	= 0;
+	size_t		i	= len;
+
+#define HASH_LOAD(v)	(fold ? ldns_mergezone_hash_fold(v) : (v))
+
+	seed ^= ldns_mergezone_hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+	if (len <= 16)
+	{
+		if (len >= 4)
+		{
+			size_t	off	= (len >> 3) << 2;
+
+			a = HASH_LOAD((ldns_mergezone_hash_read32(p) << 32) | ldns_mergezone_hash_read32(p + off));
+			b = HASH_LOAD((ldns_mergezone_hash_read32(p + len - 4) << 32) | ldns_mergezone_hash_read32(p + len - 4 - off));
+		}
+		else if (len > 0)
+		{
+			a = HASH_LOAD(ldns_mergezone_hash_read_small(p, len));
+		}
+	}
+	else
+	{
+		while (i > 16)
+		{
+			seed = ldns_mergezone_hash_mix(HASH_LOAD(ldns_mergezone_hash_read64(p)) ^ hash_secret[1], HASH_LOAD(ldns_mergezone_hash_read64(p + 8)) ^ seed);
+
+			p += 16;
+			i -= 16;
+		}
+
+		a = HASH_LOAD(ldns_mergezone_hash_read64(p + i - 16));
+		b = HASH_LOAD(ldns_mergezone_hash_read64(p + i - 8));
+	}
+
+#undef HASH_LOAD
+
+	return ldns_mergezone_hash_mix(ldns_mergezone_hash_mix(a ^ hash_secret[1], b ^ seed) ^ hash_secret[0] ^ len, hash_secret[3]);
+}
+
+/* Hash a type and a wire-format owner name, ignoring case in the owner name */
+uint64_t ldns_mergezone_hash_owner(const uint16_t type, const uint8_t* owner, const size_t len)
+{
+	return ldns_mergezone_hash_core(owner, len, hash_secret[2] ^ type, 1);
+}
+
+/* Hash arbitrary data */
+uint64_t ldns_mergezone_hash_bytes(const uint8_t* data, const size_t len, const uint64_t seed)
+{
+	return ldns_mergezone_hash_core(data, len, seed, 0);
+}
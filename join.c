@@ -0,0 +1,592 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "join.h"
+#include "dnssec_ht.h"
+#include "conform.h"
+#include "dname.h"
+#include "verify.h"
+#include "sigcols.h"
+#include "verbose.h"
+
+/*
+ * The "from" zone is merged one record at a time, in zone order. The DNSKEY
+ * RRset of the output can only be written once all DNSKEYs and DNSKEY RRSIGs
+ * of the "from" zone have been seen, so from the first DNSKEY or DNSKEY RRSIG
+ * onwards output is held back until the owner name changes. The DNSKEY RRset
+ * is then verified and written where the first DNSKEY RRSIG was, just like
+ * when the whole zone is in memory. This requires DNSKEY records to be
+ * grouped at a single owner name, which is always the case at the apex.
+ *
+ * With more than one "to" zone each RRSIG of the "from" zone is looked up in
+ * the index of every "to" zone before anything is output, so the signatures
+ * of one RRset are always written together and in zone order. The index of
+ * a "to" zone remembers which of its RRSIGs were matched, which catches a
+ * second RRSIG for the same RRset anywhere in the "from" zone.
+ */
+
+/* DNSKEY RRset state */
+#define JOIN_DNSKEY_NOT_SEEN	0
+#define JOIN_DNSKEY_HOLDING	1
+#define JOIN_DNSKEY_WRITTEN	2
+
+/* Hold position not set */
+#define JOIN_NO_POS		((size_t) -1)
+
+/* Pass a record on to the receiver, in final output order */
+static int ldns_mergezone_join_emit(join_ctx* ctx, ldns_rr* rr, const int owned)
+{
+	if (ctx->conform != NULL)
+	{
+		ldns_mergezone_conform_add_rr(ctx->conform, rr);
+	}
+
+	ctx->out_recs++;
+
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG)
+	{
+		ctx->out_rrsigs++;
+	}
+
+	return ctx->emit(ctx->emit_arg, rr, owned);
+}
+
+/* Output a record, or hold it back while waiting for the DNSKEY RRset */
+static int ldns_mergezone_join_output(join_ctx* ctx, ldns_rr* rr, const int owned)
+{
+	if (ctx->dnskey_state != JOIN_DNSKEY_HOLDING)
+	{
+		return ldns_mergezone_join_emit(ctx, rr, owned);
+	}
+
+	if (ctx->held_count == ctx->held_alloc)
+	{
+		ctx->held_alloc = (ctx->held_alloc == 0) ? 64 : ctx->held_alloc * 2;
+		ctx->held = (join_held_rr*) realloc(ctx->held, ctx->held_alloc * sizeof(join_held_rr));
+
+		assert(ctx->held != NULL);
+	}
+
+	ctx->held[ctx->held_count].rr = rr;
+	ctx->held[ctx->held_count].owned = owned;
+	ctx->held_count++;
+
+	return 0;
+}
+
+/* Emit held records in the specified range */
+static int ldns_mergezone_join_emit_held(join_ctx* ctx, const size_t first, const size_t last)
+{
+	size_t	i	= 0;
+	int	rv	= 0;
+
+	for (i = first; i < last; i++)
+	{
+		if ((rv == 0) && (ldns_mergezone_join_emit(ctx, ctx->held[i].rr, ctx->held[i].owned) == 0))
+		{
+			continue;
+		}
+
+		/* Once emitting fails, the remaining held records must still be freed */
+		rv = 1;
+
+		if (ctx->held[i].owned)
+		{
+			ldns_rr_free(ctx->held[i].rr);
+		}
+	}
+
+	return rv;
+}
+
+/* Emit a list of records that the receiver must not free */
+static int ldns_mergezone_join_emit_list(join_ctx* ctx, ldns_rr_list* list)
+{
+	size_t	i	= 0;
+
+	for (i = 0; i < ldns_rr_list_rr_count(list); i++)
+	{
+		if (ldns_mergezone_join_emit(ctx, ldns_rr_list_rr(list, i), 0) != 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Verify the DNSKEY RRsets and write the output DNSKEY RRset with the held records */
+static int ldns_mergezone_join_write_dnskeys(join_ctx* ctx)
+{
+	size_t	held_count	= ctx->held_count;
+	size_t	i		= 0;
+	int	rv		= 0;
+
+	assert(ctx->dnskey_state == JOIN_DNSKEY_HOLDING);
+
+	ctx->dnskey_state = JOIN_DNSKEY_WRITTEN;
+	ctx->held_count = 0;
+
+	if (ctx->dnskey_pos == JOIN_NO_POS)
+	{
+		fprintf(stderr, "\"From\" zone has no RRSIG over its DNSKEY RRset\n");
+
+		rv = 1;
+	}
+
+	VERBOSE("\"From\" zone has %zd DNSKEY records\n", ldns_rr_list_rr_count(ctx->dnskeys));
+	VERBOSE("\"From\" zone has %zd DNSKEY RRSIG records\n", ldns_rr_list_rr_count(ctx->dnskey_rrsigs));
+
+	VERBOSE("Validating DNSKEY RRset signatures in \"From\" zone\n");
+
+	if ((rv == 0) && (ldns_mergezone_verify_validate_dnskey_sig(ctx->dnskeys, ctx->dnskey_rrsigs) != 0))
+	{
+		fprintf(stderr, "DNSKEY RRset in \"From\" zone cannot be validated\n");
+
+		rv = 1;
+	}
+
+	if ((rv == 0) && (ctx->to_count == 1) &&
+	    (ldns_mergezone_verify_output_dnskeys(ctx->out_type,
+	                                          ctx->dnskeys, ctx->dnskey_rrsigs, ctx->from_algo,
+	                                          ldns_mergezone_get_dnskeys(&ctx->to_hts[0]), ldns_mergezone_get_dnskey_rrsigs(&ctx->to_hts[0]), ctx->to_algos[0],
+	                                          &ctx->output_dnskeys) != 0))
+	{
+		rv = 1;
+	}
+
+	if ((rv == 0) && (ctx->to_count > 1))
+	{
+		ldns_rr_list*	to_dnskeys[JOIN_MAX_TO_ZONES];
+		ldns_rr_list*	to_dnskey_rrsigs[JOIN_MAX_TO_ZONES];
+
+		for (i = 0; i < ctx->to_count; i++)
+		{
+			to_dnskeys[i] = ldns_mergezone_get_dnskeys(&ctx->to_hts[i]);
+			to_dnskey_rrsigs[i] = ldns_mergezone_get_dnskey_rrsigs(&ctx->to_hts[i]);
+		}
+
+		if (ldns_mergezone_verify_output_dnskeys_multi(ctx->out_type, ctx->dnskeys, ctx->dnskey_rrsigs, ctx->from_algo,
+		                                               to_dnskeys, to_dnskey_rrsigs, ctx->to_algos, ctx->to_count,
+		                                               &ctx->output_dnskeys) != 0)
+		{
+			rv = 1;
+		}
+	}
+
+	if (rv != 0)
+	{
+		/* Free the held records without writing them */
+		while (held_count > 0)
+		{
+			held_count--;
+
+			if (ctx->held[held_count].owned)
+			{
+				ldns_rr_free(ctx->held[held_count].rr);
+			}
+		}
+
+		return 1;
+	}
+
+	/* Write held records before the first DNSKEY RRSIG, the DNSKEY RRset and signatures, then the rest */
+	if ((ldns_mergezone_join_emit_held(ctx, 0, ctx->dnskey_pos) != 0) ||
+	    (ldns_mergezone_join_emit_list(ctx, ctx->output_dnskeys) != 0) ||
+	    (ldns_mergezone_join_emit_list(ctx, ctx->dnskey_rrsigs) != 0))
+	{
+		ldns_mergezone_join_emit_held(ctx, ctx->dnskey_pos, held_count);
+
+		return 1;
+	}
+
+	for (i = 0; i < ctx->to_count; i++)
+	{
+		if (ldns_mergezone_join_emit_list(ctx, ldns_mergezone_get_dnskey_rrsigs(&ctx->to_hts[i])) != 0)
+		{
+			ldns_mergezone_join_emit_held(ctx, ctx->dnskey_pos, held_count);
+
+			return 1;
+		}
+	}
+
+	return ldns_mergezone_join_emit_held(ctx, ctx->dnskey_pos, held_count);
+}
+
+/* Start holding back output for the DNSKEY RRset */
+static int ldns_mergezone_join_dnskey_rec(join_ctx* ctx)
+{
+	if (ctx->dnskey_state == JOIN_DNSKEY_WRITTEN)
+	{
+		fprintf(stderr, "Found DNSKEY records after the DNSKEY RRset was written, DNSKEY records must be grouped together\n");
+
+		return 1;
+	}
+
+	ctx->dnskey_state = JOIN_DNSKEY_HOLDING;
+
+	return 0;
+}
+
+/* Initialise merging against to_count indexed "to" zones; if to_digests is set, the other records of the zones must match */
+void ldns_mergezone_join_init(join_ctx* ctx, const int out_type, dnssec_ht* to_hts, const int* to_algos, const size_t to_count, ldns_rr* to_soa, const zone_digest* to_digests, conform_ctx* conform, join_emit emit, void* emit_arg)
+{
+	assert(ctx != NULL);
+	assert(to_hts != NULL);
+	assert(to_algos != NULL);
+	assert((to_count > 0) && (to_count <= JOIN_MAX_TO_ZONES));
+
+	memset(ctx, 0, sizeof(join_ctx));
+
+	ctx->out_type = out_type;
+	ctx->to_hts = to_hts;
+	ctx->to_algos = to_algos;
+	ctx->to_count = to_count;
+	ctx->to_soa = to_soa;
+	ctx->from_algo = -1;
+	ctx->dnskeys = ldns_rr_list_new();
+	ctx->dnskey_rrsigs = ldns_rr_list_new();
+	ctx->dnskey_pos = JOIN_NO_POS;
+
+	if (to_digests != NULL)
+	{
+		ldns_mergezone_digest_init(&ctx->from_digest);
+	}
+	ctx->to_digests = to_digests;
+
+	if ((ctx->check_sigs = ldns_mergezone_sigcols_check_enabled()))
+	{
+		ldns_mergezone_sigcols_init(&ctx->sig_cols);
+		ldns_mergezone_sigcols_check_init(&ctx->sig_results, "\"From\" zone");
+	}
+
+	ctx->conform = conform;
+	ctx->emit = emit;
+	ctx->emit_arg = emit_arg;
+}
+
+/* Merge the next record of the "from" zone; takes ownership of the record */
+int ldns_mergezone_join_rr(join_ctx* ctx, ldns_rr* rr)
+{
+	assert(ctx != NULL);
+	assert(rr != NULL);
+
+	ldns_rr_type	type		= ldns_rr_get_type(rr);
+	ldns_rr*	merged_rrsigs[JOIN_MAX_TO_ZONES];
+	size_t		i		= 0;
+
+	ctx->in_recs++;
+
+	if (type == LDNS_RR_TYPE_RRSIG)
+	{
+		ctx->in_rrsigs++;
+	}
+
+	if ((ctx->to_digests != NULL) && (ldns_mergezone_digest_add_rr(&ctx->from_digest, rr) != 0))
+	{
+		ldns_rr_free(rr);
+
+		return 1;
+	}
+
+	/* The SOA record goes first */
+	if (!ctx->seen_soa)
+	{
+		if (type != LDNS_RR_TYPE_SOA)
+		{
+			fprintf(stderr, "\"From\" zone does not start with an SOA record\n");
+
+			ldns_rr_free(rr);
+
+			return 1;
+		}
+
+		if (ldns_mergezone_verify_soa_records(rr, ctx->to_soa) != 0)
+		{
+			fprintf(stderr, "SOA or origin verification failed\n");
+
+			ldns_rr_free(rr);
+
+			return 1;
+		}
+
+		ctx->seen_soa = 1;
+
+		return ldns_mergezone_join_output(ctx, rr, 1);
+	}
+
+	if (type == LDNS_RR_TYPE_SOA)
+	{
+		/* Like ldns, ignore any further SOA records */
+		ldns_rr_free(rr);
+
+		return 0;
+	}
+
+	/* Keep track of the owner name */
+	if ((ctx->cur_owner == NULL) || !ldns_mergezone_dname_rdf_equal(ctx->cur_owner, ldns_rr_owner(rr)))
+	{
+		if ((ctx->dnskey_state == JOIN_DNSKEY_HOLDING) && (ldns_mergezone_join_write_dnskeys(ctx) != 0))
+		{
+			ldns_rr_free(rr);
+
+			return 1;
+		}
+
+		ldns_rdf_deep_free(ctx->cur_owner);
+
+		ctx->cur_owner = ldns_rdf_clone(ldns_rr_owner(rr));
+	}
+
+	if (type == LDNS_RR_TYPE_RRSIG)
+	{
+		assert(ldns_rr_rd_count(rr) == 9);
+
+		int		rr_algo		= ldns_rdf2native_int8(ldns_rr_rdf(rr, 1));
+		uint16_t	type_covered	= ldns_rdf2native_int16(ldns_rr_rdf(rr, 0));
+
+		if (ctx->from_algo == -1)
+		{
+			ctx->from_algo = rr_algo;
+
+			VERBOSE("\"From\" zone is signed using algorithm %d\n", rr_algo);
+
+			if (ctx->conform != NULL)
+			{
+				ldns_mergezone_conform_set_algos(ctx->conform, ctx->from_algo, ctx->to_algos, ctx->to_count);
+			}
+		}
+		else if (rr_algo != ctx->from_algo)
+		{
+			fprintf(stderr, "\"From\" input zone has records with more than one DNSSEC algorithm\n");
+
+			ldns_rr_free(rr);
+
+			return 1;
+		}
+
+		/* Signatures are checked a block at a time, as they are not kept */
+		if (ctx->check_sigs)
+		{
+			if (ldns_mergezone_sigcols_add_rr(&ctx->sig_cols, rr) != 0)
+			{
+				ldns_rr_free(rr);
+
+				return 1;
+			}
+
+			if (ctx->sig_cols.count == SIGCOLS_BLOCK)
+			{
+				ldns_mergezone_sigcols_check(&ctx->sig_cols, &ctx->sig_results);
+				ldns_mergezone_sigcols_clear(&ctx->sig_cols);
+			}
+		}
+
+		if (type_covered == LDNS_RR_TYPE_DNSKEY)
+		{
+			if (ldns_mergezone_join_dnskey_rec(ctx) != 0)
+			{
+				ldns_rr_free(rr);
+
+				return 1;
+			}
+
+			/* The DNSKEY RRset goes where the first DNSKEY RRSIG was */
+			if (ctx->dnskey_pos == JOIN_NO_POS)
+			{
+				ctx->dnskey_pos = ctx->held_count;
+			}
+
+			ldns_rr_list_push_rr(ctx->dnskey_rrsigs, rr);
+
+			return 0;
+		}
+
+		/* Find the accompanying signatures in the other zones; a second RRSIG for the same RRset finds its match taken */
+		for (i = 0; i < ctx->to_count; i++)
+		{
+			if (ldns_mergezone_find_rrsig_match(&ctx->to_hts[i], rr, &merged_rrsigs[i]) != 0)
+			{
+				fprintf(stderr, "Failed to find matching signature, giving up!\n");
+
+				while (i > 0)
+				{
+					ldns_rr_free(merged_rrsigs[--i]);
+				}
+
+				ldns_rr_free(rr);
+
+				return 1;
+			}
+		}
+
+		/* Output all signatures */
+		if (ldns_mergezone_join_output(ctx, rr, 1) != 0)
+		{
+			for (i = 0; i < ctx->to_count; i++)
+			{
+				ldns_rr_free(merged_rrsigs[i]);
+			}
+
+			return 1;
+		}
+
+		for (i = 0; i < ctx->to_count; i++)
+		{
+			if (ldns_mergezone_join_output(ctx, merged_rrsigs[i], 1) != 0)
+			{
+				while (++i < ctx->to_count)
+				{
+					ldns_rr_free(merged_rrsigs[i]);
+				}
+
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+	else if (type == LDNS_RR_TYPE_DNSKEY)
+	{
+		if (ldns_mergezone_join_dnskey_rec(ctx) != 0)
+		{
+			ldns_rr_free(rr);
+
+			return 1;
+		}
+
+		ldns_rr_list_push_rr(ctx->dnskeys, rr);
+
+		return 0;
+	}
+
+	/* Output unmodified resource record */
+	return ldns_mergezone_join_output(ctx, rr, 1);
+}
+
+/* Finish merging after the last record of the "from" zone */
+int ldns_mergezone_join_finish(join_ctx* ctx)
+{
+	assert(ctx != NULL);
+
+	size_t	i	= 0;
+
+	if (!ctx->seen_soa)
+	{
+		fprintf(stderr, "\"From\" zone is missing an SOA record\n");
+
+		return 1;
+	}
+
+	if ((ctx->dnskey_state == JOIN_DNSKEY_HOLDING) && (ldns_mergezone_join_write_dnskeys(ctx) != 0))
+	{
+		return 1;
+	}
+
+	if (ctx->dnskey_state == JOIN_DNSKEY_NOT_SEEN)
+	{
+		fprintf(stderr, "\"From\" zone has no DNSKEY RRset\n");
+
+		return 1;
+	}
+
+	if (ctx->check_sigs)
+	{
+		ldns_mergezone_sigcols_check(&ctx->sig_cols, &ctx->sig_results);
+		ldns_mergezone_sigcols_clear(&ctx->sig_cols);
+
+		if (ldns_mergezone_sigcols_check_finish(&ctx->sig_results) != 0)
+		{
+			fprintf(stderr, "Signatures in \"From\" zone failed the validity checks\n");
+
+			return 1;
+		}
+	}
+
+	/* The signatures of the "to" zones are only valid if they have the same content */
+	if (ctx->to_digests != NULL)
+	{
+		for (i = 0; i < ctx->to_count; i++)
+		{
+			if (!ldns_mergezone_digest_equal(&ctx->from_digest, &ctx->to_digests[i]))
+			{
+				fprintf(stderr, "The \"From\" zone (%zd records) and the \"To\" zone (%zd records) differ in records other than SOA, DNSKEY, RRSIG and ZONEMD records\n", ctx->from_digest.count, ctx->to_digests[i].count);
+
+				return 1;
+			}
+		}
+
+		VERBOSE("\"From\" and \"To\" zone have the same %zd records apart from SOA, DNSKEY, RRSIG and ZONEMD records\n", ctx->from_digest.count);
+	}
+
+	return 0;
+}
+
+/* Clean up; records emitted as not owned stay valid until this is called */
+void ldns_mergezone_join_free(join_ctx* ctx)
+{
+	assert(ctx != NULL);
+
+	size_t	i	= 0;
+
+	for (i = 0; i < ctx->held_count; i++)
+	{
+		if (ctx->held[i].owned)
+		{
+			ldns_rr_free(ctx->held[i].rr);
+		}
+	}
+
+	free(ctx->held);
+
+	if (ctx->to_digests != NULL)
+	{
+		ldns_mergezone_digest_free(&ctx->from_digest);
+	}
+
+	if (ctx->check_sigs)
+	{
+		ldns_mergezone_sigcols_free(&ctx->sig_cols);
+	}
+
+	ldns_rdf_deep_free(ctx->cur_owner);
+
+	ldns_rr_list_deep_free(ctx->dnskeys);
+	ldns_rr_list_deep_free(ctx->dnskey_rrsigs);
+
+	memset(ctx, 0, sizeof(join_ctx));
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_JOIN_H
+#define _LDNS_MERGEZONE_JOIN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include "dnssec_ht.h"
+#include "conform.h"
+#include "digest.h"
+#include "sigcols.h"
+
+/* Maximum number of "to" zones merged with the "from" zone */
+#define JOIN_MAX_TO_ZONES	7
+
+/* Receives merged records in output order; if owned is set the receiver must free the record */
+typedef int (*join_emit)(void* arg, ldns_rr* rr, const int owned);
+
+/* Output record held back until the DNSKEY RRset can be written */
+typedef struct
+{
+	ldns_rr*	rr;
+	int		owned;
+}
+join_held_rr;
+
+/* State for merging the records of the "from" zone, one at a time, with the "to" zones */
+typedef struct
+{
+	int		out_type;
+	dnssec_ht*	to_hts;
+	const int*	to_algos;
+	size_t		to_count;
+	ldns_rr*	to_soa;
+	int		from_algo;
+	int		seen_soa;
+	int		dnskey_state;
+	ldns_rr_list*	dnskeys;
+	ldns_rr_list*	dnskey_rrsigs;
+	ldns_rr_list*	output_dnskeys;
+	join_held_rr*	held;
+	size_t		held_count;
+	size_t		held_alloc;
+	size_t		dnskey_pos;
+	ldns_rdf*	cur_owner;
+	conform_ctx*	conform;
+	const zone_digest* to_digests;
+	zone_digest	from_digest;
+	int		check_sigs;
+	sig_columns	sig_cols;
+	sig_check	sig_results;
+	join_emit	emit;
+	void*		emit_arg;
+	size_t		in_recs;
+	size_t		out_recs;
+	size_t		in_rrsigs;
+	size_t		out_rrsigs;
+}
+join_ctx;
+
+/*
+ * Initialise merging against to_count indexed "to" zones, each signed with
+ * its own algorithm; the arrays hold one entry per zone. If to_digests is
+ * set, the other records of the zones must match.
+ */
+void ldns_mergezone_join_init(join_ctx* ctx, const int out_type, dnssec_ht* to_hts, const int* to_algos, const size_t to_count, ldns_rr* to_soa, const zone_digest* to_digests, conform_ctx* conform, join_emit emit, void* emit_arg);
+
+/* Merge the next record of the "from" zone; takes ownership of the record */
+int ldns_mergezone_join_rr(join_ctx* ctx, ldns_rr* rr);
+
+/* Finish merging after the last record of the "from" zone */
+int ldns_mergezone_join_finish(join_ctx* ctx);
+
+/* Clean up; records emitted as not owned stay valid until this is called */
+void ldns_mergezone_join_free(join_ctx* ctx);
+
+#endif /* !_LDNS_MERGEZONE_JOIN_H */
@@ -33,13 +33,25 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <openssl/engine.h>
 #include <openssl/conf.h>
 #include "merge.h"
+#include "conform.h"
 #include "verbose.h"
+#include "threads.h"
+#include "sort.h"
+#include "diff.h"
+#include "state.h"
+#include "zonemd.h"
+#include "sigcols.h"
+#include "progress.h"
+#include "metrics.h"
+#include "trace.h"
 
 void usage(void)
 {
@@ -47,21 +59,64 @@ void usage(void)
 	printf("Copyright (C) 2017 SURFnet bv\n");
 	printf("All rights reserved (see LICENSE for more information)\n\n");
 	printf("Usage:\n");
-	printf("\tldns-mergezone -f <from-zone> -t <to-zone> [-1] [-2] [-3] -o <out-zone> [-v]\n");
+	printf("\tldns-mergezone -f <from-zone> -t <to-zone> [-t <to-zone> ...] [-1] [-2] [-3] -o <out-zone> [-c] [-e <days>] [-s] [-M <megabytes>] [-z] [-Z <file>] [-d <old-zone> -D <diff-file>] [-S <file>] [-l] [-j <threads>] [-p] [-P <fd>] [-m <file>] [-T <file>] [-v]\n");
+	printf("\tldns-mergezone -k <merged-zone> [-1] [-2] [-3] [-v]\n");
 	printf("\tldns-mergezone -h\n");
 	printf("\n");
 	printf("\t-f <from-zone> Zone signed with the \"from\" algorithm\n");
-	printf("\t-t <to-zone>   Zone signed with the \"to\" algorithm\n");
+	printf("\t-t <to-zone>   Zone signed with the \"to\" algorithm; repeat to merge\n");
+	printf("\t               up to %d zones each signed with its own algorithm\n", MERGE_MAX_TO_ZONES);
 	printf("\t-1             Produce first output zone type (see README.md)\n");
 	printf("\t-2             Produce second output zone type (see README.md)\n");
 	printf("\t-3             Produce third output zone type (see README.md)\n");
 	printf("\t               (note: you must specify one of -1, -2, -3)\n");
 	printf("\t-o <out-zone>  Write output to <out-zone>\n");
+	printf("\t-c             Check that the output zone conforms to the output\n");
+	printf("\t               zone type, fail the merge if it does not\n");
+	printf("\t-e <days>      Fail the merge if a signature in the input zones is not\n");
+	printf("\t               yet valid, expires within <days> days or has a TTL\n");
+	printf("\t               other than its original TTL\n");
+	printf("\t-k <zone>      Only check that an already merged zone conforms to\n");
+	printf("\t               the output zone type\n");
+	printf("\t-s             Sort the \"from\" zone in canonical order before merging,\n");
+	printf("\t               so the output zone is in canonical order\n");
+	printf("\t-M <megabytes> Use at most <megabytes> of memory for sorting, larger\n");
+	printf("\t               zones are sorted using temporary files in $TMPDIR\n");
+	printf("\t               (default: %zd)\n", SORT_DEFAULT_MEM_LIMIT / (1024 * 1024));
+	printf("\t-z             Add a ZONEMD record (RFC 8976) to the output zone\n");
+	printf("\t-Z <file>      Like -z, and also write the ZONEMD record to <file>\n");
+	printf("\t               so that it can be signed\n");
+	printf("\t-d <old-zone>  Previously published merged zone to compare the\n");
+	printf("\t               output zone with\n");
+	printf("\t-D <diff-file> Write the difference with <old-zone> to <diff-file>\n");
+	printf("\t               as an IXFR response (deleted and added records)\n");
+	printf("\t-S <file>      Keep fingerprints of the zones in <file> and skip\n");
+	printf("\t               the merge if nothing changed since the last run\n");
+	printf("\t               (exits with status %d)\n", STATE_UNCHANGED);
+	printf("\t-l             Low memory mode, merge the \"from\" zone one record\n");
+	printf("\t               at a time in a single thread\n");
+	printf("\t-j <threads>   Use up to <threads> worker threads (default: one per CPU)\n");
+	printf("\t-p             Report progress on stderr every %d seconds\n", PROGRESS_INTERVAL);
+	printf("\t-P <fd>        Report progress on file descriptor <fd> instead\n");
+	printf("\t-m <file>      Write metrics of the run to <file> in the Prometheus\n");
+	printf("\t               text format (for the node exporter textfile collector)\n");
+	printf("\t-T <file>      Write a timeline of the run to <file> in the trace event\n");
+	printf("\t               format (for Perfetto or chrome://tracing)\n");
 	printf("\t-v             Be verbose\n");
 	printf("\n");
 	printf("\t-h                 Print this help message\n");
 }
 
+void free_to_zones(char** to_zones, const size_t to_count)
+{
+	size_t	i	= 0;
+
+	for (i = 0; i < to_count; i++)
+	{
+		free(to_zones[i]);
+	}
+}
+
 void cleanup_openssl(void)
 {
 	FIPS_mode_set(0);
@@ -75,14 +130,34 @@ void cleanup_openssl(void)
 
 int main(int argc, char* argv[])
 {
-	char*	from_zone	= NULL;
-	char*	to_zone		= NULL;
-	char*	out_zone	= NULL;
-	int	out_type	= 0;
-	int	c		= 0;
-	int	rv		= 0;
+	char*		from_zone	= NULL;
+	char*		to_zones[MERGE_MAX_TO_ZONES];
+	size_t		to_count	= 0;
+	char*		out_zone	= NULL;
+	char*		check_zone	= NULL;
+	char*		old_zone	= NULL;
+	char*		diff_file	= NULL;
+	char*		state_file	= NULL;
+	char*		zonemd_file	= NULL;
+	char*		metrics_file	= NULL;
+	char*		trace_file	= NULL;
+	int		out_type	= 0;
+	int		check_output	= 0;
+	int		sort_from	= 0;
+	int		add_zonemd	= 0;
+	int		sig_days	= -1;
+	int		low_memory	= 0;
+	int		progress_fd	= -1;
+	size_t		sort_mem_limit	= SORT_DEFAULT_MEM_LIMIT;
+	int		c		= 0;
+	int		rv		= 0;
+	int		use_state	= 0;
+	int		skipped		= 0;
+	merge_state	last_state;
+	merge_state	cur_state;
+	struct stat	st;
 	
-	while ((c = getopt(argc, argv, "f:t:o:123vh")) != -1)
+	while ((c = getopt(argc, argv, "f:t:o:ce:k:sM:zZ:d:D:S:lj:pP:m:T:123vh")) != -1)
 	{
 		switch(c)
 		{
@@ -90,11 +165,56 @@ int main(int argc, char* argv[])
 			from_zone = strdup(optarg);
 			break;
 		case 't':
-			to_zone = strdup(optarg);
+			if (to_count == MERGE_MAX_TO_ZONES)
+			{
+				fprintf(stderr, "You can specify at most %d \"to\" zones with -t!\n", MERGE_MAX_TO_ZONES);
+
+				return EINVAL;
+			}
+
+			to_zones[to_count++] = strdup(optarg);
 			break;
 		case 'o':
 			out_zone = strdup(optarg);
 			break;
+		case 'c':
+			check_output = 1;
+			break;
+		case 'e':
+			sig_days = atoi(optarg);
+
+			if ((sig_days < 0) || (sig_days > SIGCOLS_MAX_DAYS))
+			{
+				fprintf(stderr, "The number of days signatures must remain valid must be between 0 and %d!\n", SIGCOLS_MAX_DAYS);
+
+				return EINVAL;
+			}
+			break;
+		case 'k':
+			check_zone = strdup(optarg);
+			break;
+		case 's':
+			sort_from = 1;
+			break;
+		case 'M':
+			sort_mem_limit = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+			break;
+		case 'z':
+			add_zonemd = 1;
+			break;
+		case 'Z':
+			add_zonemd = 1;
+			zonemd_file = strdup(optarg);
+			break;
+		case 'd':
+			old_zone = strdup(optarg);
+			break;
+		case 'D':
+			diff_file = strdup(optarg);
+			break;
+		case 'S':
+			state_file = strdup(optarg);
+			break;
 		case '1':
 			out_type = 1;
 			break;
@@ -104,6 +224,24 @@ int main(int argc, char* argv[])
 		case '3':
 			out_type = 3;
 			break;
+		case 'l':
+			low_memory = 1;
+			break;
+		case 'j':
+			set_threads(atoi(optarg));
+			break;
+		case 'p':
+			progress_fd = STDERR_FILENO;
+			break;
+		case 'P':
+			progress_fd = atoi(optarg);
+			break;
+		case 'm':
+			metrics_file = strdup(optarg);
+			break;
+		case 'T':
+			trace_file = strdup(optarg);
+			break;
 		case 'v':
 			set_verbose(1);
 			break;
@@ -115,6 +253,78 @@ int main(int argc, char* argv[])
 	}
 
 	/* Check arguments */
+	if ((progress_fd >= 0) && (fcntl(progress_fd, F_GETFD) == -1))
+	{
+		fprintf(stderr, "File descriptor %d for progress reports is not open!\n", progress_fd);
+
+		return EINVAL;
+	}
+
+	if (check_zone != NULL)
+	{
+		if (out_type == 0)
+		{
+			fprintf(stderr, "You must specify the expected output zone type with -1, -2 or -3!\n");
+
+			return EINVAL;
+		}
+
+		ldns_mergezone_metrics_init();
+
+		if (trace_file != NULL)
+		{
+			ldns_mergezone_trace_start();
+		}
+
+		if (progress_fd >= 0)
+		{
+			ldns_mergezone_progress_start(progress_fd);
+		}
+
+		ldns_mergezone_progress_phase("check", (stat(check_zone, &st) == 0) ? st.st_size : 0, 0);
+
+		rv = ldns_mergezone_conform_check_file(check_zone, out_type);
+
+		ldns_mergezone_progress_stop();
+
+		ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "conform", rv != 0);
+		ldns_mergezone_metrics_set(METRIC_RUN_SUCCESS, NULL, NULL, rv == 0);
+
+		if ((metrics_file != NULL) && (ldns_mergezone_metrics_write(metrics_file) != 0) && (rv == 0))
+		{
+			rv = 1;
+		}
+
+		if ((trace_file != NULL) && (ldns_mergezone_trace_write(trace_file) != 0) && (rv == 0))
+		{
+			rv = 1;
+		}
+
+		if (rv != 0)
+		{
+			fprintf(stderr, "Zone %s does not conform to output zone type %d\n", check_zone, out_type);
+		}
+		else
+		{
+			VERBOSE("Zone %s conforms to output zone type %d\n", check_zone, out_type);
+		}
+
+		cleanup_openssl();
+
+		free(from_zone);
+		free_to_zones(to_zones, to_count);
+		free(out_zone);
+		free(check_zone);
+		free(old_zone);
+		free(diff_file);
+		free(state_file);
+		free(zonemd_file);
+		free(metrics_file);
+		free(trace_file);
+
+		return rv;
+	}
+
 	if (from_zone == NULL)
 	{
 		fprintf(stderr, "You must specify a \"from\" zone with -f!\n");
@@ -122,7 +332,7 @@ int main(int argc, char* argv[])
 		return EINVAL;
 	}
 
-	if (to_zone == NULL)
+	if (to_count == 0)
 	{
 		fprintf(stderr, "You must specify a \"to\" zone with -t!\n");
 
@@ -143,8 +353,105 @@ int main(int argc, char* argv[])
 		return EINVAL;
 	}
 
-	/* Run merge */
-	if ((rv = ldns_mergezone_merge(from_zone, to_zone, out_zone, out_type)) != 0)
+	if (sort_mem_limit == 0)
+	{
+		fprintf(stderr, "The memory limit for sorting must be at least 1 megabyte!\n");
+
+		return EINVAL;
+	}
+
+	if ((old_zone == NULL) != (diff_file == NULL))
+	{
+		fprintf(stderr, "You must specify both the old zone with -d and the difference file with -D!\n");
+
+		return EINVAL;
+	}
+
+	/* A skipped run is a run too, as far as metrics and tracing are concerned */
+	ldns_mergezone_metrics_init();
+
+	if (trace_file != NULL)
+	{
+		ldns_mergezone_trace_start();
+	}
+
+	/* Skip the merge if the zones have not changed since the last run */
+	if (state_file != NULL)
+	{
+		memset(&cur_state, 0, sizeof(merge_state));
+
+		cur_state.out_type = out_type;
+		cur_state.sort_from = sort_from;
+		cur_state.check_output = check_output;
+		cur_state.add_zonemd = add_zonemd;
+		cur_state.sig_days = sig_days;
+
+		use_state = (ldns_mergezone_state_fingerprint(from_zone, &cur_state.from) == 0) &&
+		            (ldns_mergezone_state_fingerprint_files((const char* const*) to_zones, to_count, &cur_state.to) == 0) &&
+		            ((old_zone == NULL) || (ldns_mergezone_state_fingerprint(old_zone, &cur_state.old) == 0));
+
+		skipped = use_state && (ldns_mergezone_state_read(state_file, &last_state) == 0) && ldns_mergezone_state_unchanged(&last_state, &cur_state, out_zone, diff_file, zonemd_file);
+	}
+
+	if (skipped)
+	{
+		VERBOSE("Zones have not changed since the last run, skipping the merge\n");
+	}
+	else
+	{
+		/* Run merge */
+		if (progress_fd >= 0)
+		{
+			ldns_mergezone_progress_start(progress_fd);
+		}
+
+		ldns_mergezone_sigcols_set_check(sig_days);
+
+		rv = ldns_mergezone_merge_multi(from_zone, (const char* const*) to_zones, to_count, out_zone, out_type, check_output, sort_from ? sort_mem_limit : 0, low_memory);
+
+		if ((rv == 0) && add_zonemd)
+		{
+			rv = ldns_mergezone_zonemd_add(out_zone, sort_mem_limit, zonemd_file);
+		}
+
+		if ((rv == 0) && (old_zone != NULL))
+		{
+			rv = ldns_mergezone_diff_zone_files(old_zone, out_zone, diff_file, sort_mem_limit);
+		}
+
+		if ((rv == 0) && use_state)
+		{
+			ldns_mergezone_sigcols_valid_until(&cur_state.sig_valid_until);
+
+			if ((ldns_mergezone_state_fingerprint(out_zone, &cur_state.out) != 0) ||
+			    ((diff_file != NULL) && (ldns_mergezone_state_fingerprint(diff_file, &cur_state.diff) != 0)) ||
+			    ((zonemd_file != NULL) && (ldns_mergezone_state_fingerprint(zonemd_file, &cur_state.zonemd) != 0)) ||
+			    (ldns_mergezone_state_write(state_file, &cur_state) != 0))
+			{
+				fprintf(stderr, "Failed to record the state of this run in %s\n", state_file);
+
+				rv = 1;
+			}
+		}
+
+		ldns_mergezone_progress_stop();
+	}
+
+	ldns_mergezone_metrics_set(METRIC_RUN_SKIPPED, NULL, NULL, skipped);
+
+	ldns_mergezone_metrics_set(METRIC_RUN_SUCCESS, NULL, NULL, rv == 0);
+
+	if ((metrics_file != NULL) && (ldns_mergezone_metrics_write(metrics_file) != 0) && (rv == 0))
+	{
+		rv = 1;
+	}
+
+	if ((trace_file != NULL) && (ldns_mergezone_trace_write(trace_file) != 0) && (rv == 0))
+	{
+		rv = 1;
+	}
+
+	if (rv != 0)
 	{
 		fprintf(stderr, "Zone merge failed, exiting with error state\n");
 	}
@@ -152,9 +459,15 @@ int main(int argc, char* argv[])
 	cleanup_openssl();
 
 	free(from_zone);
-	free(to_zone);
+	free_to_zones(to_zones, to_count);
 	free(out_zone);
+	free(old_zone);
+	free(diff_file);
+	free(state_file);
+	free(zonemd_file);
+	free(metrics_file);
+	free(trace_file);
 	
-	return rv;
+	return ((rv == 0) && skipped) ? STATE_UNCHANGED : rv;
 }
  
@@ -34,443 +34,637 @@
 #include <unistd.h>
 #include <ldns/ldns.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <assert.h>
 #include "merge.h"
 #include "verify.h"
 #include "verbose.h"
 #include "dnssec_ht.h"
-
-int ldns_mergezone_merge(const char* from_zone, const char* to_zone, const char* out_zone, const int out_type)
+#include "conform.h"
+#include "reader.h"
+#include "join.h"
+#include "pipeline.h"
+#include "sort.h"
+#include "b64.h"
+#include "writer.h"
+#include "progress.h"
+#include "metrics.h"
+#include "sigcols.h"
+
+#if MERGE_MAX_TO_ZONES > JOIN_MAX_TO_ZONES
+#error "The join cannot merge as many \"to\" zones as the library accepts"
+#endif
+
+/* Index the DNSSEC records of the "to" zone and validate its DNSKEY RRset; on failure nothing needs to be freed but the zone and digest */
+static int ldns_mergezone_index_to_zone(ldns_zone* to, const zone_digest* to_digest, const char* to_name, const char* label, dnssec_ht* to_ht, int* to_algo)
 {
-	ldns_zone*	from			= NULL;
-	ldns_zone*	to			= NULL;
-	FILE*		from_fp			= fopen(from_zone, "r");
-	FILE*		to_fp			= fopen(to_zone, "r");
-	FILE*		out_fp			= NULL;
-	int		from_algo		= 0;
-	int		to_algo			= 0;
-	ldns_rr_list*	output_dnskeys		= NULL;
-	int		wrote_dnskeys_and_sigs	= 0;
-	size_t		i			= 0;
-	size_t		out_recs		= 0;
-	ldns_rr_list*	zone_rrs		= NULL;
-	dnssec_ht	from_ht;
-	dnssec_ht	to_ht;
+	int	rv	= 0;
 
-	if (from_fp == NULL)
+	/* Only the DNSSEC records and the SOA are left, the others were added to the digest */
+	ldns_mergezone_metrics_set(METRIC_RECORDS, "zone", label, to_digest->count + ldns_rr_list_rr_count(ldns_zone_rrs(to)) + ((ldns_zone_soa(to) != NULL) ? 1 : 0));
+
+	if (ldns_zone_soa(to) == NULL)
 	{
-		fprintf(stderr, "Failed to open %s for reading\n", from_zone);
+		fprintf(stderr, "\"To\" zone is missing an SOA record\n");
 
 		return 1;
 	}
 
-	if (to_fp == NULL)
+	VERBOSE("Checking algorithm in zone %s\n", to_name);
+
+	if (ldns_mergezone_verify_and_fetch_single_algo(to, to_algo) != 0)
 	{
-		fprintf(stderr, "Failed to open %s for reading\n", to_zone);
+		fprintf(stderr, "\"To\" input zone has records with more than one DNSSEC algorithm\n");
 
 		return 1;
 	}
 
-	/* Read zones */
-	if (ldns_zone_new_frm_fp(&from, from_fp, NULL, 3600, LDNS_RR_CLASS_IN) != LDNS_STATUS_OK)
-	{
-		fprintf(stderr, "Failed to read zone data from %s\n", from_zone);
+	VERBOSE("\"To\" zone is signed using algorithm %d\n", *to_algo);
 
-		return 1;
-	}
+	/* Populate hash table for the "to" zone */
+	ldns_mergezone_progress_phase("index to zone", 0, 0);
 
-	VERBOSE("Read input zone from %s\n", from_zone);
+	VERBOSE("Populating DNSSEC hash table for %s\n", to_name);
 
-	if (ldns_zone_new_frm_fp(&to, to_fp, NULL, 3600, LDNS_RR_CLASS_IN) != LDNS_STATUS_OK)
+	if (ldns_mergezone_populate_dnssec_ht(to, to_ht) != 0)
 	{
-		fprintf(stderr, "Failed to read zone data from %s\n", to_zone);
+		fprintf(stderr, "Failed to populate DNSSEC hash table for %s\n", to_name);
+
+		ldns_mergezone_dnssec_ht_free(to_ht);
 
 		return 1;
 	}
 
-	VERBOSE("Read input zone from %s\n", to_zone);
+	ldns_mergezone_metrics_set(METRIC_RRSIGS, "zone", label, to_ht->rrsig_count + ldns_rr_list_rr_count(ldns_mergezone_get_dnskey_rrsigs(to_ht)));
+
+	VERBOSE("Validating DNSKEY RRset signatures in \"To\" zone\n");
 
-	fclose(from_fp);
-	fclose(to_fp);
+	rv = ldns_mergezone_verify_validate_dnskey_sig(ldns_mergezone_get_dnskeys(to_ht), ldns_mergezone_get_dnskey_rrsigs(to_ht));
 
-	/* Sort zones */
-	/*ldns_zone_sort(from);
-	ldns_zone_sort(to);*/
+	ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "dnskey", rv != 0);
 
-	/* Perform pre-merge verification of input zones */
-	if (ldns_mergezone_verify_soa_and_origin(from, to) != 0)
+	if (rv != 0)
 	{
-		fprintf(stderr, "SOA or origin verification failed\n");
+		fprintf(stderr, "DNSKEY RRset in \"To\" zone cannot be validated\n");
+
+		ldns_mergezone_dnssec_ht_free(to_ht);
 
 		return 1;
 	}
 
-	VERBOSE("Checking algorithm in zone %s\n", from_zone);
-
-	if (ldns_mergezone_verify_and_fetch_single_algo(from, &from_algo) != 0)
+	if (ldns_mergezone_sigcols_check_enabled() && (ldns_mergezone_sigcols_check_ht(to_ht, to_name) != 0))
 	{
-		fprintf(stderr, "\"From\" input zone has records with more than one DNSSEC algorithm\n");
+		fprintf(stderr, "Signatures in \"To\" zone failed the validity checks\n");
+
+		ldns_mergezone_dnssec_ht_free(to_ht);
 
 		return 1;
 	}
 
-	VERBOSE("\"From\" zone is signed using algorithm %d\n", from_algo);
+	return 0;
+}
 
-	VERBOSE("Checking algorithm in zone %s\n", to_zone);
+/* Finish the conformance check of the output, if one was requested; returns the new result of the merge */
+static int ldns_mergezone_finish_conform(conform_ctx* conform, const int out_type, const int rv)
+{
+	if (conform == NULL)
+	{
+		return rv;
+	}
 
-	if (ldns_mergezone_verify_and_fetch_single_algo(to, &to_algo) != 0)
+	if (rv != 0)
 	{
-		fprintf(stderr, "\"To\" input zone has records with more than one DNSSEC algorithm\n");
+		ldns_mergezone_conform_free(conform);
+
+		return rv;
+	}
+
+	if (ldns_mergezone_conform_finish(conform) != 0)
+	{
+		fprintf(stderr, "Merged zone does not conform to the requirements for output type %d\n", out_type);
+
+		ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "conform", 1);
 
 		return 1;
 	}
 
-	VERBOSE("\"To\" zone is signed using algorithm %d\n", to_algo);
+	ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "conform", 0);
 
-	/* Populate hash tables for both zones */
-	VERBOSE("Populating DNSSEC hash table for %s\n", from_zone);
+	return 0;
+}
+
+/* Record the counts of the merge in the metrics */
+static void ldns_mergezone_join_metrics(const join_ctx* join)
+{
+	ldns_mergezone_metrics_set(METRIC_RECORDS, "zone", "from", join->in_recs);
+	ldns_mergezone_metrics_set(METRIC_RECORDS, "zone", "out", join->out_recs);
+	ldns_mergezone_metrics_set(METRIC_RRSIGS, "zone", "from", join->in_rrsigs);
+	ldns_mergezone_metrics_set(METRIC_RRSIGS, "zone", "out", join->out_rrsigs);
+}
+
+/* Free the "to" zones that were read and indexed so far */
+static void ldns_mergezone_free_to_zones(ldns_zone** to, zone_digest* to_digests, dnssec_ht* to_hts, const size_t read, const size_t indexed)
+{
+	size_t	i	= 0;
 
-	if (ldns_mergezone_populate_dnssec_ht(from, &from_ht) != 0)
+	for (i = 0; i < indexed; i++)
 	{
-		fprintf(stderr, "Failed to populate DNSSEC hash table for %s\n", from_zone);
+		ldns_mergezone_dnssec_ht_free(&to_hts[i]);
+	}
 
-		return 1;
+	for (i = 0; i < read; i++)
+	{
+		ldns_zone_deep_free(to[i]);
+		ldns_mergezone_digest_free(&to_digests[i]);
 	}
+}
 
-	VERBOSE("Populating DNSSEC hash table for %s\n", to_zone);
+/* Read and index the "to" zones; on failure nothing is left to free */
+static int ldns_mergezone_read_to_zones(const char* const* to_zones, const size_t to_count, ldns_zone** to, zone_digest* to_digests, dnssec_ht* to_hts, int* to_algos)
+{
+	off_t		to_size		= 0;
+	size_t		i		= 0;
+	char		label[32];
+	struct stat	st;
 
-	if (ldns_mergezone_populate_dnssec_ht(to, &to_ht) != 0)
+	for (i = 0; i < to_count; i++)
 	{
-		fprintf(stderr, "Failed to populate DNSSEC hash table for %s\n", to_zone);
+		/* Keep the label of a single "to" zone as it was */
+		if (to_count == 1)
+		{
+			snprintf(label, sizeof(label), "to");
+		}
+		else
+		{
+			snprintf(label, sizeof(label), "to%zu", i + 1);
+		}
 
-		return 1;
+		/* Read the "to" zone, only its DNSSEC records are kept */
+		to_size = (stat(to_zones[i], &st) == 0) ? st.st_size : 0;
+
+		ldns_mergezone_progress_phase("read to zone", to_size, 0);
+
+		ldns_mergezone_digest_init(&to_digests[i]);
+
+		if (ldns_mergezone_read_dnssec_zone(to_zones[i], &to[i], &to_digests[i]) != 0)
+		{
+			fprintf(stderr, "Failed to read zone data from %s\n", to_zones[i]);
+
+			ldns_mergezone_digest_free(&to_digests[i]);
+			ldns_mergezone_free_to_zones(to, to_digests, to_hts, i, i);
+
+			return 1;
+		}
+
+		VERBOSE("Read input zone from %s\n", to_zones[i]);
+
+		ldns_mergezone_metrics_set(METRIC_BYTES, "zone", label, to_size);
+
+		if (ldns_mergezone_index_to_zone(to[i], &to_digests[i], to_zones[i], label, &to_hts[i], &to_algos[i]) != 0)
+		{
+			ldns_mergezone_free_to_zones(to, to_digests, to_hts, i + 1, i);
+
+			return 1;
+		}
+
+		/* All "to" zones must be versions of the same zone */
+		if ((i > 0) && (ldns_mergezone_verify_soa_records(ldns_zone_soa(to[i]), ldns_zone_soa(to[0])) != 0))
+		{
+			fprintf(stderr, "SOA or origin of %s does not match that of %s\n", to_zones[i], to_zones[0]);
+
+			ldns_mergezone_free_to_zones(to, to_digests, to_hts, i + 1, i + 1);
+
+			return 1;
+		}
 	}
 
-	/* Validate DNSKEY RRsets in input zones */
-	VERBOSE("Validating DNSKEY RRset signatures in \"From\" zone\n");
+	return 0;
+}
 
-	if (ldns_mergezone_verify_validate_dnskey_sig(ldns_mergezone_get_dnskeys(&from_ht), ldns_mergezone_get_dnskey_rrsigs(&from_ht)) != 0)
+/* Merge a "from" zone that is read in order */
+static int ldns_mergezone_merge_zones(const char* from_zone, const char* const* to_zones, const size_t to_count, const char* out_zone, const int out_type, const int check_output, const int low_memory)
+{
+	off_t		from_size			= 0;
+	off_t		out_size			= 0;
+	size_t		rrsig_wire_size			= 0;
+	size_t		i				= 0;
+	int		rv				= 0;
+	conform_ctx*	conform				= NULL;
+	ldns_zone*	to[JOIN_MAX_TO_ZONES];
+	int		to_algos[JOIN_MAX_TO_ZONES];
+	dnssec_ht	to_hts[JOIN_MAX_TO_ZONES];
+	zone_digest	to_digests[JOIN_MAX_TO_ZONES];
+	zone_reader	from;
+	join_ctx	join;
+	conform_ctx	conform_state;
+	zone_writer	out;
+	struct stat	st;
+
+	assert((to_count > 0) && (to_count <= JOIN_MAX_TO_ZONES));
+
+	/* The "from" zone is streamed, so only open it here */
+	if (ldns_mergezone_reader_open(&from, from_zone) != 0)
 	{
-		fprintf(stderr, "DNSKEY RRset in \"From\" zone cannot be validated\n");
-
 		return 1;
 	}
 
-	VERBOSE("Validating DNSKEY RRset signatures in \"To\" zone\n");
-
-	if (ldns_mergezone_verify_validate_dnskey_sig(ldns_mergezone_get_dnskeys(&to_ht), ldns_mergezone_get_dnskey_rrsigs(&to_ht)) != 0)
+	if (ldns_mergezone_read_to_zones(to_zones, to_count, to, to_digests, to_hts, to_algos) != 0)
 	{
-		fprintf(stderr, "DNSKEY RRset in \"To\" zone cannot be validated\n");
+		ldns_mergezone_reader_close(&from);
 
 		return 1;
 	}
 
-	/* Validate correct content of DNSKEY RRsets based on the desired output zone */
-	switch(out_type)
+	for (i = 0; i < to_count; i++)
 	{
-	case 1:
-		/* 
-		 * From zone must contain DNSKEYs with the 'from' algorithm,
-		 * but not with the 'to' algorithm.
-		 *
-		 * To zone must contain DNSKEYs with the 'from' algorithm,
-		 * and with the 'to' algorithm.
-		 */
-		{
-			VERBOSE("Verifying the \"From\" zone only contains DNSKEYs with the \"from\" algorithm\n");
+		rrsig_wire_size += to_hts[i].rrsig_wire_size;
+	}
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), from_algo) != 0)
-			{
-				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+	/*
+	 * The output is about the size of the "from" zone plus the signatures
+	 * taken from the "to" zones, which take about half as much space again
+	 * in text as they do in wire format
+	 */
+	if (stat(from_zone, &st) == 0)
+	{
+		from_size = st.st_size;
+		out_size = from_size + ((rrsig_wire_size * 3) / 2);
+	}
 
-				return 1;
-			}
+	/* Write the output zone while the "from" zone is being read */
+	if (ldns_mergezone_writer_open(&out, out_zone, out_size) != 0)
+	{
+		ldns_mergezone_free_to_zones(to, to_digests, to_hts, to_count, to_count);
+		ldns_mergezone_reader_close(&from);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), to_algo) == 0)
-			{
-				fprintf(stderr, "\"From\" zone contains DNSKEYs with the \"to\" algorithm\n");
+		return EPERM;
+	}
 
-				return 1;
-			}
+	if (check_output)
+	{
+		/* The "from" algorithm is supplied by the join once it is known */
+		ldns_mergezone_conform_init(&conform_state, out_type, 0, to_algos, to_count);
 
-			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+		conform = &conform_state;
+	}
 
-			VERBOSE("Verifying the \"To\" zone contains DNSKEYs for both the \"from\" and the \"to\" algorithm\n");
+	ldns_mergezone_join_init(&join, out_type, to_hts, to_algos, to_count, ldns_zone_soa(to[0]), to_digests, conform, NULL, NULL);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), from_algo) != 0)
-			{
-				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+	ldns_mergezone_progress_phase("merge", from_size, 0);
 
-				return 1;
-			}
+	VERBOSE("Merging %s into %s\n", from_zone, out_zone);
+	VERBOSE("Using %s base64 encoder for signatures and keys\n", ldns_mergezone_b64_impl());
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), to_algo) != 0)
-			{
-				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+	if (low_memory)
+	{
+		rv = ldns_mergezone_pipeline_run_inline(&from, &join, &out);
+	}
+	else
+	{
+		rv = ldns_mergezone_pipeline_run(&from, &join, &out);
+	}
 
-				return 1;
-			}
+	if (rv != 0)
+	{
+		fprintf(stderr, "An error occurred while outputting the merged zone\n");
+	}
 
-			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
+	rv = ldns_mergezone_finish_conform(conform, out_type, rv);
 
-			output_dnskeys = ldns_mergezone_get_dnskeys(&from_ht);
+	if ((ldns_mergezone_writer_close(&out) != 0) && (rv == 0))
+	{
+		rv = 1;
+	}
 
-			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"From\" zone\n");
+	ldns_mergezone_join_metrics(&join);
+	ldns_mergezone_metrics_set(METRIC_BYTES, "zone", "from", from_size);
+	ldns_mergezone_metrics_set(METRIC_BYTES, "zone", "out", out.written);
 
-			if (ldns_mergezone_verify_validate_dnskey_sig(output_dnskeys, ldns_mergezone_get_dnskey_rrsigs(&from_ht)) != 0)
-			{
-				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+	if (rv == 0)
+	{
+		VERBOSE("Merge finished, wrote %zd records to %s\n", join.out_recs, out_zone);
+	}
+	else
+	{
+		unlink(out_zone);
+	}
 
-				return 1;
-			}
-		}
-		break;
-	case 2:
-		/* 
-		 * From zone must contain DNSKEYs with the 'from' algorithm,
-		 * and with the 'to' algorithm.
-		 *
-		 * To zone must contain DNSKEYs with the 'from' algorithm,
-		 * and with the 'to' algorithm.
-		 */
-		{
-			VERBOSE("Verifying the \"From\" zone contains DNSKEYs with both the \"from\" and the \"to\" algorithm\n");
+	/* Clean up */
+	ldns_mergezone_join_free(&join);
+	ldns_mergezone_free_to_zones(to, to_digests, to_hts, to_count, to_count);
+
+	ldns_mergezone_reader_close(&from);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), from_algo) != 0)
-			{
-				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+	return rv;
+}
+
+int ldns_mergezone_merge_multi(const char* from_zone, const char* const* to_zones, const size_t to_count, const char* out_zone, const int out_type, const int check_output, const size_t sort_mem_limit, const int low_memory)
+{
+	char*		sorted_zone	= NULL;
+	int		rv		= 0;
+	struct stat	st;
 
-				return 1;
-			}
+	if ((to_count == 0) || (to_count > MERGE_MAX_TO_ZONES))
+	{
+		fprintf(stderr, "Between 1 and %d \"to\" zones can be merged\n", MERGE_MAX_TO_ZONES);
+
+		return 1;
+	}
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), to_algo) != 0)
-			{
-				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+	if (sort_mem_limit == 0)
+	{
+		return ldns_mergezone_merge_zones(from_zone, to_zones, to_count, out_zone, out_type, check_output, low_memory);
+	}
 
-				return 1;
-			}
+	/* Output follows the order of the "from" zone, so sort it first */
+	ldns_mergezone_progress_phase("sort from zone", (stat(from_zone, &st) == 0) ? st.st_size : 0, 0);
 
-			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+	VERBOSE("Sorting %s in canonical order\n", from_zone);
 
-			VERBOSE("Verifying the \"To\" zone contains DNSKEYs for both the \"from\" and the \"to\" algorithm\n");
+	if (ldns_mergezone_sort_zone_tmpfile(from_zone, sort_mem_limit, &sorted_zone) != 0)
+	{
+		fprintf(stderr, "Failed to sort %s\n", from_zone);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), from_algo) != 0)
-			{
-				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+		return 1;
+	}
 
-				return 1;
-			}
+	rv = ldns_mergezone_merge_zones(sorted_zone, to_zones, to_count, out_zone, out_type, check_output, low_memory);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), to_algo) != 0)
-			{
-				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+	unlink(sorted_zone);
+	free(sorted_zone);
 
-				return 1;
-			}
+	return rv;
+}
 
-			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
+int ldns_mergezone_merge(const char* from_zone, const char* to_zone, const char* out_zone, const int out_type, const int check_output, const size_t sort_mem_limit, const int low_memory)
+{
+	return ldns_mergezone_merge_multi(from_zone, &to_zone, 1, out_zone, out_type, check_output, sort_mem_limit, low_memory);
+}
 
-			output_dnskeys = ldns_mergezone_get_dnskeys(&to_ht);
+/* Collects the merged records in a zone */
+static int ldns_mergezone_merge_collect(void* arg, ldns_rr* rr, const int owned)
+{
+	ldns_zone*	merged	= (ldns_zone*) arg;
 
-			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"From\" and the \"To\" zone\n");
+	/* Records that are not handed over only live as long as the join */
+	if (!owned && ((rr = ldns_rr_clone(rr)) == NULL))
+	{
+		return 1;
+	}
 
-			if (ldns_mergezone_verify_validate_dnskey_sig(output_dnskeys, ldns_mergezone_get_dnskey_rrsigs(&from_ht)) != 0)
-			{
-				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+	if ((ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) && (ldns_zone_soa(merged) == NULL))
+	{
+		ldns_zone_set_soa(merged, rr);
+	}
+	else if (!ldns_zone_push_rr(merged, rr))
+	{
+		ldns_rr_free(rr);
 
-				return 1;
-			}
+		return 1;
+	}
 
-			if (ldns_mergezone_verify_validate_dnskey_sig(output_dnskeys, ldns_mergezone_get_dnskey_rrsigs(&to_ht)) != 0)
-			{
-				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+	return 0;
+}
 
-				return 1;
-			}
-		}
-		break;
-	case 3:
-		/* 
-		 * From zone must contain DNSKEYs with the 'from' algorithm,
-		 * and with the 'to' algorithm.
-		 *
-		 * To zone must not contain DNSKEYs with the 'from' algorithm,
-		 * but only with the 'to' algorithm.
-		 */
-		{
-			VERBOSE("Verifying the \"From\" zone contains DNSKEYs with both the \"from\" and the \"to\" algorithm\n");
+/* Merge two zones held in memory, passing the merged records to emit; finish (if set) is called before the join is cleaned up */
+static int ldns_mergezone_merge_mem_emit(const ldns_zone* from, const ldns_zone* to, const int out_type, const int check_output, join_emit emit, void* emit_arg, int (*finish)(void*, const int))
+{
+	ldns_zone*	to_dnssec	= NULL;
+	ldns_rr_list*	from_rrs	= ldns_zone_rrs(from);
+	int		to_algo		= 0;
+	int		rv		= 0;
+	size_t		i		= 0;
+	conform_ctx*	conform		= NULL;
+	dnssec_ht	to_ht;
+	join_ctx	join;
+	conform_ctx	conform_state;
+	zone_digest	to_digest;
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), from_algo) != 0)
-			{
-				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+	if (ldns_zone_soa(from) == NULL)
+	{
+		fprintf(stderr, "\"From\" zone is missing an SOA record\n");
 
-				return 1;
-			}
+		return 1;
+	}
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&from_ht), to_algo) != 0)
-			{
-				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+	/* Copy the DNSSEC records of the "to" zone, indexing takes them over */
+	ldns_mergezone_digest_init(&to_digest);
 
-				return 1;
-			}
+	if (ldns_mergezone_copy_dnssec_zone(to, &to_dnssec, &to_digest) != 0)
+	{
+		ldns_mergezone_digest_free(&to_digest);
 
-			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+		return 1;
+	}
 
-			VERBOSE("Verifying the \"To\" zone only contains DNSKEYs for the \"to\" algorithm\n");
+	if (ldns_mergezone_index_to_zone(to_dnssec, &to_digest, "\"to\" zone", "to", &to_ht, &to_algo) != 0)
+	{
+		ldns_zone_deep_free(to_dnssec);
+		ldns_mergezone_digest_free(&to_digest);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), from_algo) == 0)
-			{
-				fprintf(stderr, "\"To\" zone contains DNSKEYs with the \"from\" algorithm\n");
+		return 1;
+	}
 
-				return 1;
-			}
+	if (check_output)
+	{
+		ldns_mergezone_conform_init(&conform_state, out_type, 0, &to_algo, 1);
 
-			if (ldns_mergezone_verify_dnskey_set_contains_algo(ldns_mergezone_get_dnskeys(&to_ht), to_algo) != 0)
-			{
-				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+		conform = &conform_state;
+	}
 
-				return 1;
-			}
+	ldns_mergezone_join_init(&join, out_type, &to_ht, &to_algo, 1, ldns_zone_soa(to_dnssec), &to_digest, conform, emit, emit_arg);
 
-			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
-			
-			output_dnskeys = ldns_mergezone_get_dnskeys(&to_ht);
+	ldns_mergezone_progress_phase("merge", 0, ldns_rr_list_rr_count(from_rrs) + 1);
 
-			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"To\" zone\n");
+	/* The join takes over the records, so it gets copies; the SOA record goes first */
+	rv = ldns_mergezone_join_rr(&join, ldns_rr_clone(ldns_zone_soa(from)));
 
-			if (ldns_mergezone_verify_validate_dnskey_sig(output_dnskeys, ldns_mergezone_get_dnskey_rrsigs(&to_ht)) != 0)
-			{
-				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+	for (i = 0; (rv == 0) && (i < ldns_rr_list_rr_count(from_rrs)); i++)
+	{
+		PROGRESS_RECORDS(1);
 
-				return 1;
-			}
-		}
-		break;
-	default:
-		assert(0 == 1);	/* We should never get here, but hey... */
-		break;
+		rv = ldns_mergezone_join_rr(&join, ldns_rr_clone(ldns_rr_list_rr(from_rrs, i)));
 	}
 
-	/* Write the output zone */
-	out_fp = fopen(out_zone, "w");
+	if (rv == 0)
+	{
+		rv = ldns_mergezone_join_finish(&join);
+	}
 
-	if (out_fp == NULL)
+	if (finish != NULL)
 	{
-		fprintf(stderr, "Failed to open %s for writing\n", out_zone);
+		rv = finish(emit_arg, rv);
+	}
 
-		return EPERM;
+	rv = ldns_mergezone_finish_conform(conform, out_type, rv);
+
+	ldns_mergezone_join_metrics(&join);
+
+	if (rv == 0)
+	{
+		VERBOSE("Merge finished, merged zone has %zd records\n", join.out_recs);
 	}
 
-	/* Output the SOA first */
-	ldns_rr_print(out_fp, ldns_zone_soa(from));
-	out_recs++;
+	/* Clean up */
+	ldns_mergezone_join_free(&join);
+	ldns_mergezone_dnssec_ht_free(&to_ht);
+
+	ldns_zone_deep_free(to_dnssec);
+	ldns_mergezone_digest_free(&to_digest);
+
+	return rv;
+}
+
+/* Merge two zones held in memory; the input zones are left untouched, the merged zone must be freed with ldns_zone_deep_free() */
+int ldns_mergezone_merge_mem(const ldns_zone* from, const ldns_zone* to, const int out_type, const int check_output, ldns_zone** merged)
+{
+	assert(from != NULL);
+	assert(to != NULL);
+	assert(merged != NULL);
+
+	*merged = ldns_zone_new();
 
-	zone_rrs = ldns_zone_rrs(from);
+	assert(*merged != NULL);
 
-	for (i = 0; i < ldns_rr_list_rr_count(zone_rrs); i++)
+	if (ldns_mergezone_merge_mem_emit(from, to, out_type, check_output, ldns_mergezone_merge_collect, *merged, NULL) != 0)
 	{
-		ldns_rr*	rr		= ldns_rr_list_rr(zone_rrs, i);
-		ldns_rr*	merged_rrsig	= NULL;
-		int		is_dnskey_rec	= 0;
+		ldns_zone_deep_free(*merged);
 
-		if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG)
-		{
-			assert(ldns_rr_rd_count(rr) == 9);
+		*merged = NULL;
 
-			/* Check if the type covered by the RRSIG is DNSKEY */
-			uint16_t type_covered = ldns_rdf2native_int16(ldns_rr_rdf(rr, 0));
+		return 1;
+	}
 
-			if (type_covered == LDNS_RR_TYPE_DNSKEY)
-			{
-				/* Do not output this signature directly */
-				is_dnskey_rec = 1;
-			}
-			else
-			{
-				/* Find the accompanying signature in the other zone */
-				if (ldns_mergezone_find_rrsig_match(&to_ht, rr, &merged_rrsig) != 0)
-				{
-					fprintf(stderr, "Failed to find matching signature, giving up!\n");
+	return 0;
+}
 
-					fclose(out_fp);
+/* Passes merged records on to a callback, with the DNSKEY RRset and its signatures as one batch */
+typedef struct
+{
+	ldns_mergezone_merged_cb	cb;
+	void*				cb_arg;
+	join_held_rr*			batch;
+	const ldns_rr**			batch_rrs;
+	size_t				batch_count;
+	size_t				batch_alloc;
+}
+merge_batcher;
 
-					unlink(out_zone);
+/* Check if a record is part of the DNSKEY RRset or its signatures */
+static int ldns_mergezone_is_dnskey_rec(const ldns_rr* rr)
+{
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY)
+	{
+		return 1;
+	}
 
-					return 1;
-				}
+	return (ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG) &&
+	       (ldns_rdf2native_int16(ldns_rr_rdf(rr, 0)) == LDNS_RR_TYPE_DNSKEY);
+}
 
-				/* Output both signatures */
-				ldns_rr_print(out_fp, rr);
-				ldns_rr_print(out_fp, merged_rrsig);
+/* Pass the batch on if rv is 0, then release it */
+static int ldns_mergezone_batcher_flush(merge_batcher* b, int rv)
+{
+	size_t	i	= 0;
 
-				out_recs += 2;
-			}
-		}
-		else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_DNSKEY)
+	if ((rv == 0) && (b->batch_count > 0))
+	{
+		for (i = 0; i < b->batch_count; i++)
 		{
-			/* Do not output this record directly */
+			b->batch_rrs[i] = b->batch[i].rr;
 		}
-		else
-		{
-			/* Output unmodified resource record */
-			ldns_rr_print(out_fp, rr);
 
-			out_recs++;
-		}
+		rv = (b->cb(b->cb_arg, b->batch_rrs, b->batch_count) != 0);
+	}
 
-		if (is_dnskey_rec && !wrote_dnskeys_and_sigs)
+	for (i = 0; i < b->batch_count; i++)
+	{
+		if (b->batch[i].owned)
 		{
-			/* Write DNSKEY RRset and accompanying signatures */
-			size_t	j	= 0;
+			ldns_rr_free(b->batch[i].rr);
+		}
+	}
 
-			/* Output DNSKEYs first */
-			for (j = 0; j < ldns_rr_list_rr_count(output_dnskeys); j++)
-			{
-				ldns_rr_print(out_fp, ldns_rr_list_rr(output_dnskeys, j));
+	b->batch_count = 0;
 
-				out_recs++;
-			}
+	return rv;
+}
 
-			/* Output DNSKEY RRSIG records */
-			for (j = 0; j < ldns_rr_list_rr_count(ldns_mergezone_get_dnskey_rrsigs(&from_ht)); j++)
-			{
-				ldns_rr_print(out_fp, ldns_rr_list_rr(ldns_mergezone_get_dnskey_rrsigs(&from_ht), j));
+/* Receives merged records from the join; the join writes the DNSKEY RRset and its signatures together */
+static int ldns_mergezone_batcher_emit(void* arg, ldns_rr* rr, const int owned)
+{
+	merge_batcher*	b	= (merge_batcher*) arg;
+	const ldns_rr*	one	= rr;
+	int		rv	= 0;
 
-				out_recs++;
-			}
+	if (ldns_mergezone_is_dnskey_rec(rr))
+	{
+		if (b->batch_count == b->batch_alloc)
+		{
+			b->batch_alloc = (b->batch_alloc == 0) ? 16 : b->batch_alloc * 2;
+			b->batch = (join_held_rr*) realloc(b->batch, b->batch_alloc * sizeof(join_held_rr));
+			b->batch_rrs = (const ldns_rr**) realloc(b->batch_rrs, b->batch_alloc * sizeof(ldns_rr*));
 
-			for (j = 0; j < ldns_rr_list_rr_count(ldns_mergezone_get_dnskey_rrsigs(&to_ht)); j++)
-			{
-				ldns_rr_print(out_fp, ldns_rr_list_rr(ldns_mergezone_get_dnskey_rrsigs(&to_ht), j));
+			assert(b->batch != NULL);
+			assert(b->batch_rrs != NULL);
+		}
 
-				out_recs++;
-			}
+		b->batch[b->batch_count].rr = rr;
+		b->batch[b->batch_count].owned = owned;
+		b->batch_count++;
 
-			wrote_dnskeys_and_sigs = 1;
-		}
+		return 0;
 	}
 
-	if (!wrote_dnskeys_and_sigs)
+	rv = ldns_mergezone_batcher_flush(b, 0);
+
+	if (rv == 0)
 	{
-		fprintf(stderr, "An error occurred while outputting the merged zone\n");
+		rv = (b->cb(b->cb_arg, &one, 1) != 0);
+	}
 
-		fclose(out_fp);
+	if (owned)
+	{
+		ldns_rr_free(rr);
+	}
 
-		unlink(out_zone);
+	return rv;
+}
 
-		return 1;
-	}
+/* Pass on the last batch, if any, once the join has finished */
+static int ldns_mergezone_batcher_finish(void* arg, const int rv)
+{
+	return ldns_mergezone_batcher_flush((merge_batcher*) arg, rv);
+}
 
-	VERBOSE("Merge finished, wrote %zd records to %s\n", out_recs, out_zone);
+/* Merge two zones held in memory and pass the merged records to a callback in output order */
+int ldns_mergezone_merge_mem_cb(const ldns_zone* from, const ldns_zone* to, const int out_type, const int check_output, ldns_mergezone_merged_cb cb, ldns_mergezone_merge_done_cb done, void* cb_arg)
+{
+	merge_batcher	b;
+	int		rv	= 0;
 
-	fclose(out_fp);
+	assert(from != NULL);
+	assert(to != NULL);
+	assert(cb != NULL);
 
-	/* Clean up */
-	ldns_mergezone_dnssec_ht_free(&from_ht);
-	ldns_mergezone_dnssec_ht_free(&to_ht);
+	memset(&b, 0, sizeof(merge_batcher));
 
-	ldns_zone_deep_free(from);
-	ldns_zone_deep_free(to);
+	b.cb = cb;
+	b.cb_arg = cb_arg;
 
-	return 0;
+	rv = ldns_mergezone_merge_mem_emit(from, to, out_type, check_output, ldns_mergezone_batcher_emit, &b, ldns_mergezone_batcher_finish);
+
+	/* Records held when the merge failed early */
+	ldns_mergezone_batcher_flush(&b, 1);
+
+	free(b.batch);
+	free(b.batch_rrs);
+
+	/* Only now do the content and conformance checks have a result */
+	if (done != NULL)
+	{
+		done(cb_arg, rv);
+	}
+
+	return rv;
 }
- 
@@ -30,8 +30,60 @@
 
 #ifndef _LDNS_MERGEZONE_MERGE_H
 #define _LDNS_MERGEZONE_MERGE_H
- 
-int ldns_mergezone_merge(const char* from_zone, const char* to_zone, const char* out_zone, const int out_type);
+
+#include <stdlib.h>
+#include <ldns/ldns.h>
+
+/* Maximum number of "to" zones that can be merged with the "from" zone */
+#define MERGE_MAX_TO_ZONES	7
+
+/*
+ * Merge two zones; if sort_mem_limit is non-zero the "from" zone is sorted in
+ * canonical order first, using at most that much memory. In low memory mode
+ * the "from" zone is merged in a single thread, one record at a time.
+ */
+int ldns_mergezone_merge(const char* from_zone, const char* to_zone, const char* out_zone, const int out_type, const int check_output, const size_t sort_mem_limit, const int low_memory);
+
+/*
+ * Merge the "from" zone with to_count "to" zones, each signed with its own
+ * algorithm, so the output carries the signatures of all of them. The "to"
+ * zones together take the place of the single "to" zone in the requirements
+ * for the output zone type, so that several algorithms can be introduced
+ * or retired at once.
+ */
+int ldns_mergezone_merge_multi(const char* from_zone, const char* const* to_zones, const size_t to_count, const char* out_zone, const int out_type, const int check_output, const size_t sort_mem_limit, const int low_memory);
+
+/*
+ * Merge two zones held in memory, for applications that already have both
+ * signed zones loaded; the output is in the order of the "from" zone. The
+ * input zones are left untouched. On success *merged is set to the merged
+ * zone, which must be freed with ldns_zone_deep_free().
+ */
+int ldns_mergezone_merge_mem(const ldns_zone* from, const ldns_zone* to, const int out_type, const int check_output, ldns_zone** merged);
+
+/*
+ * Receives merged records in output order, one record per call except for
+ * the DNSKEY RRset, which is passed together with its signatures in one
+ * call. The records belong to the merge and are only valid during the
+ * call; a non-zero return value stops the merge.
+ */
+typedef int (*ldns_mergezone_merged_cb)(void* arg, const ldns_rr* const* rrs, const size_t count);
+
+/*
+ * Receives the outcome of a merge whose records were passed to a callback:
+ * rv is 0 if the merge succeeded, so the records can be committed, or 1 if
+ * it failed and they must be rolled back.
+ */
+typedef void (*ldns_mergezone_merge_done_cb)(void* arg, const int rv);
+
+/*
+ * Merge two zones held in memory like ldns_mergezone_merge_mem(), but pass
+ * the merged records on to a callback instead of building a merged zone.
+ * Some checks only finish after the last record, so the records are
+ * provisional until done (if not NULL) is called once at the end with the
+ * same result that the function returns.
+ */
+int ldns_mergezone_merge_mem_cb(const ldns_zone* from, const ldns_zone* to, const int out_type, const int check_output, ldns_mergezone_merged_cb cb, ldns_mergezone_merge_done_cb done, void* cb_arg);
 
 #endif /* !_LDNS_MERGEZONE_MERGE_H */
 
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <assert.h>
+#include "metrics.h"
+#include "replace.h"
+
+/*
+ * Metrics of a run, written as a file in the Prometheus text exposition
+ * format so that the textfile collector of the node exporter can pick
+ * them up. Values are collected in a small table as the run progresses
+ * (only from the main thread, at the end of each phase), and the file is
+ * written once at the end. It is written to a temporary file next to it
+ * that is then renamed over the old one, so the collector never reads a
+ * partially written file.
+ */
+
+/* Maximum number of samples and the maximum length of a label */
+#define METRICS_MAX_SAMPLES	128
+#define METRICS_MAX_LABEL	64
+
+typedef struct
+{
+	const char*	name;
+	const char*	type;
+	const char*	help;
+}
+metric_desc;
+
+typedef struct
+{
+	int		metric;
+	char		label[METRICS_MAX_LABEL];
+	char		label_value[METRICS_MAX_LABEL];
+	double		value;
+}
+metric_sample;
+
+static const metric_desc metric_descs[METRIC_COUNT] =
+{
+	{ "ldns_mergezone_last_run_success", "gauge", "Whether the last run succeeded (1) or failed (0)" },
+	{ "ldns_mergezone_last_run_timestamp_seconds", "gauge", "Time the last run finished, in seconds since the epoch" },
+	{ "ldns_mergezone_last_run_duration_seconds", "gauge", "Duration of the last run" },
+	{ "ldns_mergezone_phase_duration_seconds", "gauge", "Duration of each phase of the last run" },
+	{ "ldns_mergezone_records", "gauge", "Number of records in each zone" },
+	{ "ldns_mergezone_rrsigs", "gauge", "Number of RRSIG records in each zone" },
+	{ "ldns_mergezone_bytes", "gauge", "Size of each zone file read or written" },
+	{ "ldns_mergezone_validation_failures", "gauge", "Number of failed validations and conformance checks" },
+	{ "ldns_mergezone_peak_memory_bytes", "gauge", "Peak resident memory use of the last run" },
+	{ "ldns_mergezone_diff_records", "gauge", "Number of records deleted and added in the IXFR difference" },
+	{ "ldns_mergezone_last_run_skipped", "gauge", "Whether the last run was skipped (1) because nothing changed since the run before" }
+};
+
+static metric_sample	metric_samples[METRICS_MAX_SAMPLES];
+static size_t		metric_sample_count	= 0;
+static struct timespec	metrics_start;
+
+/* Start collecting metrics for a run */
+void ldns_mergezone_metrics_init(void)
+{
+	metric_sample_count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &metrics_start);
+}
+
+/* Set the value of a metric, optionally with a single label (label may be NULL) */
+void ldns_mergezone_metrics_set(const int metric, const char* label, const char* label_value, const double value)
+{
+	assert((metric >= 0) && (metric < METRIC_COUNT));
+
+	metric_sample*	sample	= NULL;
+	size_t		i	= 0;
+
+	if (label == NULL)
+	{
+		label = label_value = "";
+	}
+
+	for (i = 0; i < metric_sample_count; i++)
+	{
+		if ((metric_samples[i].metric == metric) && !strcmp(metric_samples[i].label, label) && !strcmp(metric_samples[i].label_value, label_value))
+		{
+			sample = &metric_samples[i];
+
+			break;
+		}
+	}
+
+	if (sample == NULL)
+	{
+		if (metric_sample_count == METRICS_MAX_SAMPLES)
+		{
+			return;
+		}
+
+		sample = &metric_samples[metric_sample_count++];
+
+		sample->metric = metric;
+
+		snprintf(sample->label, METRICS_MAX_LABEL, "%s", label);
+		snprintf(sample->label_value, METRICS_MAX_LABEL, "%s", label_value);
+	}
+
+	sample->value = value;
+}
+
+/* Write a label value with backslashes, double quotes and newlines escaped */
+static void ldns_mergezone_metrics_write_label_value(FILE* fp, const char* value)
+{
+	for (; *value != '\0'; value++)
+	{
+		switch(*value)
+		{
+		case '\\':
+			fputs("\\\\", fp);
+			break;
+		case '"':
+			fputs("\\\"", fp);
+			break;
+		case '\n':
+			fputs("\\n", fp);
+			break;
+		default:
+			fputc(*value, fp);
+		}
+	}
+}
+
+/* Write all metrics in the Prometheus text format, atomically replacing the specified file */
+int ldns_mergezone_metrics_write(const char* metrics_file)
+{
+	assert(metrics_file != NULL);
+
+	struct rusage	usage;
+	struct timespec	now;
+	replace_file	rf;
+	FILE*		fp		= NULL;
+	int		metric		= 0;
+	size_t		i		= 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ldns_mergezone_metrics_set(METRIC_RUN_TIMESTAMP, NULL, NULL, (double) time(NULL));
+	ldns_mergezone_metrics_set(METRIC_RUN_SECONDS, NULL, NULL, (now.tv_sec - metrics_start.tv_sec) + (now.tv_nsec - metrics_start.tv_nsec) / 1e9);
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		/* Linux and the BSDs report this in kilobytes */
+		ldns_mergezone_metrics_set(METRIC_PEAK_MEMORY, NULL, NULL, (double) usage.ru_maxrss * 1024);
+	}
+
+	if (ldns_mergezone_replace_open(&rf, metrics_file) != 0)
+	{
+		return 1;
+	}
+
+	fp = rf.fp;
+
+	/* The collector usually runs as a different user */
+	fchmod(rf.fd, 0644);
+
+	for (metric = 0; metric < METRIC_COUNT; metric++)
+	{
+		int	described	= 0;
+
+		for (i = 0; i < metric_sample_count; i++)
+		{
+			const metric_sample*	sample	= &metric_samples[i];
+
+			if (sample->metric != metric)
+			{
+				continue;
+			}
+
+			if (!described)
+			{
+				fprintf(fp, "# HELP %s %s\n", metric_descs[metric].name, metric_descs[metric].help);
+				fprintf(fp, "# TYPE %s %s\n", metric_descs[metric].name, metric_descs[metric].type);
+
+				described = 1;
+			}
+
+			fputs(metric_descs[metric].name, fp);
+
+			if (sample->label[0] != '\0')
+			{
+				fprintf(fp, "{%s=\"", sample->label);
+				ldns_mergezone_metrics_write_label_value(fp, sample->label_value);
+				fputs("\"}", fp);
+			}
+
+			fprintf(fp, " %.15g\n", sample->value);
+		}
+	}
+
+	if (ldns_mergezone_replace_close(&rf, 0) != 0)
+	{
+		fprintf(stderr, "Failed to write metrics to %s\n", metrics_file);
+
+		return 1;
+	}
+
+	return 0;
+}
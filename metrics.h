@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_METRICS_H
+#define _LDNS_MERGEZONE_METRICS_H
+
+#include <stdint.h>
+
+/* Metrics */
+#define METRIC_RUN_SUCCESS		0
+#define METRIC_RUN_TIMESTAMP		1
+#define METRIC_RUN_SECONDS		2
+#define METRIC_PHASE_SECONDS		3
+#define METRIC_RECORDS			4
+#define METRIC_RRSIGS			5
+#define METRIC_BYTES			6
+#define METRIC_VALIDATION_FAILURES	7
+#define METRIC_PEAK_MEMORY		8
+#define METRIC_DIFF_RECORDS		9
+#define METRIC_RUN_SKIPPED		10
+#define METRIC_COUNT			11
+
+/* Start collecting metrics for a run */
+void ldns_mergezone_metrics_init(void);
+
+/* Set the value of a metric, optionally with a single label (label may be NULL) */
+void ldns_mergezone_metrics_set(const int metric, const char* label, const char* label_value, const double value);
+
+/* Write all metrics in the Prometheus text format, atomically replacing the specified file */
+int ldns_mergezone_metrics_write(const char* metrics_file);
+
+#endif /* !_LDNS_MERGEZONE_METRICS_H */
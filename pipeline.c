@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "pipeline.h"
+#include "ring.h"
+#include "reader.h"
+#include "join.h"
+#include "format.h"
+#include "writer.h"
+#include "trace.h"
+
+/*
+ * The stages are connected by bounded rings, so a slow stage makes the
+ * ones before it wait instead of letting memory use grow. Work is passed
+ * on in batches to keep the cost of the hand-over low. Each stage passes
+ * on a NULL batch when it is done; if a stage fails, it sets the failed
+ * flag and keeps consuming (and freeing) its input until it receives
+ * NULL, so no stage ever blocks on a ring that is no longer emptied.
+ */
+
+/* Number of items per batch */
+#define PIPELINE_BATCH		256
+
+/* Number of batches each ring can hold */
+#define PIPELINE_RING_SIZE	64
+
+/* Size at which formatted output is handed over to the writer */
+#define PIPELINE_OUT_CHUNK	(256 * 1024)
+
+/* Lines read from the zone file */
+typedef struct
+{
+	size_t	count;
+	char*	lines[PIPELINE_BATCH];
+	int	line_nrs[PIPELINE_BATCH];
+}
+pipeline_line_batch;
+
+/* Parsed records */
+typedef struct
+{
+	size_t		count;
+	ldns_rr*	rrs[PIPELINE_BATCH];
+}
+pipeline_rr_batch;
+
+/* Merged records in output order */
+typedef struct
+{
+	size_t		count;
+	join_held_rr	rrs[PIPELINE_BATCH];
+}
+pipeline_out_batch;
+
+typedef struct
+{
+	zone_reader*		from;
+	join_ctx*		join;
+	pipeline_out_batch*	cur_out;
+	ring			lines;
+	ring			rrs;
+	ring			out;
+	ring			text;
+	int			failed;
+}
+pipeline;
+
+static void ldns_mergezone_pipeline_fail(pipeline* p)
+{
+	__atomic_store_n(&p->failed, 1, __ATOMIC_RELEASE);
+}
+
+static int ldns_mergezone_pipeline_failed(pipeline* p)
+{
+	return __atomic_load_n(&p->failed, __ATOMIC_ACQUIRE);
+}
+
+static void ldns_mergezone_pipeline_free_out_batch(pipeline_out_batch* batch)
+{
+	size_t	i	= 0;
+
+	for (i = 0; i < batch->count; i++)
+	{
+		if (batch->rrs[i].owned)
+		{
+			ldns_rr_free(batch->rrs[i].rr);
+		}
+	}
+
+	free(batch);
+}
+
+/* Stage 1: read lines from the zone file */
+static void* ldns_mergezone_pipeline_read(void* arg)
+{
+	pipeline*		p	= (pipeline*) arg;
+	pipeline_line_batch*	batch	= NULL;
+	char*			line	= NULL;
+	uint64_t		start	= 0;
+
+	TRACE_THREAD("read");
+
+	while (!ldns_mergezone_pipeline_failed(p))
+	{
+		if (ldns_mergezone_reader_next_line(p->from, &line) != 0)
+		{
+			ldns_mergezone_pipeline_fail(p);
+
+			break;
+		}
+
+		if (line == NULL)
+		{
+			break;
+		}
+
+		if (batch == NULL)
+		{
+			batch = (pipeline_line_batch*) malloc(sizeof(pipeline_line_batch));
+
+			assert(batch != NULL);
+
+			batch->count = 0;
+
+			TRACE_BEGIN(start);
+		}
+
+		batch->lines[batch->count] = strdup(line);
+		batch->line_nrs[batch->count] = p->from->line_nr;
+
+		assert(batch->lines[batch->count] != NULL);
+
+		if (++batch->count == PIPELINE_BATCH)
+		{
+			TRACE_END(start, "pipeline", "read");
+
+			ldns_mergezone_ring_push(&p->lines, batch);
+
+			batch = NULL;
+		}
+	}
+
+	if (batch != NULL)
+	{
+		TRACE_END(start, "pipeline", "read");
+
+		ldns_mergezone_ring_push(&p->lines, batch);
+	}
+
+	ldns_mergezone_ring_push(&p->lines, NULL);
+
+	return NULL;
+}
+
+/* Stage 2: parse lines into records */
+static void* ldns_mergezone_pipeline_parse(void* arg)
+{
+	pipeline*		p	= (pipeline*) arg;
+	pipeline_line_batch*	lines	= NULL;
+	pipeline_rr_batch*	batch	= NULL;
+	size_t			i	= 0;
+	uint64_t		start	= 0;
+
+	TRACE_THREAD("parse");
+
+	while ((lines = (pipeline_line_batch*) ldns_mergezone_ring_pop(&p->lines)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		batch = (pipeline_rr_batch*) malloc(sizeof(pipeline_rr_batch));
+
+		assert(batch != NULL);
+
+		batch->count = 0;
+
+		for (i = 0; i < lines->count; i++)
+		{
+			ldns_rr*	rr	= NULL;
+
+			if (!ldns_mergezone_pipeline_failed(p))
+			{
+				if (ldns_mergezone_reader_parse(p->from, lines->lines[i], lines->line_nrs[i], &rr) != 0)
+				{
+					ldns_mergezone_pipeline_fail(p);
+				}
+				else if (rr != NULL)
+				{
+					batch->rrs[batch->count++] = rr;
+				}
+			}
+
+			free(lines->lines[i]);
+		}
+
+		free(lines);
+
+		TRACE_END(start, "pipeline", "parse");
+
+		ldns_mergezone_ring_push(&p->rrs, batch);
+	}
+
+	ldns_mergezone_ring_push(&p->rrs, NULL);
+
+	return NULL;
+}
+
+/* Receives merged records from the join */
+static int ldns_mergezone_pipeline_emit(void* arg, ldns_rr* rr, const int owned)
+{
+	pipeline*	p	= (pipeline*) arg;
+
+	if (p->cur_out == NULL)
+	{
+		p->cur_out = (pipeline_out_batch*) malloc(sizeof(pipeline_out_batch));
+
+		assert(p->cur_out != NULL);
+
+		p->cur_out->count = 0;
+	}
+
+	p->cur_out->rrs[p->cur_out->count].rr = rr;
+	p->cur_out->rrs[p->cur_out->count].owned = owned;
+
+	if (++p->cur_out->count == PIPELINE_BATCH)
+	{
+		ldns_mergezone_ring_push(&p->out, p->cur_out);
+
+		p->cur_out = NULL;
+	}
+
+	return 0;
+}
+
+/* Stage 3: merge records with the "to" zone */
+static void* ldns_mergezone_pipeline_join(void* arg)
+{
+	pipeline*		p	= (pipeline*) arg;
+	pipeline_rr_batch*	batch	= NULL;
+	size_t			i	= 0;
+	uint64_t		start	= 0;
+
+	TRACE_THREAD("join");
+
+	while ((batch = (pipeline_rr_batch*) ldns_mergezone_ring_pop(&p->rrs)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		for (i = 0; i < batch->count; i++)
+		{
+			if (ldns_mergezone_pipeline_failed(p))
+			{
+				ldns_rr_free(batch->rrs[i]);
+			}
+			else if (ldns_mergezone_join_rr(p->join, batch->rrs[i]) != 0)
+			{
+				ldns_mergezone_pipeline_fail(p);
+			}
+		}
+
+		free(batch);
+
+		TRACE_END(start, "pipeline", "join");
+
+		/* Do not keep output waiting for a full batch while input is slow */
+		if ((p->cur_out != NULL) && (p->cur_out->count > 0) && ldns_mergezone_ring_empty(&p->rrs))
+		{
+			ldns_mergezone_ring_push(&p->out, p->cur_out);
+
+			p->cur_out = NULL;
+		}
+	}
+
+	if (!ldns_mergezone_pipeline_failed(p) && (ldns_mergezone_join_finish(p->join) != 0))
+	{
+		ldns_mergezone_pipeline_fail(p);
+	}
+
+	if (p->cur_out != NULL)
+	{
+		ldns_mergezone_ring_push(&p->out, p->cur_out);
+
+		p->cur_out = NULL;
+	}
+
+	ldns_mergezone_ring_push(&p->out, NULL);
+
+	return NULL;
+}
+
+/* Stage 4: format records as text */
+static void* ldns_mergezone_pipeline_format(void* arg)
+{
+	pipeline*		p	= (pipeline*) arg;
+	pipeline_out_batch*	batch	= NULL;
+	ldns_buffer*		text	= NULL;
+	size_t			i	= 0;
+	uint64_t		start	= 0;
+
+	TRACE_THREAD("format");
+
+	while ((batch = (pipeline_out_batch*) ldns_mergezone_ring_pop(&p->out)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		if (ldns_mergezone_pipeline_failed(p))
+		{
+			ldns_mergezone_pipeline_free_out_batch(batch);
+
+			continue;
+		}
+
+		if (text == NULL)
+		{
+			text = ldns_buffer_new(PIPELINE_OUT_CHUNK + LDNS_MAX_LINELEN);
+
+			assert(text != NULL);
+		}
+
+		for (i = 0; i < batch->count; i++)
+		{
+			if (ldns_mergezone_format_rr(text, batch->rrs[i].rr) != LDNS_STATUS_OK)
+			{
+				fprintf(stderr, "Failed to format merged record\n");
+
+				ldns_mergezone_pipeline_fail(p);
+
+				break;
+			}
+		}
+
+		ldns_mergezone_pipeline_free_out_batch(batch);
+
+		TRACE_END(start, "pipeline", "format");
+
+		if ((ldns_buffer_position(text) >= PIPELINE_OUT_CHUNK) || ldns_mergezone_ring_empty(&p->out))
+		{
+			ldns_mergezone_ring_push(&p->text, text);
+
+			text = NULL;
+		}
+	}
+
+	if (text != NULL)
+	{
+		ldns_mergezone_ring_push(&p->text, text);
+	}
+
+	ldns_mergezone_ring_push(&p->text, NULL);
+
+	return NULL;
+}
+
+int ldns_mergezone_pipeline_run(zone_reader* from, join_ctx* join, zone_writer* out)
+{
+	assert(from != NULL);
+	assert(join != NULL);
+	assert(out != NULL);
+
+	/* Stages are started last to first, so a stage that fails to start can be replaced by an end marker */
+	void*		(*stages[4])(void*)	= { ldns_mergezone_pipeline_format, ldns_mergezone_pipeline_join, ldns_mergezone_pipeline_parse, ldns_mergezone_pipeline_read };
+	pthread_t	threads[4];
+	ring*		stage_out[4];
+	int		started			= 0;
+	ldns_buffer*	text			= NULL;
+	pipeline	p;
+
+	memset(&p, 0, sizeof(pipeline));
+
+	p.from = from;
+	p.join = join;
+
+	join->emit = ldns_mergezone_pipeline_emit;
+	join->emit_arg = &p;
+
+	if ((ldns_mergezone_ring_init(&p.lines, PIPELINE_RING_SIZE) != 0) ||
+	    (ldns_mergezone_ring_init(&p.rrs, PIPELINE_RING_SIZE) != 0) ||
+	    (ldns_mergezone_ring_init(&p.out, PIPELINE_RING_SIZE) != 0) ||
+	    (ldns_mergezone_ring_init(&p.text, PIPELINE_RING_SIZE) != 0))
+	{
+		fprintf(stderr, "Failed to set up output pipeline\n");
+
+		return 1;
+	}
+
+	stage_out[0] = &p.text;
+	stage_out[1] = &p.out;
+	stage_out[2] = &p.rrs;
+	stage_out[3] = &p.lines;
+
+	for (started = 0; started < 4; started++)
+	{
+		if (pthread_create(&threads[started], NULL, stages[started], &p) != 0)
+		{
+			fprintf(stderr, "Failed to start output pipeline thread\n");
+
+			ldns_mergezone_pipeline_fail(&p);
+
+			ldns_mergezone_ring_push(stage_out[started], NULL);
+
+			break;
+		}
+	}
+
+	/* Stage 5: write the output in this thread */
+	while ((text = (ldns_buffer*) ldns_mergezone_ring_pop(&p.text)) != NULL)
+	{
+		if (!ldns_mergezone_pipeline_failed(&p) &&
+		    (ldns_mergezone_writer_write(out, ldns_buffer_begin(text), ldns_buffer_position(text)) != 0))
+		{
+			ldns_mergezone_pipeline_fail(&p);
+		}
+
+		ldns_buffer_free(text);
+	}
+
+	while (started > 0)
+	{
+		pthread_join(threads[--started], NULL);
+	}
+
+	ldns_mergezone_ring_free(&p.lines);
+	ldns_mergezone_ring_free(&p.rrs);
+	ldns_mergezone_ring_free(&p.out);
+	ldns_mergezone_ring_free(&p.text);
+
+	join->emit = NULL;
+	join->emit_arg = NULL;
+
+	return ldns_mergezone_pipeline_failed(&p);
+}
+
+/* Output of the single-threaded pipeline */
+typedef struct
+{
+	zone_writer*	out;
+	ldns_buffer*	text;
+}
+pipeline_printer;
+
+/* Receives merged records from the join and writes them straight away */
+static int ldns_mergezone_pipeline_print(void* arg, ldns_rr* rr, const int owned)
+{
+	pipeline_printer*	printer	= (pipeline_printer*) arg;
+	int			rv	= 0;
+
+	ldns_buffer_clear(printer->text);
+
+	if (ldns_mergezone_format_rr(printer->text, rr) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to format merged record\n");
+
+		rv = 1;
+	}
+	else
+	{
+		rv = ldns_mergezone_writer_write(printer->out, ldns_buffer_begin(printer->text), ldns_buffer_position(printer->text));
+	}
+
+	if (owned)
+	{
+		ldns_rr_free(rr);
+	}
+
+	return rv;
+}
+
+int ldns_mergezone_pipeline_run_inline(zone_reader* from, join_ctx* join, zone_writer* out)
+{
+	assert(from != NULL);
+	assert(join != NULL);
+	assert(out != NULL);
+
+	pipeline_printer	printer;
+	ldns_rr*		rr	= NULL;
+	int			rv	= 0;
+
+	printer.out = out;
+	printer.text = ldns_buffer_new(LDNS_MAX_LINELEN);
+
+	assert(printer.text != NULL);
+
+	join->emit = ldns_mergezone_pipeline_print;
+	join->emit_arg = &printer;
+
+	while ((rv = ldns_mergezone_reader_next_rr(from, &rr)) == 0)
+	{
+		if (rr == NULL)
+		{
+			rv = ldns_mergezone_join_finish(join);
+
+			break;
+		}
+
+		if ((rv = ldns_mergezone_join_rr(join, rr)) != 0)
+		{
+			break;
+		}
+	}
+
+	join->emit = NULL;
+	join->emit_arg = NULL;
+
+	ldns_buffer_free(printer.text);
+
+	return rv;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_PIPELINE_H
+#define _LDNS_MERGEZONE_PIPELINE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ldns/ldns.h>
+#include "reader.h"
+#include "join.h"
+#include "writer.h"
+
+/*
+ * Merge the "from" zone into the output file, with reading, parsing,
+ * merging, formatting and writing each running in their own thread.
+ * The join context must have been initialised; its receiver is set
+ * by the pipeline.
+ */
+int ldns_mergezone_pipeline_run(zone_reader* from, join_ctx* join, zone_writer* out);
+
+/*
+ * Merge the "from" zone into the output file in the calling thread, one
+ * record at a time; every record is freed as soon as it is written.
+ */
+int ldns_mergezone_pipeline_run_inline(zone_reader* from, join_ctx* join, zone_writer* out);
+
+#endif /* !_LDNS_MERGEZONE_PIPELINE_H */
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "progress.h"
+#include "metrics.h"
+#include "trace.h"
+
+/*
+ * Progress reporting for long runs. The threads doing the work only bump
+ * two counters (records and input bytes) of the current phase; these are
+ * only ever written by the single thread that is reading input at the
+ * time, so updating them is an ordinary load and store without any
+ * locked instructions, and when progress is not shown it is a single
+ * well-predicted branch. A separate timer thread wakes up at a fixed
+ * interval, samples the counters and writes a line with the phase,
+ * records processed, percentage done, rate and estimated time remaining.
+ * The percentage is based on the input bytes consumed if the size of the
+ * input is known. A summary line is written at the end of each phase.
+ * Phases are timed for the metrics and the trace even if progress is not
+ * shown.
+ */
+
+int			show_progress	= 0;
+progress_counters	progress;
+
+static pthread_mutex_t	progress_lock		= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	progress_cond;
+static pthread_t	progress_thread;
+static int		progress_fd		= -1;
+static int		progress_stopping	= 0;
+static const char*	progress_phase_name	= NULL;
+static uint64_t		progress_total_bytes	= 0;
+static uint64_t		progress_total_recs	= 0;
+static struct timespec	progress_phase_start;
+static uint64_t		progress_phase_trace	= 0;
+
+static double ldns_mergezone_progress_elapsed(const struct timespec* since)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static void ldns_mergezone_progress_hms(char* buf, const size_t len, const double secs)
+{
+	unsigned long	s	= (secs > 0) ? (unsigned long) (secs + 0.5) : 0;
+
+	snprintf(buf, len, "%02lu:%02lu:%02lu", s / 3600, (s / 60) % 60, s % 60);
+}
+
+/* Format a report on the current phase, must be called with the lock held */
+static void ldns_mergezone_progress_format(char* line, const size_t len, const int finished)
+{
+	double		elapsed		= ldns_mergezone_progress_elapsed(&progress_phase_start);
+	uint64_t	recs		= __atomic_load_n(&progress.recs, __ATOMIC_RELAXED);
+	uint64_t	bytes		= __atomic_load_n(&progress.bytes, __ATOMIC_RELAXED);
+	double		done		= 0;
+	size_t		pos		= 0;
+	char		elapsed_str[32];
+	char		eta_str[32];
+
+	ldns_mergezone_progress_hms(elapsed_str, sizeof(elapsed_str), elapsed);
+
+	pos += snprintf(&line[pos], len - pos, "[%s] %s %s, %" PRIu64 " records", progress_phase_name, finished ? "finished in" : "running for", elapsed_str, recs);
+
+	if ((elapsed > 0) && (pos < len))
+	{
+		pos += snprintf(&line[pos], len - pos, ", %.0f records/s", recs / elapsed);
+	}
+
+	if (progress_total_bytes > 0)
+	{
+		done = (double) bytes / progress_total_bytes;
+	}
+	else if (progress_total_recs > 0)
+	{
+		done = (double) recs / progress_total_recs;
+	}
+
+	if (!finished && (done > 0) && (done <= 1) && (pos < len))
+	{
+		ldns_mergezone_progress_hms(eta_str, sizeof(eta_str), elapsed * (1 - done) / done);
+
+		pos += snprintf(&line[pos], len - pos, ", %.1f%% done, ETA %s", done * 100, eta_str);
+	}
+
+	if (pos < len)
+	{
+		snprintf(&line[pos], len - pos, "\n");
+	}
+}
+
+static void ldns_mergezone_progress_write(const char* line)
+{
+	size_t	len	= strlen(line);
+	ssize_t	rv	= 0;
+
+	/* Progress is informational, so errors are ignored */
+	while (len > 0)
+	{
+		rv = write(progress_fd, line, len);
+
+		if ((rv < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+
+		if (rv <= 0)
+		{
+			break;
+		}
+
+		line += rv;
+		len -= rv;
+	}
+}
+
+/* Time the phase that just ended and report on it, must be called with the lock held */
+static void ldns_mergezone_progress_finish_phase(char* line, const size_t len)
+{
+	if (progress_phase_name == NULL)
+	{
+		return;
+	}
+
+	ldns_mergezone_metrics_set(METRIC_PHASE_SECONDS, "phase", progress_phase_name, ldns_mergezone_progress_elapsed(&progress_phase_start));
+
+	TRACE_END(progress_phase_trace, "phase", progress_phase_name);
+
+	if (show_progress)
+	{
+		ldns_mergezone_progress_format(line, len, 1);
+	}
+}
+
+static void* ldns_mergezone_progress_run(void* arg)
+{
+	struct timespec	deadline;
+	char		line[256];
+
+	(void) arg;
+
+	pthread_mutex_lock(&progress_lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	while (!progress_stopping)
+	{
+		deadline.tv_sec += PROGRESS_INTERVAL;
+
+		while (!progress_stopping && (pthread_cond_timedwait(&progress_cond, &progress_lock, &deadline) != ETIMEDOUT));
+
+		if (progress_stopping || (progress_phase_name == NULL))
+		{
+			continue;
+		}
+
+		ldns_mergezone_progress_format(line, sizeof(line), 0);
+
+		/* Do not hold up the start of a new phase while writing */
+		pthread_mutex_unlock(&progress_lock);
+
+		ldns_mergezone_progress_write(line);
+
+		pthread_mutex_lock(&progress_lock);
+	}
+
+	pthread_mutex_unlock(&progress_lock);
+
+	return NULL;
+}
+
+/* Start reporting progress to the specified file descriptor */
+int ldns_mergezone_progress_start(const int fd)
+{
+	pthread_condattr_t	attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&progress_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	progress_fd = fd;
+	progress_stopping = 0;
+	progress_phase_name = NULL;
+
+	if (pthread_create(&progress_thread, NULL, ldns_mergezone_progress_run, NULL) != 0)
+	{
+		fprintf(stderr, "Failed to start progress reporting thread\n");
+
+		pthread_cond_destroy(&progress_cond);
+
+		return 1;
+	}
+
+	show_progress = 1;
+
+	return 0;
+}
+
+/* Start a new phase; the percentage done is based on total_bytes if known, otherwise on total_recs (both may be 0) */
+void ldns_mergezone_progress_phase(const char* phase, const uint64_t total_bytes, const uint64_t total_recs)
+{
+	char	line[256];
+
+	line[0] = '\0';
+
+	pthread_mutex_lock(&progress_lock);
+
+	ldns_mergezone_progress_finish_phase(line, sizeof(line));
+
+	progress_phase_name = phase;
+	progress_total_bytes = total_bytes;
+	progress_total_recs = total_recs;
+
+	/* The thread that updated the counters in the last phase is done with them */
+	__atomic_store_n(&progress.recs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&progress.bytes, 0, __ATOMIC_RELAXED);
+
+	clock_gettime(CLOCK_MONOTONIC, &progress_phase_start);
+
+	TRACE_BEGIN(progress_phase_trace);
+
+	pthread_mutex_unlock(&progress_lock);
+
+	if (show_progress)
+	{
+		ldns_mergezone_progress_write(line);
+	}
+}
+
+/* Report on the last phase and stop reporting */
+void ldns_mergezone_progress_stop(void)
+{
+	char	line[256];
+
+	line[0] = '\0';
+
+	pthread_mutex_lock(&progress_lock);
+
+	ldns_mergezone_progress_finish_phase(line, sizeof(line));
+
+	progress_phase_name = NULL;
+	progress_stopping = 1;
+
+	if (show_progress)
+	{
+		pthread_cond_signal(&progress_cond);
+	}
+
+	pthread_mutex_unlock(&progress_lock);
+
+	if (!show_progress)
+	{
+		return;
+	}
+
+	pthread_join(progress_thread, NULL);
+	pthread_cond_destroy(&progress_cond);
+
+	show_progress = 0;
+
+	ldns_mergezone_progress_write(line);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_PROGRESS_H
+#define _LDNS_MERGEZONE_PROGRESS_H
+
+#include <stdint.h>
+
+/* Interval between progress reports in seconds */
+#define PROGRESS_INTERVAL	5
+
+/* Counters of the current phase, each is only ever updated by the one thread that is reading */
+typedef struct
+{
+	uint64_t	recs;
+	uint64_t	bytes;
+}
+__attribute__((aligned(64))) progress_counters;
+
+extern int			show_progress;
+extern progress_counters	progress;
+
+#define PROGRESS_ADD(counter, n) { __atomic_store_n(&(counter), __atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), __ATOMIC_RELAXED); }
+
+#define PROGRESS_RECORDS(n) { if (show_progress) PROGRESS_ADD(progress.recs, (n)); }
+
+#define PROGRESS_BYTES(n) { if (show_progress) PROGRESS_ADD(progress.bytes, (n)); }
+
+/* Start reporting progress to the specified file descriptor */
+int ldns_mergezone_progress_start(const int fd);
+
+/* Start a new phase; the percentage done is based on total_bytes if known, otherwise on total_recs (both may be 0) */
+void ldns_mergezone_progress_phase(const char* phase, const uint64_t total_bytes, const uint64_t total_recs);
+
+/* Report on the last phase and stop reporting */
+void ldns_mergezone_progress_stop(void);
+
+#endif /* !_LDNS_MERGEZONE_PROGRESS_H */
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "reader.h"
+#include "b64.h"
+#include "aio.h"
+#include "progress.h"
+
+/*
+ * Reads a zone one record at a time, the same way ldns_zone_new_frm_fp()
+ * does, but with reading a line and parsing it split into two steps so
+ * they can run in different threads. The reading step only touches the
+ * file and the line counter, the parsing step only touches the origin,
+ * previous owner and default TTL.
+ *
+ * Most of the text in a signed zone is the base64 signature or public key
+ * at the end of RRSIG and DNSKEY records. For these records the base64
+ * field is decoded here with the vectorised decoder and replaced by a
+ * short placeholder before the rest of the record is parsed by ldns; the
+ * placeholder data is then swapped for the decoded data. If the field is
+ * not valid base64, the record is left to ldns as a whole.
+ */
+
+/* Strip leading and trailing white space */
+static char* ldns_mergezone_reader_strip_ws(char* str)
+{
+	char*	end	= NULL;
+
+	while (isspace((unsigned char) *str))
+	{
+		str++;
+	}
+
+	end = str + strlen(str);
+
+	while ((end > str) && isspace((unsigned char) end[-1]))
+	{
+		*--end = '\0';
+	}
+
+	return str;
+}
+
+/* Find the next token, returns its start and sets its length */
+static char* ldns_mergezone_reader_token(char* str, size_t* len)
+{
+	while (isspace((unsigned char) *str))
+	{
+		str++;
+	}
+
+	for (*len = 0; (str[*len] != '\0') && !isspace((unsigned char) str[*len]); (*len)++);
+
+	return str;
+}
+
+/* Check if a token is a class */
+static int ldns_mergezone_reader_is_class(const char* token, const size_t len)
+{
+	return ((len == 2) && ((strncasecmp(token, "IN", 2) == 0) || (strncasecmp(token, "CH", 2) == 0) ||
+	                       (strncasecmp(token, "HS", 2) == 0) || (strncasecmp(token, "CS", 2) == 0))) ||
+	       ((len > 5) && (strncasecmp(token, "CLASS", 5) == 0));
+}
+
+/* Find the base64 field of an RRSIG or DNSKEY record, returns the index of the field or -1 for other records */
+static int ldns_mergezone_reader_find_b64(char* line, char** b64)
+{
+	char*	token	= line;
+	size_t	len	= 0;
+	int	field	= -1;
+	int	i	= 0;
+
+	/* Lines starting with white space have no owner name */
+	if (!isspace((unsigned char) *line))
+	{
+		token = ldns_mergezone_reader_token(line, &len);
+		token += len;
+	}
+
+	/* Skip the TTL and class, which can come in either order */
+	for (i = 0; i < 3; i++)
+	{
+		token = ldns_mergezone_reader_token(token + ((i > 0) ? len : 0), &len);
+
+		if (!isdigit((unsigned char) *token) && !ldns_mergezone_reader_is_class(token, len))
+		{
+			break;
+		}
+	}
+
+	if ((len == 5) && (strncasecmp(token, "RRSIG", 5) == 0))
+	{
+		field = 8;
+	}
+	else if ((len == 6) && (strncasecmp(token, "DNSKEY", 6) == 0))
+	{
+		field = 3;
+	}
+	else
+	{
+		return -1;
+	}
+
+	for (i = 0; i <= field; i++)
+	{
+		token = ldns_mergezone_reader_token(token + len, &len);
+
+		/* Leave records in the unknown record format to ldns */
+		if ((len == 0) || ((i == 0) && (*token == '\\')))
+		{
+			return -1;
+		}
+	}
+
+	*b64 = token;
+
+	return field;
+}
+
+/* Decode the base64 field, which runs to the end of the line, and replace it by a placeholder; returns NULL if it is not valid */
+static uint8_t* ldns_mergezone_reader_decode_b64(char* b64, size_t* data_len)
+{
+	char*		in	= b64;
+	char*		out	= b64;
+	uint8_t*	data	= NULL;
+
+	/* Like ldns, allow the data to be split by white space */
+	for (in = b64; *in != '\0'; in++)
+	{
+		if (!isspace((unsigned char) *in))
+		{
+			*out++ = *in;
+		}
+	}
+
+	*out = '\0';
+
+	if ((out - b64) < 4)
+	{
+		return NULL;
+	}
+
+	data = (uint8_t*) malloc(B64_DECODED_MAX(out - b64) + B64_DECODE_SLACK);
+
+	assert(data != NULL);
+
+	if (ldns_mergezone_b64_decode(b64, out - b64, data, data_len) != 0)
+	{
+		free(data);
+
+		return NULL;
+	}
+
+	strcpy(b64, "AA==");
+
+	return data;
+}
+
+/* Open a zone file for reading */
+int ldns_mergezone_reader_open(zone_reader* reader, const char* zone_file)
+{
+	assert(reader != NULL);
+	assert(zone_file != NULL);
+
+	memset(reader, 0, sizeof(zone_reader));
+
+	reader->name = zone_file;
+	reader->default_ttl = 3600;
+	reader->fp = ldns_mergezone_aio_fopen(zone_file);
+
+	if (reader->fp == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for reading\n", zone_file);
+
+		return 1;
+	}
+
+	reader->line = (char*) malloc(LDNS_MAX_LINELEN + 1);
+
+	assert(reader->line != NULL);
+
+	return 0;
+}
+
+/* Read the next line (a record or a directive) into an internal buffer; *line is NULL at the end of the file */
+int ldns_mergezone_reader_next_line(zone_reader* reader, char** line)
+{
+	assert(reader != NULL);
+	assert(line != NULL);
+
+	ssize_t	len	= 0;
+
+	*line = NULL;
+
+	while (!feof(reader->fp))
+	{
+		len = ldns_fget_token_l(reader->fp, reader->line, LDNS_PARSE_SKIP_SPACE, LDNS_MAX_LINELEN, &reader->line_nr);
+
+		if (len < 0)
+		{
+			if (feof(reader->fp))
+			{
+				break;
+			}
+
+			fprintf(stderr, "Failed to read zone data from %s at line %d\n", reader->name, reader->line_nr);
+
+			return 1;
+		}
+
+		if (len > 0)
+		{
+			*line = reader->line;
+
+			PROGRESS_RECORDS(1);
+
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* Parse a line read earlier; *rr is NULL if the line was a directive */
+int ldns_mergezone_reader_parse(zone_reader* reader, char* line, const int line_nr, ldns_rr** rr)
+{
+	assert(reader != NULL);
+	assert(line != NULL);
+	assert(rr != NULL);
+
+	ldns_status	status		= LDNS_STATUS_OK;
+	char*		b64		= NULL;
+	int		b64_field	= -1;
+	uint8_t*	b64_data	= NULL;
+	size_t		b64_len		= 0;
+
+	*rr = NULL;
+
+	if ((strncmp(line, "$ORIGIN", 7) == 0) && isspace((unsigned char) line[7]))
+	{
+		ldns_rdf*	origin	= ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, ldns_mergezone_reader_strip_ws(line + 8));
+
+		if (origin == NULL)
+		{
+			fprintf(stderr, "Invalid $ORIGIN in %s at line %d\n", reader->name, line_nr);
+
+			return 1;
+		}
+
+		ldns_rdf_deep_free(reader->origin);
+
+		reader->origin = origin;
+
+		return 0;
+	}
+
+	if ((strncmp(line, "$TTL", 4) == 0) && isspace((unsigned char) line[4]))
+	{
+		const char*	endptr	= NULL;
+
+		reader->default_ttl = ldns_str2period(ldns_mergezone_reader_strip_ws(line + 5), &endptr);
+
+		return 0;
+	}
+
+	if (strncmp(line, "$INCLUDE", 8) == 0)
+	{
+		fprintf(stderr, "$INCLUDE is not supported (%s, line %d)\n", reader->name, line_nr);
+
+		return 1;
+	}
+
+	if (*ldns_mergezone_reader_strip_ws(line) == '\0')
+	{
+		return 0;
+	}
+
+	if ((b64_field = ldns_mergezone_reader_find_b64(line, &b64)) >= 0)
+	{
+		b64_data = ldns_mergezone_reader_decode_b64(b64, &b64_len);
+	}
+
+	status = ldns_rr_new_frm_str(rr, line, reader->default_ttl, reader->origin, &reader->prev);
+
+	if (status != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to read zone data from %s at line %d (%s)\n", reader->name, line_nr, ldns_get_errorstr_by_id(status));
+
+		free(b64_data);
+
+		*rr = NULL;
+
+		return 1;
+	}
+
+	if (b64_data != NULL)
+	{
+		if ((ldns_rr_rd_count(*rr) != (size_t) (b64_field + 1)) || (ldns_rdf_get_type(ldns_rr_rdf(*rr, b64_field)) != LDNS_RDF_TYPE_B64))
+		{
+			fprintf(stderr, "Failed to read zone data from %s at line %d (unexpected base64 field)\n", reader->name, line_nr);
+
+			free(b64_data);
+			ldns_rr_free(*rr);
+
+			*rr = NULL;
+
+			return 1;
+		}
+
+		ldns_rdf_deep_free(ldns_rr_set_rdf(*rr, ldns_rdf_new(LDNS_RDF_TYPE_B64, b64_len, b64_data), b64_field));
+	}
+
+	/* Like ldns, take the origin from the SOA record if it was not set */
+	if ((reader->origin == NULL) && (ldns_rr_get_type(*rr) == LDNS_RR_TYPE_SOA))
+	{
+		reader->origin = ldns_rdf_clone(ldns_rr_owner(*rr));
+	}
+
+	return 0;
+}
+
+/* Read and parse the next record; *rr is NULL at the end of the file */
+int ldns_mergezone_reader_next_rr(zone_reader* reader, ldns_rr** rr)
+{
+	assert(reader != NULL);
+	assert(rr != NULL);
+
+	char*	line	= NULL;
+
+	*rr = NULL;
+
+	do
+	{
+		if (ldns_mergezone_reader_next_line(reader, &line) != 0)
+		{
+			return 1;
+		}
+
+		if (line == NULL)
+		{
+			/* End of file */
+			return 0;
+		}
+
+		if (ldns_mergezone_reader_parse(reader, line, reader->line_nr, rr) != 0)
+		{
+			return 1;
+		}
+	}
+	while (*rr == NULL);
+
+	return 0;
+}
+
+/* Clean up */
+void ldns_mergezone_reader_close(zone_reader* reader)
+{
+	assert(reader != NULL);
+
+	if (reader->fp != NULL)
+	{
+		fclose(reader->fp);
+	}
+
+	free(reader->line);
+
+	ldns_rdf_deep_free(reader->origin);
+	ldns_rdf_deep_free(reader->prev);
+
+	memset(reader, 0, sizeof(zone_reader));
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_READER_H
+#define _LDNS_MERGEZONE_READER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* Streaming zone file reader */
+typedef struct
+{
+	FILE*		fp;
+	const char*	name;
+	char*		line;
+	int		line_nr;
+	ldns_rdf*	origin;
+	ldns_rdf*	prev;
+	uint32_t	default_ttl;
+}
+zone_reader;
+
+/* Open a zone file for reading */
+int ldns_mergezone_reader_open(zone_reader* reader, const char* zone_file);
+
+/* Read the next line (a record or a directive) into an internal buffer; *line is NULL at the end of the file */
+int ldns_mergezone_reader_next_line(zone_reader* reader, char** line);
+
+/* Parse a line read earlier; *rr is NULL if the line was a directive */
+int ldns_mergezone_reader_parse(zone_reader* reader, char* line, const int line_nr, ldns_rr** rr);
+
+/* Read and parse the next record; *rr is NULL at the end of the file */
+int ldns_mergezone_reader_next_rr(zone_reader* reader, ldns_rr** rr);
+
+/* Clean up */
+void ldns_mergezone_reader_close(zone_reader* reader);
+
+#endif /* !_LDNS_MERGEZONE_READER_H */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "replace.h"
+
+/*
+ * Files that other processes may read at any time, such as the state and
+ * metrics files and the output zone with its ZONEMD record, are written to
+ * a temporary file next to them, which is flushed to disk and then renamed
+ * over the original. Readers therefore see either the old or the new file,
+ * and never a partly written one, even after a crash.
+ */
+
+/* Create a temporary file next to the file at path, to be written through rf->fp */
+int ldns_mergezone_replace_open(replace_file* rf, const char* path)
+{
+	assert(rf != NULL);
+	assert(path != NULL);
+
+	rf->path = path;
+	rf->tmp_path = (char*) malloc(strlen(path) + 8);
+	rf->fp = NULL;
+	rf->fd = -1;
+
+	assert(rf->tmp_path != NULL);
+
+	/* The temporary file must be on the same file system for the rename to be atomic */
+	sprintf(rf->tmp_path, "%s.XXXXXX", path);
+
+	if (((rf->fd = mkstemp(rf->tmp_path)) < 0) || ((rf->fp = fdopen(rf->fd, "w")) == NULL))
+	{
+		fprintf(stderr, "Failed to create temporary file for %s\n", path);
+
+		if (rf->fd >= 0)
+		{
+			close(rf->fd);
+			unlink(rf->tmp_path);
+		}
+
+		free(rf->tmp_path);
+
+		rf->tmp_path = NULL;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Finish writing, replacing the original file if rv is 0; returns 0 if the file was replaced */
+int ldns_mergezone_replace_close(replace_file* rf, const int rv)
+{
+	assert(rf != NULL);
+	assert(rf->fp != NULL);
+
+	int	failed	= rv;
+
+	if (!failed && ((fflush(rf->fp) != 0) || (fsync(rf->fd) != 0)))
+	{
+		failed = 1;
+	}
+
+	if ((fclose(rf->fp) != 0) || failed || (rename(rf->tmp_path, rf->path) != 0))
+	{
+		unlink(rf->tmp_path);
+
+		failed = 1;
+	}
+
+	free(rf->tmp_path);
+
+	rf->tmp_path = NULL;
+	rf->fp = NULL;
+	rf->fd = -1;
+
+	return failed;
+}
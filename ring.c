@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "ring.h"
+
+/*
+ * The producer only writes the tail and the consumer only writes the head,
+ * so neither side takes a lock while the ring is neither full nor empty.
+ * A side that has to wait announces this in a flag under the lock and then
+ * checks the ring again before sleeping; the other side checks the flag
+ * after publishing its index and only then takes the lock to wake it up.
+ */
+
+/* Initialise a ring that holds up to the specified number of items */
+int ldns_mergezone_ring_init(ring* r, const size_t size)
+{
+	assert(r != NULL);
+	assert(size > 0);
+
+	r->slots = (void**) calloc(size, sizeof(void*));
+	r->size = size;
+	r->head = 0;
+	r->tail = 0;
+	r->producer_waiting = 0;
+	r->consumer_waiting = 0;
+
+	if (r->slots == NULL)
+	{
+		return 1;
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->not_full, NULL);
+	pthread_cond_init(&r->not_empty, NULL);
+
+	return 0;
+}
+
+/* Add an item, blocks while the ring is full */
+void ldns_mergezone_ring_push(ring* r, void* item)
+{
+	assert(r != NULL);
+
+	size_t	tail	= r->tail;
+
+	if ((tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) == r->size)
+	{
+		pthread_mutex_lock(&r->lock);
+
+		__atomic_store_n(&r->producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+		while ((tail - __atomic_load_n(&r->head, __ATOMIC_SEQ_CST)) == r->size)
+		{
+			pthread_cond_wait(&r->not_full, &r->lock);
+		}
+
+		__atomic_store_n(&r->producer_waiting, 0, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	r->slots[tail % r->size] = item;
+
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&r->consumer_waiting, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_signal(&r->not_empty);
+		pthread_mutex_unlock(&r->lock);
+	}
+}
+
+/* Remove the oldest item, blocks while the ring is empty */
+void* ldns_mergezone_ring_pop(ring* r)
+{
+	assert(r != NULL);
+
+	size_t	head	= r->head;
+	void*	item	= NULL;
+
+	if (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head)
+	{
+		pthread_mutex_lock(&r->lock);
+
+		__atomic_store_n(&r->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+
+		while (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == head)
+		{
+			pthread_cond_wait(&r->not_empty, &r->lock);
+		}
+
+		__atomic_store_n(&r->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	item = r->slots[head % r->size];
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&r->producer_waiting, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_signal(&r->not_full);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	return item;
+}
+
+/* Check if the ring is empty; only meaningful when called by the consumer */
+int ldns_mergezone_ring_empty(ring* r)
+{
+	assert(r != NULL);
+
+	return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head;
+}
+
+/* Clean up */
+void ldns_mergezone_ring_free(ring* r)
+{
+	assert(r != NULL);
+
+	free(r->slots);
+
+	r->slots = NULL;
+
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->not_full);
+	pthread_cond_destroy(&r->not_empty);
+}
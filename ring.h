@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_RING_H
+#define _LDNS_MERGEZONE_RING_H
+
+#include <stdlib.h>
+#include <pthread.h>
+
+/* Bounded single-producer/single-consumer ring buffer of pointers */
+typedef struct
+{
+	void**		slots;
+	size_t		size;
+	size_t		head;
+	size_t		tail;
+	int		producer_waiting;
+	int		consumer_waiting;
+	pthread_mutex_t	lock;
+	pthread_cond_t	not_full;
+	pthread_cond_t	not_empty;
+}
+ring;
+
+/* Initialise a ring that holds up to the specified number of items */
+int ldns_mergezone_ring_init(ring* r, const size_t size);
+
+/* Add an item, blocks while the ring is full */
+void ldns_mergezone_ring_push(ring* r, void* item);
+
+/* Remove the oldest item, blocks while the ring is empty */
+void* ldns_mergezone_ring_pop(ring* r);
+
+/* Check if the ring is empty; only meaningful when called by the consumer */
+int ldns_mergezone_ring_empty(ring* r);
+
+/* Clean up */
+void ldns_mergezone_ring_free(ring* r);
+
+#endif /* !_LDNS_MERGEZONE_RING_H */
@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "sigcols.h"
+#include "dnssec_ht.h"
+#include "verbose.h"
+#include "metrics.h"
+#include "trace.h"
+
+/*
+ * The RRSIG metadata of a zone (type covered, algorithm, labels, TTL,
+ * original TTL, expiration, inception and key tag) is kept as separate
+ * columns, so checking a field of millions of signatures is a scan over
+ * one contiguous array. Expiration and inception are compared with the
+ * current time using serial number arithmetic (RFC 4034, section 3.1.5),
+ * which is just a wrapping subtraction. The scan only counts the
+ * failures; the vector code paths are selected at compile time like in
+ * dname.c. Failures are rare, so only when the counts are not all zero
+ * are the rows looked at one by one to report them.
+ *
+ * Signatures of the "to" zones are taken from the index when it is
+ * complete. The "from" zone is streamed, so its signatures are collected
+ * and checked in blocks, keeping the memory use of the merge bounded.
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Size of the fixed part of the RRSIG RDATA, up to the signer's name */
+#define SIGCOLS_RDATA_FIXED	18
+
+/* Size of the type, class, TTL and RDATA length that follow the owner */
+#define SIGCOLS_RR_FIXED	10
+
+/* Settings and results of the signature checks of this run */
+static int	sigcols_enabled		= 0;
+static uint32_t	sigcols_now		= 0;
+static int32_t	sigcols_window		= 0;
+static int	sigcols_checked		= 0;
+static int32_t	sigcols_min_remaining	= 0;
+static size_t	sigcols_expiring	= 0;
+static size_t	sigcols_not_yet_valid	= 0;
+static size_t	sigcols_ttl_mismatch	= 0;
+
+/* Enable checking the signatures of the input zones, which must remain valid for at least the specified number of days; disabled if days is negative */
+void ldns_mergezone_sigcols_set_check(const int days)
+{
+	assert(days <= SIGCOLS_MAX_DAYS);
+
+	sigcols_enabled = (days >= 0);
+	sigcols_now = (uint32_t) time(NULL);
+	sigcols_window = sigcols_enabled ? days * 86400 : 0;
+	sigcols_checked = 0;
+	sigcols_min_remaining = INT32_MAX;
+	sigcols_expiring = 0;
+	sigcols_not_yet_valid = 0;
+	sigcols_ttl_mismatch = 0;
+}
+
+/* Check if the signatures of the input zones are to be checked */
+int ldns_mergezone_sigcols_check_enabled(void)
+{
+	return sigcols_enabled;
+}
+
+/* Get the time until which the signatures checked so far pass the checks; returns 1 if nothing was checked */
+int ldns_mergezone_sigcols_valid_until(uint32_t* until)
+{
+	assert(until != NULL);
+
+	if (!sigcols_enabled || !sigcols_checked)
+	{
+		return 1;
+	}
+
+	*until = sigcols_now + (uint32_t) sigcols_min_remaining - (uint32_t) sigcols_window;
+
+	return 0;
+}
+
+/* Initialise empty columns */
+void ldns_mergezone_sigcols_init(sig_columns* cols)
+{
+	assert(cols != NULL);
+
+	memset(cols, 0, sizeof(sig_columns));
+}
+
+/* Make room for at least one more row and owner_len more bytes of owner names */
+static void ldns_mergezone_sigcols_grow(sig_columns* cols, const size_t owner_len)
+{
+	if (cols->count == cols->alloc)
+	{
+		cols->alloc = (cols->alloc == 0) ? 1024 : cols->alloc * 2;
+
+		cols->type_covered = (uint16_t*) realloc(cols->type_covered, cols->alloc * sizeof(uint16_t));
+		cols->algorithm = (uint8_t*) realloc(cols->algorithm, cols->alloc * sizeof(uint8_t));
+		cols->labels = (uint8_t*) realloc(cols->labels, cols->alloc * sizeof(uint8_t));
+		cols->ttl = (uint32_t*) realloc(cols->ttl, cols->alloc * sizeof(uint32_t));
+		cols->orig_ttl = (uint32_t*) realloc(cols->orig_ttl, cols->alloc * sizeof(uint32_t));
+		cols->expiration = (uint32_t*) realloc(cols->expiration, cols->alloc * sizeof(uint32_t));
+		cols->inception = (uint32_t*) realloc(cols->inception, cols->alloc * sizeof(uint32_t));
+		cols->key_tag = (uint16_t*) realloc(cols->key_tag, cols->alloc * sizeof(uint16_t));
+		cols->owner_off = (size_t*) realloc(cols->owner_off, cols->alloc * sizeof(size_t));
+
+		assert((cols->type_covered != NULL) && (cols->algorithm != NULL) && (cols->labels != NULL) &&
+		       (cols->ttl != NULL) && (cols->orig_ttl != NULL) && (cols->expiration != NULL) &&
+		       (cols->inception != NULL) && (cols->key_tag != NULL) && (cols->owner_off != NULL));
+	}
+
+	while (cols->owners_size + owner_len > cols->owners_alloc)
+	{
+		cols->owners_alloc = (cols->owners_alloc == 0) ? 65536 : cols->owners_alloc * 2;
+		cols->owners = (uint8_t*) realloc(cols->owners, cols->owners_alloc);
+
+		assert(cols->owners != NULL);
+	}
+}
+
+/* Add a row from the owner name, TTL and fixed part of the RDATA of an RRSIG in wire format */
+static void ldns_mergezone_sigcols_add_row(sig_columns* cols, const uint8_t* owner, const size_t owner_len, const uint32_t ttl, const uint8_t* rdata)
+{
+	size_t	row	= cols->count;
+
+	ldns_mergezone_sigcols_grow(cols, owner_len);
+
+	cols->type_covered[row] = ldns_read_uint16(rdata);
+	cols->algorithm[row] = rdata[2];
+	cols->labels[row] = rdata[3];
+	cols->ttl[row] = ttl;
+	cols->orig_ttl[row] = ldns_read_uint32(rdata + 4);
+	cols->expiration[row] = ldns_read_uint32(rdata + 8);
+	cols->inception[row] = ldns_read_uint32(rdata + 12);
+	cols->key_tag[row] = ldns_read_uint16(rdata + 16);
+	cols->owner_off[row] = cols->owners_size;
+
+	memcpy(cols->owners + cols->owners_size, owner, owner_len);
+
+	cols->owners_size += owner_len;
+	cols->count++;
+}
+
+/* Add the metadata of an RRSIG record */
+int ldns_mergezone_sigcols_add_rr(sig_columns* cols, const ldns_rr* rrsig)
+{
+	assert(cols != NULL);
+	assert(rrsig != NULL);
+	assert(ldns_rr_get_type(rrsig) == LDNS_RR_TYPE_RRSIG);
+
+	uint8_t		rdata[SIGCOLS_RDATA_FIXED];
+	ldns_rdf*	owner	= ldns_rr_owner(rrsig);
+
+	if (ldns_rr_rd_count(rrsig) != 9)
+	{
+		return 1;
+	}
+
+	/* Put the fields in wire format, so records are added the same way as those in an index */
+	ldns_write_uint16(rdata, ldns_rdf2native_int16(ldns_rr_rdf(rrsig, 0)));
+	rdata[2] = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 1));
+	rdata[3] = ldns_rdf2native_int8(ldns_rr_rdf(rrsig, 2));
+	ldns_write_uint32(rdata + 4, ldns_rdf2native_int32(ldns_rr_rdf(rrsig, 3)));
+	ldns_write_uint32(rdata + 8, ldns_rdf2native_int32(ldns_rr_rdf(rrsig, 4)));
+	ldns_write_uint32(rdata + 12, ldns_rdf2native_int32(ldns_rr_rdf(rrsig, 5)));
+	ldns_write_uint16(rdata + 16, ldns_rdf2native_int16(ldns_rr_rdf(rrsig, 6)));
+
+	ldns_mergezone_sigcols_add_row(cols, ldns_rdf_data(owner), ldns_rdf_size(owner), ldns_rr_ttl(rrsig), rdata);
+
+	return 0;
+}
+
+/* Add the metadata of all RRSIGs in an index, in zone order */
+int ldns_mergezone_sigcols_add_ht(sig_columns* cols, dnssec_ht* ht)
+{
+	assert(cols != NULL);
+	assert(ht != NULL);
+
+	ldns_rr_list*	dnskey_rrsigs	= ldns_mergezone_get_dnskey_rrsigs(ht);
+	size_t		i		= 0;
+
+	for (i = 0; i < ldns_rr_list_rr_count(dnskey_rrsigs); i++)
+	{
+		if (ldns_mergezone_sigcols_add_rr(cols, ldns_rr_list_rr(dnskey_rrsigs, i)) != 0)
+		{
+			return 1;
+		}
+	}
+
+	/* Indexed RRSIGs are in wire format in the arena, starting with the owner name */
+	for (i = 0; i < ht->rrsig_count; i++)
+	{
+		const rrsig_ht_ent*	ent		= &ht->rrsig_ents[i];
+		const uint8_t*		wire		= ent->type_and_owner.owner;
+		size_t			owner_len	= ent->type_and_owner.owner_len;
+
+		if (ent->wire_len < owner_len + SIGCOLS_RR_FIXED + SIGCOLS_RDATA_FIXED)
+		{
+			return 1;
+		}
+
+		ldns_mergezone_sigcols_add_row(cols, wire, owner_len, ldns_read_uint32(wire + owner_len + 4), wire + owner_len + SIGCOLS_RR_FIXED);
+	}
+
+	return 0;
+}
+
+/* Remove all rows, keeping the memory for reuse */
+void ldns_mergezone_sigcols_clear(sig_columns* cols)
+{
+	assert(cols != NULL);
+
+	cols->count = 0;
+	cols->owners_size = 0;
+}
+
+/* Clean up */
+void ldns_mergezone_sigcols_free(sig_columns* cols)
+{
+	assert(cols != NULL);
+
+	free(cols->type_covered);
+	free(cols->algorithm);
+	free(cols->labels);
+	free(cols->ttl);
+	free(cols->orig_ttl);
+	free(cols->expiration);
+	free(cols->inception);
+	free(cols->key_tag);
+	free(cols->owner_off);
+	free(cols->owners);
+
+	memset(cols, 0, sizeof(sig_columns));
+}
+
+/* Start checking the signatures of a zone */
+void ldns_mergezone_sigcols_check_init(sig_check* check, const char* zone_name)
+{
+	assert(check != NULL);
+	assert(zone_name != NULL);
+
+	memset(check, 0, sizeof(sig_check));
+
+	check->zone_name = zone_name;
+	check->min_remaining = INT32_MAX;
+}
+
+#if defined(__AVX2__)
+/* Add the lanes of a vector of counts */
+static inline size_t ldns_mergezone_sigcols_sum256(const __m256i v)
+{
+	uint32_t	lanes[8];
+	size_t		sum	= 0;
+	int		i	= 0;
+
+	_mm256_storeu_si256((__m256i*) lanes, v);
+
+	for (i = 0; i < 8; i++)
+	{
+		sum += lanes[i];
+	}
+
+	return sum;
+}
+#endif
+
+#if defined(__SSE2__)
+/* Add the lanes of a vector of counts */
+static inline size_t ldns_mergezone_sigcols_sum128(const __m128i v)
+{
+	uint32_t	lanes[4];
+
+	_mm_storeu_si128((__m128i*) lanes, v);
+
+	return (size_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/* Lowest of the lanes of a vector of signed values */
+static inline int32_t ldns_mergezone_sigcols_min128(const __m128i v)
+{
+	int32_t	lanes[4];
+	int32_t	min	= INT32_MAX;
+	int	i	= 0;
+
+	_mm_storeu_si128((__m128i*) lanes, v);
+
+	for (i = 0; i < 4; i++)
+	{
+		min = (lanes[i] < min) ? lanes[i] : min;
+	}
+
+	return min;
+}
+#endif
+
+/* Count the signatures failing each check and failing any check, and find the lowest remaining validity */
+static void ldns_mergezone_sigcols_scan(const sig_columns* cols, size_t* expiring, size_t* not_yet_valid, size_t* ttl_mismatch, size_t* failed, int32_t* min_remaining)
+{
+	size_t	i		= 0;
+	size_t	ttl_equal	= 0;
+	size_t	passed		= 0;
+	int32_t	remaining	= 0;
+	int32_t	min		= INT32_MAX;
+
+	*expiring = 0;
+	*not_yet_valid = 0;
+
+	/* Comparisons set a lane to all ones, so subtracting them counts */
+#if defined(__AVX2__)
+	{
+		const __m256i	now		= _mm256_set1_epi32((int32_t) sigcols_now);
+		const __m256i	window		= _mm256_set1_epi32(sigcols_window);
+		const __m256i	zero		= _mm256_setzero_si256();
+		__m256i		n_expiring	= zero;
+		__m256i		n_future	= zero;
+		__m256i		n_ttl_equal	= zero;
+		__m256i		n_passed	= zero;
+		__m256i		v_min		= _mm256_set1_epi32(INT32_MAX);
+		int32_t		lanes[8];
+		int		j		= 0;
+
+		for (; i + 8 <= cols->count; i += 8)
+		{
+			__m256i	left	= _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*) (cols->expiration + i)), now);
+			__m256i	since	= _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*) (cols->inception + i)), now);
+			__m256i	ttl	= _mm256_loadu_si256((const __m256i*) (cols->ttl + i));
+			__m256i	orig	= _mm256_loadu_si256((const __m256i*) (cols->orig_ttl + i));
+
+			__m256i	expires	= _mm256_cmpgt_epi32(window, left);
+			__m256i	future	= _mm256_cmpgt_epi32(since, zero);
+			__m256i	equal	= _mm256_cmpeq_epi32(ttl, orig);
+
+			n_expiring = _mm256_sub_epi32(n_expiring, expires);
+			n_future = _mm256_sub_epi32(n_future, future);
+			n_ttl_equal = _mm256_sub_epi32(n_ttl_equal, equal);
+			n_passed = _mm256_sub_epi32(n_passed, _mm256_andnot_si256(_mm256_or_si256(expires, future), equal));
+			v_min = _mm256_min_epi32(v_min, left);
+		}
+
+		*expiring += ldns_mergezone_sigcols_sum256(n_expiring);
+		*not_yet_valid += ldns_mergezone_sigcols_sum256(n_future);
+		ttl_equal += ldns_mergezone_sigcols_sum256(n_ttl_equal);
+		passed += ldns_mergezone_sigcols_sum256(n_passed);
+
+		_mm256_storeu_si256((__m256i*) lanes, v_min);
+
+		for (j = 0; j < 8; j++)
+		{
+			min = (lanes[j] < min) ? lanes[j] : min;
+		}
+	}
+#endif
+
+#if defined(__SSE2__)
+	{
+		const __m128i	now		= _mm_set1_epi32((int32_t) sigcols_now);
+		const __m128i	window		= _mm_set1_epi32(sigcols_window);
+		const __m128i	zero		= _mm_setzero_si128();
+		__m128i		n_expiring	= zero;
+		__m128i		n_future	= zero;
+		__m128i		n_ttl_equal	= zero;
+		__m128i		n_passed	= zero;
+		__m128i		v_min		= _mm_set1_epi32(INT32_MAX);
+
+		for (; i + 4 <= cols->count; i += 4)
+		{
+			__m128i	left	= _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (cols->expiration + i)), now);
+			__m128i	since	= _mm_sub_epi32(_mm_loadu_si128((const __m128i*) (cols->inception + i)), now);
+			__m128i	ttl	= _mm_loadu_si128((const __m128i*) (cols->ttl + i));
+			__m128i	orig	= _mm_loadu_si128((const __m128i*) (cols->orig_ttl + i));
+			__m128i	lower	= _mm_cmplt_epi32(left, v_min);
+
+			__m128i	expires	= _mm_cmplt_epi32(left, window);
+			__m128i	future	= _mm_cmpgt_epi32(since, zero);
+			__m128i	equal	= _mm_cmpeq_epi32(ttl, orig);
+
+			n_expiring = _mm_sub_epi32(n_expiring, expires);
+			n_future = _mm_sub_epi32(n_future, future);
+			n_ttl_equal = _mm_sub_epi32(n_ttl_equal, equal);
+			n_passed = _mm_sub_epi32(n_passed, _mm_andnot_si128(_mm_or_si128(expires, future), equal));
+
+			/* SSE2 has no signed minimum, so select the lower lanes */
+			v_min = _mm_or_si128(_mm_and_si128(lower, left), _mm_andnot_si128(lower, v_min));
+		}
+
+		*expiring += ldns_mergezone_sigcols_sum128(n_expiring);
+		*not_yet_valid += ldns_mergezone_sigcols_sum128(n_future);
+		ttl_equal += ldns_mergezone_sigcols_sum128(n_ttl_equal);
+		passed += ldns_mergezone_sigcols_sum128(n_passed);
+
+		remaining = ldns_mergezone_sigcols_min128(v_min);
+		min = (remaining < min) ? remaining : min;
+	}
+#endif
+
+	for (; i < cols->count; i++)
+	{
+		remaining = (int32_t) (cols->expiration[i] - sigcols_now);
+
+		int	expires	= (remaining < sigcols_window);
+		int	future	= ((int32_t) (cols->inception[i] - sigcols_now) > 0);
+		int	equal	= (cols->ttl[i] == cols->orig_ttl[i]);
+
+		*expiring += expires;
+		*not_yet_valid += future;
+		ttl_equal += equal;
+		passed += (!expires && !future && equal);
+		min = (remaining < min) ? remaining : min;
+	}
+
+	*ttl_mismatch = cols->count - ttl_equal;
+	*failed = cols->count - passed;
+	*min_remaining = min;
+}
+
+/* Report a signature that failed a check */
+static void ldns_mergezone_sigcols_report(const sig_columns* cols, const size_t row, const char* zone_name, const char* problem)
+{
+	const uint8_t*	owner		= cols->owners + cols->owner_off[row];
+	size_t		owner_len	= ((row + 1 < cols->count) ? cols->owner_off[row + 1] : cols->owners_size) - cols->owner_off[row];
+	ldns_rdf*	owner_rdf	= ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME, owner_len, owner);
+	char*		owner_name	= (owner_rdf != NULL) ? ldns_rdf2str(owner_rdf) : NULL;
+
+	fprintf(stderr, "%s: RRSIG for %u_%s (algorithm %u, key tag %u) %s\n", zone_name, cols->type_covered[row], (owner_name != NULL) ? owner_name : "?", cols->algorithm[row], cols->key_tag[row], problem);
+
+	free(owner_name);
+	ldns_rdf_deep_free(owner_rdf);
+}
+
+/* Check the signatures in the columns, reporting the first failures on stderr */
+void ldns_mergezone_sigcols_check(const sig_columns* cols, sig_check* check)
+{
+	assert(cols != NULL);
+	assert(check != NULL);
+
+	size_t		expiring	= 0;
+	size_t		not_yet_valid	= 0;
+	size_t		ttl_mismatch	= 0;
+	size_t		failed		= 0;
+	int32_t		min_remaining	= 0;
+	int32_t		remaining	= 0;
+	size_t		i		= 0;
+	char		problem[128];
+	uint64_t	start		= 0;
+
+	TRACE_BEGIN(start);
+
+	ldns_mergezone_sigcols_scan(cols, &expiring, &not_yet_valid, &ttl_mismatch, &failed, &min_remaining);
+
+	check->checked += cols->count;
+	check->expiring += expiring;
+	check->not_yet_valid += not_yet_valid;
+	check->ttl_mismatch += ttl_mismatch;
+	check->failed += failed;
+
+	if ((cols->count > 0) && (min_remaining < check->min_remaining))
+	{
+		check->min_remaining = min_remaining;
+	}
+
+	/* Only look at the failing rows themselves if there are any */
+	for (i = 0; (i < cols->count) && (failed > 0) && (check->reported < SIGCOLS_MAX_REPORTS); i++)
+	{
+		remaining = (int32_t) (cols->expiration[i] - sigcols_now);
+
+		if (remaining < 0)
+		{
+			snprintf(problem, sizeof(problem), "expired %.1f days ago", -remaining / 86400.0);
+		}
+		else if (remaining < sigcols_window)
+		{
+			snprintf(problem, sizeof(problem), "expires in %.1f days", remaining / 86400.0);
+		}
+		else if ((int32_t) (cols->inception[i] - sigcols_now) > 0)
+		{
+			snprintf(problem, sizeof(problem), "is not valid until %.1f days from now", (int32_t) (cols->inception[i] - sigcols_now) / 86400.0);
+		}
+		else if (cols->ttl[i] != cols->orig_ttl[i])
+		{
+			snprintf(problem, sizeof(problem), "has TTL %u but original TTL %u", cols->ttl[i], cols->orig_ttl[i]);
+		}
+		else
+		{
+			continue;
+		}
+
+		ldns_mergezone_sigcols_report(cols, i, check->zone_name, problem);
+
+		check->reported++;
+	}
+
+	TRACE_END(start, "sigcheck", "check signature columns");
+}
+
+/* Finish checking the signatures of a zone; returns 1 if any signature failed a check */
+int ldns_mergezone_sigcols_check_finish(const sig_check* check)
+{
+	assert(check != NULL);
+
+	if (check->checked > 0)
+	{
+		sigcols_checked = 1;
+
+		if (check->min_remaining < sigcols_min_remaining)
+		{
+			sigcols_min_remaining = check->min_remaining;
+		}
+	}
+
+	sigcols_expiring += check->expiring;
+	sigcols_not_yet_valid += check->not_yet_valid;
+	sigcols_ttl_mismatch += check->ttl_mismatch;
+
+	ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "sig_expiry", sigcols_expiring);
+	ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "sig_inception", sigcols_not_yet_valid);
+	ldns_mergezone_metrics_set(METRIC_VALIDATION_FAILURES, "check", "sig_ttl", sigcols_ttl_mismatch);
+
+	if (check->failed == 0)
+	{
+		VERBOSE("%s: all %zd signatures pass the validity checks\n", check->zone_name, check->checked);
+
+		return 0;
+	}
+
+	/* A signature can fail more than one check, but is reported once */
+	if (check->failed > check->reported)
+	{
+		fprintf(stderr, "%s: ... not reporting the remaining failures\n", check->zone_name);
+	}
+
+	fprintf(stderr, "%s: of %zd signatures, %zd expire within %d days, %zd are not valid yet and %zd have a TTL other than their original TTL\n",
+	        check->zone_name, check->checked, check->expiring, sigcols_window / 86400, check->not_yet_valid, check->ttl_mismatch);
+
+	return 1;
+}
+
+/* Check all signatures in an index */
+int ldns_mergezone_sigcols_check_ht(dnssec_ht* ht, const char* zone_name)
+{
+	assert(ht != NULL);
+	assert(zone_name != NULL);
+
+	sig_columns	cols;
+	sig_check	check;
+	int		rv	= 0;
+
+	ldns_mergezone_sigcols_init(&cols);
+	ldns_mergezone_sigcols_check_init(&check, zone_name);
+
+	if (ldns_mergezone_sigcols_add_ht(&cols, ht) != 0)
+	{
+		fprintf(stderr, "%s: malformed RRSIG record in the index\n", zone_name);
+
+		ldns_mergezone_sigcols_free(&cols);
+
+		return 1;
+	}
+
+	VERBOSE("Checking the validity of %zd signatures in %s\n", cols.count, zone_name);
+
+	ldns_mergezone_sigcols_check(&cols, &check);
+
+	rv = ldns_mergezone_sigcols_check_finish(&check);
+
+	ldns_mergezone_sigcols_free(&cols);
+
+	return rv;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_SIGCOLS_H
+#define _LDNS_MERGEZONE_SIGCOLS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include "dnssec_ht.h"
+
+/* Number of signatures of a streamed zone that are collected before they are checked */
+#define SIGCOLS_BLOCK		65536
+
+/* Maximum number of failing signatures reported per zone */
+#define SIGCOLS_MAX_REPORTS	10
+
+/* Maximum number of days a signature must remain valid for */
+#define SIGCOLS_MAX_DAYS	24855
+
+/* RRSIG metadata, one column per field and one row per signature */
+typedef struct
+{
+	size_t		count;
+	size_t		alloc;
+	uint16_t*	type_covered;
+	uint8_t*	algorithm;
+	uint8_t*	labels;
+	uint32_t*	ttl;
+	uint32_t*	orig_ttl;
+	uint32_t*	expiration;
+	uint32_t*	inception;
+	uint16_t*	key_tag;
+	size_t*		owner_off;
+	uint8_t*	owners;
+	size_t		owners_size;
+	size_t		owners_alloc;
+}
+sig_columns;
+
+/* Results of checking the signatures of a zone */
+typedef struct
+{
+	const char*	zone_name;
+	size_t		checked;
+	size_t		expiring;
+	size_t		not_yet_valid;
+	size_t		ttl_mismatch;
+	size_t		failed;
+	size_t		reported;
+	int32_t		min_remaining;
+}
+sig_check;
+
+/* Enable checking the signatures of the input zones, which must remain valid for at least the specified number of days; disabled if days is negative */
+void ldns_mergezone_sigcols_set_check(const int days);
+
+/* Check if the signatures of the input zones are to be checked */
+int ldns_mergezone_sigcols_check_enabled(void);
+
+/* Get the time until which the signatures checked so far pass the checks; returns 1 if nothing was checked */
+int ldns_mergezone_sigcols_valid_until(uint32_t* until);
+
+/* Initialise empty columns */
+void ldns_mergezone_sigcols_init(sig_columns* cols);
+
+/* Add the metadata of an RRSIG record */
+int ldns_mergezone_sigcols_add_rr(sig_columns* cols, const ldns_rr* rrsig);
+
+/* Add the metadata of all RRSIGs in an index, in zone order */
+int ldns_mergezone_sigcols_add_ht(sig_columns* cols, dnssec_ht* ht);
+
+/* Remove all rows, keeping the memory for reuse */
+void ldns_mergezone_sigcols_clear(sig_columns* cols);
+
+/* Clean up */
+void ldns_mergezone_sigcols_free(sig_columns* cols);
+
+/* Start checking the signatures of a zone */
+void ldns_mergezone_sigcols_check_init(sig_check* check, const char* zone_name);
+
+/* Check the signatures in the columns, reporting the first failures on stderr */
+void ldns_mergezone_sigcols_check(const sig_columns* cols, sig_check* check);
+
+/* Finish checking the signatures of a zone; returns 1 if any signature failed a check */
+int ldns_mergezone_sigcols_check_finish(const sig_check* check);
+
+/* Check all signatures in an index */
+int ldns_mergezone_sigcols_check_ht(dnssec_ht* ht, const char* zone_name);
+
+#endif /* !_LDNS_MERGEZONE_SIGCOLS_H */
@@ -0,0 +1,1318 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ldns/ldns.h>
+#include <assert.h>
+#include "sort.h"
+#include "format.h"
+#include "reader.h"
+#include "dname.h"
+#include "threads.h"
+#include "verbose.h"
+#include "progress.h"
+#include "trace.h"
+
+/*
+ * Records are kept in uncompressed wire format, prefixed with their
+ * length, both in memory and in the temporary run files. Records are
+ * collected in memory until the memory limit is reached; the run is then
+ * sorted and, unless it is the only one, written to a temporary file.
+ * The runs are finally merged into the output using a binary heap. If
+ * there are too many runs to keep open at once, groups of runs are first
+ * merged into longer runs.
+ *
+ * Runs are sorted with an MSD radix sort on a fixed-width key that is
+ * computed once per record: the owner name with its labels in reverse
+ * order and in lower case, each label followed by a zero byte and every
+ * other byte incremented by one so that the key sorts the same way the
+ * names do. Only a window of the key is kept at a time; a window that
+ * is the same for all records is skipped, and the next window is
+ * computed when a bucket still holds many records after the last byte of
+ * a window (e.g. for names with a long common suffix). Small buckets are
+ * sorted with the full record comparison. The first level is split over
+ * worker threads, after which whole buckets are handed out to them.
+ *
+ * Names in the RDATA are compared as they are, without converting them
+ * to lower case first. This only makes a difference for records of the
+ * same RRset that differ only in the case of a name in their RDATA.
+ */
+
+/* Smallest memory limit that is accepted */
+#define SORT_MIN_MEM_LIMIT	((size_t) 1024 * 1024)
+
+/* Maximum number of runs that are merged at once */
+#define SORT_MAX_FANIN		128
+
+/* Buckets with fewer records than this are sorted by comparing records */
+#define SORT_RADIX_CUTOFF	32
+
+/* Keys are never longer than a name in wire format */
+#define SORT_MAX_KEY_LEN	256
+
+/* Do not bother starting a thread for fewer records than this */
+#define SORT_MIN_RECS_PER_THREAD	16384
+
+/* Maximum size of a record in wire format */
+#define SORT_MAX_REC_LEN	(LDNS_MAX_DOMAINLEN + 10 + 65535)
+
+/* Buffer size for temporary files, this is used for each run that is merged */
+#define SORT_IO_BUF		(256 * 1024)
+
+/* Size at which formatted output is written to the output file */
+#define SORT_OUT_CHUNK		(256 * 1024)
+
+/* Records collected in memory */
+typedef struct
+{
+	uint8_t*	arena;
+	size_t		arena_size;
+	size_t		arena_alloc;
+	size_t		count;
+	size_t		mem_limit;
+}
+sort_run;
+
+/* Run being merged */
+typedef struct
+{
+	FILE*		fp;
+	uint8_t*	wire;
+	uint32_t	len;
+}
+sort_run_reader;
+
+/* Receives records in sorted order */
+typedef int (*sort_emit)(void* arg, const uint8_t* wire, const uint32_t len);
+
+/* State for a thread sorting part of the records */
+typedef struct
+{
+	sort_rec*	recs;
+	sort_rec*	tmp;
+	size_t		first;
+	size_t		last;
+	size_t		key_offset;
+	size_t		depth;
+	size_t		counts[256];
+	uint8_t		min_key[SORT_KEY_LEN];
+	uint8_t		max_key[SORT_KEY_LEN];
+	const size_t*	bucket_first;
+	size_t*		next_bucket;
+	int		prev;
+	int		started;
+	pthread_t	thread;
+}
+sort_worker;
+
+/* Output state */
+typedef struct
+{
+	FILE*		out_fp;
+	ldns_buffer*	text;
+	size_t		count;
+}
+sort_output;
+
+/* Determine the length of the owner name of a wire-format record */
+static size_t ldns_mergezone_sort_owner_len(const uint8_t* wire, const size_t len)
+{
+	size_t	pos	= 0;
+
+	while ((pos < len) && (wire[pos] != 0))
+	{
+		pos += wire[pos] + 1;
+	}
+
+	return (pos < len) ? pos + 1 : len;
+}
+
+/* Compare two wire-format records in canonical order */
+int ldns_mergezone_sort_rec_compare(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len)
+{
+	size_t		left_owner_len	= ldns_mergezone_sort_owner_len(left, left_len);
+	size_t		right_owner_len	= ldns_mergezone_sort_owner_len(right, right_len);
+	size_t		left_rdata_len	= 0;
+	size_t		right_rdata_len	= 0;
+	int		rv		= 0;
+
+	if ((rv = ldns_mergezone_dname_compare(left, left_owner_len, right, right_owner_len)) != 0)
+	{
+		return rv;
+	}
+
+	if ((left_len < left_owner_len + 10) || (right_len < right_owner_len + 10))
+	{
+		return (left_len < right_len) ? -1 : (left_len > right_len);
+	}
+
+	/* Class, then type */
+	if ((rv = memcmp(left + left_owner_len + 2, right + right_owner_len + 2, 2)) != 0)
+	{
+		return rv;
+	}
+
+	if ((rv = memcmp(left + left_owner_len, right + right_owner_len, 2)) != 0)
+	{
+		return rv;
+	}
+
+	/* RDATA, skipping the TTL and the RDATA length */
+	left_rdata_len = left_len - left_owner_len - 10;
+	right_rdata_len = right_len - right_owner_len - 10;
+
+	if ((rv = memcmp(left + left_owner_len + 10, right + right_owner_len + 10, (left_rdata_len < right_rdata_len) ? left_rdata_len : right_rdata_len)) != 0)
+	{
+		return rv;
+	}
+
+	return (left_rdata_len < right_rdata_len) ? -1 : (left_rdata_len > right_rdata_len);
+}
+
+static int ldns_mergezone_sort_qsort_compare(const void* a, const void* b)
+{
+	const sort_rec*	left	= (const sort_rec*) a;
+	const sort_rec*	right	= (const sort_rec*) b;
+	int		rv	= ldns_mergezone_sort_rec_compare(left->wire, left->len, right->wire, right->len);
+
+	/* Keep records that compare equal in input order */
+	if (rv == 0)
+	{
+		rv = (left->wire < right->wire) ? -1 : (left->wire > right->wire);
+	}
+
+	return rv;
+}
+
+/* Compute the window of the sort key that starts at the specified offset */
+static void ldns_mergezone_sort_make_key(sort_rec* rec, const size_t key_offset)
+{
+	size_t		labels[128];
+	size_t		label_count	= 0;
+	size_t		pos		= 0;
+	size_t		out		= 0;
+	size_t		l		= 0;
+	size_t		j		= 0;
+
+	memset(rec->key, 0, SORT_KEY_LEN);
+
+	while ((pos < rec->len) && (rec->wire[pos] != 0) && (label_count < 128))
+	{
+		labels[label_count++] = pos;
+
+		pos += rec->wire[pos] + 1;
+	}
+
+	for (l = label_count; l > 0; l--)
+	{
+		const uint8_t*	label		= &rec->wire[labels[l - 1]];
+		size_t		label_len	= label[0];
+
+		if (labels[l - 1] + label_len >= rec->len)
+		{
+			return;
+		}
+
+		/* Skip labels before the window */
+		if (out + label_len + 1 <= key_offset)
+		{
+			out += label_len + 1;
+
+			continue;
+		}
+
+		for (j = 1; j <= label_len + 1; j++)
+		{
+			uint8_t	b	= 0;
+			int	stop	= 0;
+
+			if (j <= label_len)
+			{
+				uint8_t	c	= label[j];
+
+				if ((c >= 'A') && (c <= 'Z'))
+				{
+					c += 'a' - 'A';
+				}
+
+				/* Bytes that cannot be incremented end the key, records with the same key are compared in full */
+				stop = (c >= 0xfe);
+				b = stop ? 0xff : c + 1;
+			}
+
+			if (out >= key_offset)
+			{
+				rec->key[out - key_offset] = b;
+			}
+
+			if (stop || (++out == key_offset + SORT_KEY_LEN))
+			{
+				return;
+			}
+		}
+	}
+}
+
+/* Compare records on the current window of their keys first, then in full */
+static int ldns_mergezone_sort_key_compare(const void* a, const void* b)
+{
+	int	rv	= memcmp(((const sort_rec*) a)->key, ((const sort_rec*) b)->key, SORT_KEY_LEN);
+
+	return (rv != 0) ? rv : ldns_mergezone_sort_qsort_compare(a, b);
+}
+
+/* Sort a few records, all with keys in the same window */
+static void ldns_mergezone_sort_small(sort_rec* recs, const size_t count)
+{
+	size_t	i	= 0;
+	size_t	j	= 0;
+
+	if (count > SORT_RADIX_CUTOFF)
+	{
+		qsort(recs, count, sizeof(sort_rec), ldns_mergezone_sort_key_compare);
+
+		return;
+	}
+
+	for (i = 1; i < count; i++)
+	{
+		sort_rec	rec	= recs[i];
+
+		for (j = i; (j > 0) && (ldns_mergezone_sort_key_compare(&recs[j - 1], &rec) > 0); j--)
+		{
+			recs[j] = recs[j - 1];
+		}
+
+		recs[j] = rec;
+	}
+}
+
+/*
+ * Sort records on the key from the specified depth, using tmp as scratch
+ * space. All records have the same key before this depth; prev is the
+ * last byte of that shared part, or 1 if it is not known.
+ */
+static void ldns_mergezone_sort_radix(sort_rec* recs, sort_rec* tmp, const size_t count, size_t depth, size_t key_offset, int prev)
+{
+	size_t	counts[256];
+	size_t	first[256];
+	size_t	i	= 0;
+	size_t	b	= 0;
+
+	for (;;)
+	{
+		if (count <= SORT_RADIX_CUTOFF)
+		{
+			ldns_mergezone_sort_small(recs, count);
+
+			return;
+		}
+
+		if (depth == SORT_KEY_LEN)
+		{
+			/* Move on to the next window of the key */
+			key_offset += SORT_KEY_LEN;
+			depth = 0;
+
+			if (key_offset >= SORT_MAX_KEY_LEN)
+			{
+				ldns_mergezone_sort_small(recs, count);
+
+				return;
+			}
+
+			for (i = 0; i < count; i++)
+			{
+				ldns_mergezone_sort_make_key(&recs[i], key_offset);
+			}
+		}
+
+		memset(counts, 0, sizeof(counts));
+
+		for (i = 0; i < count; i++)
+		{
+			counts[recs[i].key[depth]]++;
+		}
+
+		if (counts[recs[0].key[depth]] != count)
+		{
+			break;
+		}
+
+		/* Two zero bytes in a row means the owner names are the same */
+		if ((prev == 0) && (recs[0].key[depth] == 0))
+		{
+			ldns_mergezone_sort_small(recs, count);
+
+			return;
+		}
+
+		/* Skip a byte that is the same for all records */
+		prev = recs[0].key[depth];
+		depth++;
+	}
+
+	for (b = 0, i = 0; b < 256; b++)
+	{
+		first[b] = i;
+		i += counts[b];
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		tmp[first[recs[i].key[depth]]++] = recs[i];
+	}
+
+	memcpy(recs, tmp, count * sizeof(sort_rec));
+
+	for (b = 0, i = 0; b < 256; b++)
+	{
+		if (counts[b] > 1)
+		{
+			ldns_mergezone_sort_radix(&recs[i], &tmp[i], counts[b], depth + 1, key_offset, (int) b);
+		}
+
+		i += counts[b];
+	}
+}
+
+/* Compute the keys for a slice of the records and count them by the key byte at the current depth */
+static void* ldns_mergezone_sort_worker_keys(void* arg)
+{
+	sort_worker*	worker	= (sort_worker*) arg;
+	size_t		i	= 0;
+
+	memset(worker->counts, 0, sizeof(worker->counts));
+	memset(worker->min_key, 0xff, SORT_KEY_LEN);
+	memset(worker->max_key, 0, SORT_KEY_LEN);
+
+	for (i = worker->first; i < worker->last; i++)
+	{
+		sort_rec*	rec	= &worker->recs[i];
+
+		ldns_mergezone_sort_make_key(rec, worker->key_offset);
+
+		if (memcmp(rec->key, worker->min_key, SORT_KEY_LEN) < 0)
+		{
+			memcpy(worker->min_key, rec->key, SORT_KEY_LEN);
+		}
+
+		if (memcmp(rec->key, worker->max_key, SORT_KEY_LEN) > 0)
+		{
+			memcpy(worker->max_key, rec->key, SORT_KEY_LEN);
+		}
+	}
+
+	return NULL;
+}
+
+/* Count a slice of the records by the key byte at the current depth */
+static void* ldns_mergezone_sort_worker_count(void* arg)
+{
+	sort_worker*	worker	= (sort_worker*) arg;
+	size_t		i	= 0;
+
+	memset(worker->counts, 0, sizeof(worker->counts));
+
+	for (i = worker->first; i < worker->last; i++)
+	{
+		worker->counts[worker->recs[i].key[worker->depth]]++;
+	}
+
+	return NULL;
+}
+
+/* Move a slice of the records to their buckets; counts holds the position of the slice in each bucket */
+static void* ldns_mergezone_sort_worker_scatter(void* arg)
+{
+	sort_worker*	worker	= (sort_worker*) arg;
+	size_t		i	= 0;
+
+	for (i = worker->first; i < worker->last; i++)
+	{
+		worker->tmp[worker->counts[worker->recs[i].key[worker->depth]]++] = worker->recs[i];
+	}
+
+	return NULL;
+}
+
+/* Sort buckets until there are none left; buckets are moved back from the scratch space when done */
+static void* ldns_mergezone_sort_worker_buckets(void* arg)
+{
+	sort_worker*	worker	= (sort_worker*) arg;
+	size_t		b	= 0;
+
+	while ((b = __atomic_fetch_add(worker->next_bucket, 1, __ATOMIC_RELAXED)) < 256)
+	{
+		size_t	first	= worker->bucket_first[b];
+		size_t	count	= worker->bucket_first[b + 1] - first;
+
+		if (count > 1)
+		{
+			ldns_mergezone_sort_radix(&worker->tmp[first], &worker->recs[first], count, worker->depth + 1, worker->key_offset, (int) b);
+		}
+
+		memcpy(&worker->recs[first], &worker->tmp[first], count * sizeof(sort_rec));
+	}
+
+	return NULL;
+}
+
+/* Run the specified function on all workers, in parallel if there is more than one */
+static void ldns_mergezone_sort_run_workers(sort_worker* workers, const int num_workers, void* (*fn)(void*))
+{
+	int	i	= 0;
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].started = (num_workers > 1) && (pthread_create(&workers[i].thread, NULL, fn, &workers[i]) == 0);
+
+		if (!workers[i].started)
+		{
+			fn(&workers[i]);
+		}
+	}
+
+	for (i = 0; i < num_workers; i++)
+	{
+		if (workers[i].started)
+		{
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+}
+
+/* Sort records in canonical order */
+void ldns_mergezone_sort_recs(sort_rec* recs, const size_t count)
+{
+	int		num_workers	= get_threads();
+	sort_worker*	workers		= NULL;
+	sort_rec*	tmp		= NULL;
+	size_t		bucket_first[257];
+	size_t		next_bucket	= 0;
+	size_t		key_offset	= 0;
+	size_t		depth		= 0;
+	size_t		pos		= 0;
+	uint8_t		min_key[SORT_KEY_LEN];
+	uint8_t		max_key[SORT_KEY_LEN];
+	int		prev		= 1;
+	int		i		= 0;
+	size_t		b		= 0;
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	if ((size_t) num_workers > (count / SORT_MIN_RECS_PER_THREAD))
+	{
+		num_workers = (count / SORT_MIN_RECS_PER_THREAD > 0) ? (int) (count / SORT_MIN_RECS_PER_THREAD) : 1;
+	}
+
+	tmp = (sort_rec*) malloc(count * sizeof(sort_rec));
+	workers = (sort_worker*) calloc(num_workers, sizeof(sort_worker));
+
+	assert(tmp != NULL);
+	assert(workers != NULL);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].recs = recs;
+		workers[i].tmp = tmp;
+		workers[i].first = (count * i) / num_workers;
+		workers[i].last = (count * (i + 1)) / num_workers;
+		workers[i].bucket_first = bucket_first;
+		workers[i].next_bucket = &next_bucket;
+	}
+
+	/* Skip the part of the key that all records have in common, e.g. the name of the zone */
+	for (;;)
+	{
+		for (i = 0; i < num_workers; i++)
+		{
+			workers[i].key_offset = key_offset;
+		}
+
+		ldns_mergezone_sort_run_workers(workers, num_workers, ldns_mergezone_sort_worker_keys);
+
+		memcpy(min_key, workers[0].min_key, SORT_KEY_LEN);
+		memcpy(max_key, workers[0].max_key, SORT_KEY_LEN);
+
+		for (i = 1; i < num_workers; i++)
+		{
+			if (memcmp(workers[i].min_key, min_key, SORT_KEY_LEN) < 0)
+			{
+				memcpy(min_key, workers[i].min_key, SORT_KEY_LEN);
+			}
+
+			if (memcmp(workers[i].max_key, max_key, SORT_KEY_LEN) > 0)
+			{
+				memcpy(max_key, workers[i].max_key, SORT_KEY_LEN);
+			}
+		}
+
+		for (depth = 0; (depth < SORT_KEY_LEN) && (min_key[depth] == max_key[depth]); depth++)
+		{
+			/* Two zero bytes in a row means all owner names are the same */
+			if ((min_key[depth] == 0) && (prev == 0))
+			{
+				break;
+			}
+
+			prev = min_key[depth];
+		}
+
+		if ((depth < SORT_KEY_LEN) || (key_offset + SORT_KEY_LEN >= SORT_MAX_KEY_LEN))
+		{
+			break;
+		}
+
+		key_offset += SORT_KEY_LEN;
+	}
+
+	if ((depth == SORT_KEY_LEN) || ((min_key[depth] == max_key[depth]) && (min_key[depth] == 0)))
+	{
+		/* All owner names are the same */
+		ldns_mergezone_sort_small(recs, count);
+	}
+	else
+	{
+		/* Start the window where the keys start to differ, so all of it is used for sorting */
+		if (depth > 0)
+		{
+			for (i = 0; i < num_workers; i++)
+			{
+				workers[i].key_offset = key_offset + depth;
+			}
+
+			ldns_mergezone_sort_run_workers(workers, num_workers, ldns_mergezone_sort_worker_keys);
+
+			key_offset += depth;
+			depth = 0;
+		}
+
+		/* Distribute over buckets on the first byte that differs, then sort the buckets */
+		for (i = 0; i < num_workers; i++)
+		{
+			workers[i].depth = depth;
+		}
+
+		ldns_mergezone_sort_run_workers(workers, num_workers, ldns_mergezone_sort_worker_count);
+
+		for (b = 0; b < 256; b++)
+		{
+			bucket_first[b] = pos;
+
+			for (i = 0; i < num_workers; i++)
+			{
+				size_t	n	= workers[i].counts[b];
+
+				workers[i].counts[b] = pos;
+
+				pos += n;
+			}
+		}
+
+		bucket_first[256] = pos;
+
+		assert(pos == count);
+
+		ldns_mergezone_sort_run_workers(workers, num_workers, ldns_mergezone_sort_worker_scatter);
+
+		ldns_mergezone_sort_run_workers(workers, num_workers, ldns_mergezone_sort_worker_buckets);
+	}
+
+	free(workers);
+	free(tmp);
+}
+
+/* Create a temporary file in $TMPDIR; returns the open file descriptor */
+static int ldns_mergezone_sort_mkstemp(char** path)
+{
+	const char*	tmp_dir	= getenv("TMPDIR");
+	int		fd	= -1;
+
+	if ((tmp_dir == NULL) || (*tmp_dir == '\0'))
+	{
+		tmp_dir = "/tmp";
+	}
+
+	*path = (char*) malloc(strlen(tmp_dir) + 32);
+
+	assert(*path != NULL);
+
+	sprintf(*path, "%s/ldns-mergezone-XXXXXX", tmp_dir);
+
+	if ((fd = mkstemp(*path)) < 0)
+	{
+		fprintf(stderr, "Failed to create temporary file in %s\n", tmp_dir);
+
+		free(*path);
+
+		*path = NULL;
+	}
+
+	return fd;
+}
+
+/* Create an anonymous temporary file in $TMPDIR */
+FILE* ldns_mergezone_sort_tmpfile(void)
+{
+	char*	path	= NULL;
+	FILE*	fp	= NULL;
+	int	fd	= ldns_mergezone_sort_mkstemp(&path);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	unlink(path);
+	free(path);
+
+	if ((fp = fdopen(fd, "w+")) == NULL)
+	{
+		fprintf(stderr, "Failed to open temporary file\n");
+
+		close(fd);
+
+		return NULL;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, SORT_IO_BUF);
+
+	return fp;
+}
+
+/* Add a record to the run; returns 1 if the run is full */
+static int ldns_mergezone_sort_run_add(sort_run* run, const uint8_t* wire, const uint32_t len)
+{
+	size_t	need	= run->arena_size + sizeof(uint32_t) + len;
+
+	/* Sorting needs two record arrays */
+	if ((run->count > 0) && (need + 2 * (run->count + 1) * sizeof(sort_rec) > run->mem_limit))
+	{
+		return 1;
+	}
+
+	if (need > run->arena_alloc)
+	{
+		/* Grow by doubling, but do not allocate more than the memory limit */
+		run->arena_alloc = (run->arena_alloc == 0) ? SORT_MIN_MEM_LIMIT : run->arena_alloc * 2;
+
+		if (run->arena_alloc > run->mem_limit)
+		{
+			run->arena_alloc = run->mem_limit;
+		}
+
+		if (run->arena_alloc < need)
+		{
+			run->arena_alloc = need;
+		}
+
+		run->arena = (uint8_t*) realloc(run->arena, run->arena_alloc);
+
+		assert(run->arena != NULL);
+	}
+
+	memcpy(run->arena + run->arena_size, &len, sizeof(uint32_t));
+	memcpy(run->arena + run->arena_size + sizeof(uint32_t), wire, len);
+
+	run->arena_size = need;
+	run->count++;
+
+	return 0;
+}
+
+/* Sort the records in the run */
+static sort_rec* ldns_mergezone_sort_run_sort(sort_run* run)
+{
+	sort_rec*	recs	= (sort_rec*) malloc((run->count + 1) * sizeof(sort_rec));
+	size_t		pos	= 0;
+	size_t		i	= 0;
+	uint64_t	start	= 0;
+
+	assert(recs != NULL);
+
+	TRACE_BEGIN(start);
+
+	for (i = 0; i < run->count; i++)
+	{
+		memcpy(&recs[i].len, run->arena + pos, sizeof(uint32_t));
+
+		recs[i].wire = run->arena + pos + sizeof(uint32_t);
+
+		pos += sizeof(uint32_t) + recs[i].len;
+	}
+
+	ldns_mergezone_sort_recs(recs, run->count);
+
+	TRACE_END(start, "sort", "sort run");
+
+	return recs;
+}
+
+/* Write a record to a run file */
+static int ldns_mergezone_sort_write_rec(void* arg, const uint8_t* wire, const uint32_t len)
+{
+	FILE*	fp	= (FILE*) arg;
+
+	if ((fwrite(&len, sizeof(uint32_t), 1, fp) != 1) || (fwrite(wire, 1, len, fp) != len))
+	{
+		fprintf(stderr, "Failed to write to temporary file\n");
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Write a record to the output zone */
+static int ldns_mergezone_sort_output_rec(void* arg, const uint8_t* wire, const uint32_t len)
+{
+	sort_output*	out	= (sort_output*) arg;
+	ldns_rr*	rr	= NULL;
+	size_t		pos	= 0;
+
+	if (ldns_wire2rr(&rr, wire, len, &pos, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to convert record from wire format\n");
+
+		return 1;
+	}
+
+	PROGRESS_RECORDS(1);
+
+	if (ldns_mergezone_format_rr(out->text, rr) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to format record\n");
+
+		ldns_rr_free(rr);
+
+		return 1;
+	}
+
+	ldns_rr_free(rr);
+
+	out->count++;
+
+	if (ldns_buffer_position(out->text) >= SORT_OUT_CHUNK)
+	{
+		if (fwrite(ldns_buffer_begin(out->text), 1, ldns_buffer_position(out->text), out->out_fp) != ldns_buffer_position(out->text))
+		{
+			fprintf(stderr, "Failed to write sorted zone\n");
+
+			return 1;
+		}
+
+		ldns_buffer_clear(out->text);
+	}
+
+	return 0;
+}
+
+/* Read the next record of a run; the wire pointer is NULL at the end of the run */
+static int ldns_mergezone_sort_run_next(sort_run_reader* run)
+{
+	if (fread(&run->len, sizeof(uint32_t), 1, run->fp) != 1)
+	{
+		run->len = 0;
+
+		if (ferror(run->fp))
+		{
+			fprintf(stderr, "Failed to read from temporary file\n");
+
+			return 1;
+		}
+
+		free(run->wire);
+
+		run->wire = NULL;
+
+		return 0;
+	}
+
+	if ((run->len > SORT_MAX_REC_LEN) || (fread(run->wire, 1, run->len, run->fp) != run->len))
+	{
+		fprintf(stderr, "Failed to read from temporary file\n");
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Compare the current records of two runs; earlier runs go first for equal records */
+static int ldns_mergezone_sort_run_less(sort_run_reader* runs, const size_t a, const size_t b)
+{
+	int	rv	= ldns_mergezone_sort_rec_compare(runs[a].wire, runs[a].len, runs[b].wire, runs[b].len);
+
+	return (rv < 0) || ((rv == 0) && (a < b));
+}
+
+static void ldns_mergezone_sort_heap_down(sort_run_reader* runs, size_t* heap, const size_t heap_size, size_t i)
+{
+	for (;;)
+	{
+		size_t	smallest	= i;
+		size_t	left		= 2 * i + 1;
+		size_t	right		= 2 * i + 2;
+		size_t	swap		= 0;
+
+		if ((left < heap_size) && ldns_mergezone_sort_run_less(runs, heap[left], heap[smallest]))
+		{
+			smallest = left;
+		}
+
+		if ((right < heap_size) && ldns_mergezone_sort_run_less(runs, heap[right], heap[smallest]))
+		{
+			smallest = right;
+		}
+
+		if (smallest == i)
+		{
+			break;
+		}
+
+		swap = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = swap;
+
+		i = smallest;
+	}
+}
+
+/* Merge sorted run files; the run files are closed */
+static int ldns_mergezone_sort_merge(FILE** run_fps, const size_t run_count, sort_emit emit, void* emit_arg)
+{
+	sort_run_reader*	runs		= (sort_run_reader*) malloc(run_count * sizeof(sort_run_reader));
+	size_t*			heap		= (size_t*) malloc(run_count * sizeof(size_t));
+	size_t			heap_size	= 0;
+	size_t			i		= 0;
+	int			rv		= 0;
+
+	assert(runs != NULL);
+	assert(heap != NULL);
+
+	for (i = 0; i < run_count; i++)
+	{
+		runs[i].fp = run_fps[i];
+		runs[i].wire = (uint8_t*) malloc(SORT_MAX_REC_LEN);
+		runs[i].len = 0;
+
+		assert(runs[i].wire != NULL);
+
+		rewind(runs[i].fp);
+
+		if ((rv == 0) && (ldns_mergezone_sort_run_next(&runs[i]) != 0))
+		{
+			rv = 1;
+		}
+
+		if (runs[i].wire != NULL)
+		{
+			heap[heap_size++] = i;
+		}
+	}
+
+	for (i = heap_size / 2; (rv == 0) && (i > 0); i--)
+	{
+		ldns_mergezone_sort_heap_down(runs, heap, heap_size, i - 1);
+	}
+
+	while ((rv == 0) && (heap_size > 0))
+	{
+		sort_run_reader*	run	= &runs[heap[0]];
+
+		if ((emit(emit_arg, run->wire, run->len) != 0) || (ldns_mergezone_sort_run_next(run) != 0))
+		{
+			rv = 1;
+
+			break;
+		}
+
+		if (run->wire == NULL)
+		{
+			heap[0] = heap[--heap_size];
+		}
+
+		ldns_mergezone_sort_heap_down(runs, heap, heap_size, 0);
+	}
+
+	for (i = 0; i < run_count; i++)
+	{
+		free(runs[i].wire);
+
+		fclose(runs[i].fp);
+	}
+
+	free(runs);
+	free(heap);
+
+	return rv;
+}
+
+/* Merge groups of runs into longer runs */
+static int ldns_mergezone_sort_merge_pass(FILE** run_fps, size_t* run_count)
+{
+	size_t	merged	= 0;
+	size_t	i	= 0;
+	size_t	j	= 0;
+	int	rv	= 0;
+
+	for (i = 0; i < *run_count; i += SORT_MAX_FANIN)
+	{
+		size_t	group	= ((*run_count - i) < SORT_MAX_FANIN) ? (*run_count - i) : SORT_MAX_FANIN;
+		FILE*	fp	= (rv == 0) ? ldns_mergezone_sort_tmpfile() : NULL;
+
+		if (fp == NULL)
+		{
+			for (j = i; j < i + group; j++)
+			{
+				fclose(run_fps[j]);
+			}
+
+			rv = 1;
+
+			continue;
+		}
+
+		/* This closes the merged run files */
+		if (ldns_mergezone_sort_merge(&run_fps[i], group, ldns_mergezone_sort_write_rec, fp) != 0)
+		{
+			fclose(fp);
+
+			rv = 1;
+
+			continue;
+		}
+
+		run_fps[merged++] = fp;
+	}
+
+	if (rv != 0)
+	{
+		for (j = 0; j < merged; j++)
+		{
+			fclose(run_fps[j]);
+		}
+
+		merged = 0;
+	}
+
+	*run_count = merged;
+
+	return rv;
+}
+
+/* Sort the run and write it to a new temporary file */
+static FILE* ldns_mergezone_sort_spill(sort_run* run)
+{
+	sort_rec*	recs	= ldns_mergezone_sort_run_sort(run);
+	FILE*		fp	= ldns_mergezone_sort_tmpfile();
+	size_t		i	= 0;
+	uint64_t	start	= 0;
+
+	TRACE_BEGIN(start);
+
+	for (i = 0; (fp != NULL) && (i < run->count); i++)
+	{
+		if (ldns_mergezone_sort_write_rec(fp, recs[i].wire, recs[i].len) != 0)
+		{
+			fclose(fp);
+
+			fp = NULL;
+		}
+	}
+
+	free(recs);
+
+	TRACE_END(start, "sort", "spill run");
+
+	run->arena_size = 0;
+	run->count = 0;
+
+	return fp;
+}
+
+/* Sort a zone file in canonical order and write it to a new file */
+int ldns_mergezone_sort_zone_file(const char* in_file, const char* out_file, const size_t mem_limit)
+{
+	zone_reader	reader;
+	sort_run	run;
+	sort_output	out;
+	ldns_rr*	rr		= NULL;
+	ldns_rr*	soa		= NULL;
+	FILE**		run_fps		= NULL;
+	size_t		run_count	= 0;
+	size_t		run_alloc	= 0;
+	size_t		in_recs		= 0;
+	uint8_t*	wire		= NULL;
+	size_t		wire_len	= 0;
+	int		rv		= 0;
+	size_t		i		= 0;
+
+	if (ldns_mergezone_reader_open(&reader, in_file) != 0)
+	{
+		return 1;
+	}
+
+	memset(&run, 0, sizeof(sort_run));
+
+	run.mem_limit = (mem_limit < SORT_MIN_MEM_LIMIT) ? SORT_MIN_MEM_LIMIT : mem_limit;
+
+	/* Collect records in sorted runs */
+	while ((rv = ldns_mergezone_reader_next_rr(&reader, &rr)) == 0)
+	{
+		if (rr == NULL)
+		{
+			break;
+		}
+
+		in_recs++;
+
+		if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA)
+		{
+			/* Like ldns, keep the first SOA record and ignore the rest */
+			if (soa == NULL)
+			{
+				soa = rr;
+			}
+			else
+			{
+				ldns_rr_free(rr);
+			}
+
+			continue;
+		}
+
+		if (ldns_rr2wire(&wire, rr, LDNS_SECTION_ANSWER, &wire_len) != LDNS_STATUS_OK)
+		{
+			fprintf(stderr, "Failed to convert record to wire format\n");
+
+			ldns_rr_free(rr);
+
+			rv = 1;
+
+			break;
+		}
+
+		ldns_rr_free(rr);
+
+		if (ldns_mergezone_sort_run_add(&run, wire, wire_len) != 0)
+		{
+			if (run_count == run_alloc)
+			{
+				run_alloc = (run_alloc == 0) ? 16 : run_alloc * 2;
+				run_fps = (FILE**) realloc(run_fps, run_alloc * sizeof(FILE*));
+
+				assert(run_fps != NULL);
+			}
+
+			if ((run_fps[run_count] = ldns_mergezone_sort_spill(&run)) == NULL)
+			{
+				free(wire);
+
+				rv = 1;
+
+				break;
+			}
+
+			run_count++;
+
+			VERBOSE("Wrote sorted run %zd of %s to temporary file\n", run_count, in_file);
+
+			ldns_mergezone_sort_run_add(&run, wire, wire_len);
+		}
+
+		free(wire);
+	}
+
+	ldns_mergezone_reader_close(&reader);
+
+	if ((rv == 0) && (soa == NULL))
+	{
+		fprintf(stderr, "Zone %s does not contain an SOA record\n", in_file);
+
+		rv = 1;
+	}
+
+	/* Spill the last run too if runs have to be merged */
+	if ((rv == 0) && (run_count > 0) && (run.count > 0))
+	{
+		if (run_count == run_alloc)
+		{
+			run_fps = (FILE**) realloc(run_fps, ++run_alloc * sizeof(FILE*));
+
+			assert(run_fps != NULL);
+		}
+
+		if ((run_fps[run_count] = ldns_mergezone_sort_spill(&run)) == NULL)
+		{
+			rv = 1;
+		}
+		else
+		{
+			run_count++;
+		}
+	}
+
+	/* Merge groups of runs until they can all be merged at once */
+	while ((rv == 0) && (run_count > SORT_MAX_FANIN))
+	{
+		rv = ldns_mergezone_sort_merge_pass(run_fps, &run_count);
+	}
+
+	/* Write the output zone, starting with the SOA record */
+	ldns_mergezone_progress_phase("write sorted zone", 0, in_recs);
+
+	memset(&out, 0, sizeof(sort_output));
+
+	if ((rv == 0) && ((out.out_fp = fopen(out_file, "w")) == NULL))
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", out_file);
+
+		rv = 1;
+	}
+
+	if (rv == 0)
+	{
+		out.text = ldns_buffer_new(SORT_OUT_CHUNK + LDNS_MAX_LINELEN);
+
+		assert(out.text != NULL);
+
+		if (ldns_mergezone_format_rr(out.text, soa) != LDNS_STATUS_OK)
+		{
+			fprintf(stderr, "Failed to format record\n");
+
+			rv = 1;
+		}
+	}
+
+	if ((rv == 0) && (run_count > 0))
+	{
+		VERBOSE("Merging %zd sorted runs of %s\n", run_count, in_file);
+
+		/* This closes the run files */
+		rv = ldns_mergezone_sort_merge(run_fps, run_count, ldns_mergezone_sort_output_rec, &out);
+
+		run_count = 0;
+	}
+	else if (rv == 0)
+	{
+		/* Everything fit in memory */
+		sort_rec*	recs	= ldns_mergezone_sort_run_sort(&run);
+
+		for (i = 0; (rv == 0) && (i < run.count); i++)
+		{
+			rv = ldns_mergezone_sort_output_rec(&out, recs[i].wire, recs[i].len);
+		}
+
+		free(recs);
+	}
+
+	for (i = 0; i < run_count; i++)
+	{
+		fclose(run_fps[i]);
+	}
+
+	free(run_fps);
+	free(run.arena);
+
+	ldns_rr_free(soa);
+
+	if (out.out_fp != NULL)
+	{
+		if ((rv == 0) && (fwrite(ldns_buffer_begin(out.text), 1, ldns_buffer_position(out.text), out.out_fp) != ldns_buffer_position(out.text)))
+		{
+			fprintf(stderr, "Failed to write sorted zone\n");
+
+			rv = 1;
+		}
+
+		if ((fclose(out.out_fp) != 0) && (rv == 0))
+		{
+			fprintf(stderr, "Failed to write sorted zone\n");
+
+			rv = 1;
+		}
+
+		if (rv != 0)
+		{
+			unlink(out_file);
+		}
+	}
+
+	if (out.text != NULL)
+	{
+		ldns_buffer_free(out.text);
+	}
+
+	if (rv == 0)
+	{
+		VERBOSE("Sorted %zd records of %s in canonical order\n", in_recs, in_file);
+	}
+
+	return rv;
+}
+
+/* Sort a zone file into a new temporary file; the caller must remove and free it */
+int ldns_mergezone_sort_zone_tmpfile(const char* in_file, const size_t mem_limit, char** sorted_file)
+{
+	assert(in_file != NULL);
+	assert(sorted_file != NULL);
+
+	int	fd	= ldns_mergezone_sort_mkstemp(sorted_file);
+
+	if (fd < 0)
+	{
+		return 1;
+	}
+
+	close(fd);
+
+	if (ldns_mergezone_sort_zone_file(in_file, *sorted_file, mem_limit) != 0)
+	{
+		unlink(*sorted_file);
+		free(*sorted_file);
+
+		*sorted_file = NULL;
+
+		return 1;
+	}
+
+	return 0;
+}
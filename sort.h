@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_SORT_H
+#define _LDNS_MERGEZONE_SORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* Default amount of memory to use for sorting */
+#define SORT_DEFAULT_MEM_LIMIT	((size_t) 1024 * 1024 * 1024)
+
+/* Size of the window of the canonical name key that records are sorted on */
+#define SORT_KEY_LEN		16
+
+/* Record to sort; the key is filled in while sorting */
+typedef struct
+{
+	uint8_t		key[SORT_KEY_LEN];
+	const uint8_t*	wire;
+	uint32_t	len;
+}
+sort_rec;
+
+/* Compare two wire-format records in canonical order */
+int ldns_mergezone_sort_rec_compare(const uint8_t* left, const size_t left_len, const uint8_t* right, const size_t right_len);
+
+/* Sort wire-format records in canonical order; records that compare equal are ordered by the address of their data */
+void ldns_mergezone_sort_recs(sort_rec* recs, const size_t count);
+
+/*
+ * Sort a zone file in canonical order and write it to a new file, with the
+ * SOA record first. Records that do not fit in the memory limit are sorted
+ * in runs that are spilled to temporary files in $TMPDIR and merged.
+ */
+int ldns_mergezone_sort_zone_file(const char* in_file, const char* out_file, const size_t mem_limit);
+
+/* Sort a zone file into a new temporary file; the caller must remove and free it */
+int ldns_mergezone_sort_zone_tmpfile(const char* in_file, const size_t mem_limit, char** sorted_file);
+
+/* Create an anonymous temporary file in $TMPDIR */
+FILE* ldns_mergezone_sort_tmpfile(void);
+
+#endif /* !_LDNS_MERGEZONE_SORT_H */
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <assert.h>
+#include "state.h"
+#include "hash.h"
+#include "threads.h"
+#include "verbose.h"
+#include "replace.h"
+
+/*
+ * A run is skipped if the inputs are the same as in the last successful
+ * run and the outputs it wrote are still there, unchanged. To tell, the
+ * state file records the size and a 64-bit hash of the contents of each
+ * input and of each output (the zone and, if requested, the difference
+ * and the ZONEMD record), together with the options that affect them. When the validity of the signatures is checked, it also records
+ * until when the signatures pass the check, after which the merge is run
+ * again even if nothing changed.
+ *
+ * Files are mapped into memory and hashed without being parsed. They are
+ * split into segments of a fixed size, each of which is hashed by one of
+ * the worker threads in chunks that are chained through the seed; the
+ * hashes of the segments are then hashed together. The segment size does
+ * not depend on the number of threads, so neither does the fingerprint.
+ */
+
+/* Size of the segments of a file that are hashed independently */
+#define STATE_SEGMENT_SIZE	((size_t) 64 * 1024 * 1024)
+
+/* Size of the chunks a segment is hashed in */
+#define STATE_CHUNK_SIZE	((size_t) 1024 * 1024)
+
+/* Seed of the file hash */
+#define STATE_SEED		0x6d657267657a6f6eull
+
+/* Version of the state file */
+#define STATE_VERSION		4
+
+/* Worker hashing every num_workers'th segment, starting at first */
+typedef struct
+{
+	const uint8_t*	data;
+	size_t		size;
+	uint64_t*	hashes;
+	size_t		segments;
+	size_t		first;
+	size_t		step;
+	int		started;
+	pthread_t	thread;
+}
+state_worker;
+
+static void* ldns_mergezone_state_hash_segments(void* arg)
+{
+	state_worker*	worker	= (state_worker*) arg;
+	size_t		seg	= 0;
+
+	for (seg = worker->first; seg < worker->segments; seg += worker->step)
+	{
+		size_t		pos	= seg * STATE_SEGMENT_SIZE;
+		size_t		end	= (worker->size - pos > STATE_SEGMENT_SIZE) ? pos + STATE_SEGMENT_SIZE : worker->size;
+		uint64_t	hash	= STATE_SEED ^ seg;
+
+		for (; pos < end; pos += STATE_CHUNK_SIZE)
+		{
+			hash = ldns_mergezone_hash_bytes(worker->data + pos, (end - pos > STATE_CHUNK_SIZE) ? STATE_CHUNK_SIZE : end - pos, hash);
+		}
+
+		worker->hashes[seg] = hash;
+	}
+
+	return NULL;
+}
+
+/* Compute the fingerprint of the contents of a file */
+int ldns_mergezone_state_fingerprint(const char* file, file_fingerprint* fp)
+{
+	assert(file != NULL);
+	assert(fp != NULL);
+
+	int		fd		= open(file, O_RDONLY);
+	void*		data		= NULL;
+	uint64_t*	hashes		= NULL;
+	state_worker*	workers		= NULL;
+	size_t		segments	= 0;
+	int		num_workers	= 0;
+	int		i		= 0;
+	struct stat	st;
+
+	memset(fp, 0, sizeof(file_fingerprint));
+
+	if (fd < 0)
+	{
+		return 1;
+	}
+
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+
+		return 1;
+	}
+
+	fp->size = st.st_size;
+	fp->hash = STATE_SEED;
+
+	if (st.st_size == 0)
+	{
+		close(fd);
+
+		return 0;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "Failed to map %s into memory\n", file);
+
+		return 1;
+	}
+
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	segments = (st.st_size + STATE_SEGMENT_SIZE - 1) / STATE_SEGMENT_SIZE;
+	num_workers = ((size_t) get_threads() < segments) ? get_threads() : (int) segments;
+	hashes = (uint64_t*) malloc(segments * sizeof(uint64_t));
+	workers = (state_worker*) calloc(num_workers, sizeof(state_worker));
+
+	assert(hashes != NULL);
+	assert(workers != NULL);
+
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].data = (const uint8_t*) data;
+		workers[i].size = st.st_size;
+		workers[i].hashes = hashes;
+		workers[i].segments = segments;
+		workers[i].first = i;
+		workers[i].step = num_workers;
+		workers[i].started = (num_workers > 1) && (pthread_create(&workers[i].thread, NULL, ldns_mergezone_state_hash_segments, &workers[i]) == 0);
+
+		if (!workers[i].started)
+		{
+			ldns_mergezone_state_hash_segments(&workers[i]);
+		}
+	}
+
+	for (i = 0; i < num_workers; i++)
+	{
+		if (workers[i].started)
+		{
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+
+	fp->hash = ldns_mergezone_hash_bytes((const uint8_t*) hashes, segments * sizeof(uint64_t), STATE_SEED ^ fp->size);
+
+	munmap(data, st.st_size);
+
+	free(workers);
+	free(hashes);
+
+	return 0;
+}
+
+/* Compute one fingerprint of several files; for a single file it is the fingerprint of that file */
+int ldns_mergezone_state_fingerprint_files(const char* const* files, const size_t count, file_fingerprint* fp)
+{
+	assert(files != NULL);
+	assert(count > 0);
+	assert(fp != NULL);
+
+	uint64_t	parts[2]	= { 0, 0 };
+	size_t		i		= 0;
+	file_fingerprint file_fp;
+
+	if (count == 1)
+	{
+		return ldns_mergezone_state_fingerprint(files[0], fp);
+	}
+
+	fp->size = 0;
+	fp->hash = STATE_SEED ^ count;
+
+	/* The order of the files matters, so chain the fingerprints */
+	for (i = 0; i < count; i++)
+	{
+		if (ldns_mergezone_state_fingerprint(files[i], &file_fp) != 0)
+		{
+			return 1;
+		}
+
+		parts[0] = file_fp.size;
+		parts[1] = file_fp.hash;
+
+		fp->size += file_fp.size;
+		fp->hash = ldns_mergezone_hash_bytes((const uint8_t*) parts, sizeof(parts), fp->hash);
+	}
+
+	return 0;
+}
+
+/* Read a fingerprint line of the state file */
+static int ldns_mergezone_state_read_fp(FILE* fp, const char* name, file_fingerprint* file_fp)
+{
+	char		line_name[16];
+	uint64_t	size	= 0;
+	uint64_t	hash	= 0;
+
+	if ((fscanf(fp, "%15s %" SCNu64 " %" SCNx64, line_name, &size, &hash) != 3) || strcmp(line_name, name))
+	{
+		return 1;
+	}
+
+	file_fp->size = size;
+	file_fp->hash = hash;
+
+	return 0;
+}
+
+/* Read the state of the last run; returns 1 if there is no (valid) state */
+int ldns_mergezone_state_read(const char* state_file, merge_state* state)
+{
+	assert(state_file != NULL);
+	assert(state != NULL);
+
+	FILE*	fp	= fopen(state_file, "r");
+	int	version	= 0;
+	int	rv	= 0;
+
+	memset(state, 0, sizeof(merge_state));
+
+	if (fp == NULL)
+	{
+		VERBOSE("No state of a previous run in %s\n", state_file);
+
+		return 1;
+	}
+
+	if ((fscanf(fp, "ldns-mergezone-state %d", &version) != 1) || (version != STATE_VERSION) ||
+	    ldns_mergezone_state_read_fp(fp, "from", &state->from) ||
+	    ldns_mergezone_state_read_fp(fp, "to", &state->to) ||
+	    ldns_mergezone_state_read_fp(fp, "old", &state->old) ||
+	    ldns_mergezone_state_read_fp(fp, "out", &state->out) ||
+	    ldns_mergezone_state_read_fp(fp, "diff", &state->diff) ||
+	    ldns_mergezone_state_read_fp(fp, "zonemd", &state->zonemd) ||
+	    (fscanf(fp, " options %d %d %d %d %d", &state->out_type, &state->sort_from, &state->check_output, &state->add_zonemd, &state->sig_days) != 5) ||
+	    (fscanf(fp, " signatures %" SCNu32, &state->sig_valid_until) != 1))
+	{
+		VERBOSE("Ignoring invalid state file %s\n", state_file);
+
+		memset(state, 0, sizeof(merge_state));
+
+		rv = 1;
+	}
+
+	fclose(fp);
+
+	return rv;
+}
+
+/* Write the state of this run, atomically replacing the specified file */
+int ldns_mergezone_state_write(const char* state_file, const merge_state* state)
+{
+	assert(state_file != NULL);
+	assert(state != NULL);
+
+	replace_file	rf;
+	FILE*		fp	= NULL;
+
+	if (ldns_mergezone_replace_open(&rf, state_file) != 0)
+	{
+		return 1;
+	}
+
+	fp = rf.fp;
+
+	fprintf(fp, "ldns-mergezone-state %d\n", STATE_VERSION);
+	fprintf(fp, "from %" PRIu64 " %016" PRIx64 "\n", state->from.size, state->from.hash);
+	fprintf(fp, "to %" PRIu64 " %016" PRIx64 "\n", state->to.size, state->to.hash);
+	fprintf(fp, "old %" PRIu64 " %016" PRIx64 "\n", state->old.size, state->old.hash);
+	fprintf(fp, "out %" PRIu64 " %016" PRIx64 "\n", state->out.size, state->out.hash);
+	fprintf(fp, "diff %" PRIu64 " %016" PRIx64 "\n", state->diff.size, state->diff.hash);
+	fprintf(fp, "zonemd %" PRIu64 " %016" PRIx64 "\n", state->zonemd.size, state->zonemd.hash);
+	fprintf(fp, "options %d %d %d %d %d\n", state->out_type, state->sort_from, state->check_output, state->add_zonemd, state->sig_days);
+	fprintf(fp, "signatures %" PRIu32 "\n", state->sig_valid_until);
+
+	if (ldns_mergezone_replace_close(&rf, 0) != 0)
+	{
+		fprintf(stderr, "Failed to write state to %s\n", state_file);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static int ldns_mergezone_state_same_fp(const file_fingerprint* left, const file_fingerprint* right)
+{
+	return (left->size == right->size) && (left->hash == right->hash);
+}
+
+/* Check if an output of the last run is still there and has not changed since */
+static int ldns_mergezone_state_output_unchanged(const file_fingerprint* last_fp, const char* file, const char* what)
+{
+	file_fingerprint	cur_fp;
+
+	if ((ldns_mergezone_state_fingerprint(file, &cur_fp) != 0) || !ldns_mergezone_state_same_fp(last_fp, &cur_fp))
+	{
+		VERBOSE("%s %s has changed since the last run\n", what, file);
+
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Check if the inputs are the same as in the last run and the outputs have not changed since (diff_file and zonemd_file may be NULL) */
+int ldns_mergezone_state_unchanged(const merge_state* last, const merge_state* cur, const char* out_zone, const char* diff_file, const char* zonemd_file)
+{
+
+	if (!ldns_mergezone_state_same_fp(&last->from, &cur->from) ||
+	    !ldns_mergezone_state_same_fp(&last->to, &cur->to) ||
+	    !ldns_mergezone_state_same_fp(&last->old, &cur->old) ||
+	    (last->out_type != cur->out_type) ||
+	    (last->sort_from != cur->sort_from) ||
+	    (last->check_output != cur->check_output) ||
+	    (last->add_zonemd != cur->add_zonemd) ||
+	    (last->sig_days != cur->sig_days))
+	{
+		return 0;
+	}
+
+	/* Signatures that passed the validity checks last time may not pass them anymore */
+	if ((cur->sig_days >= 0) && ((int32_t) (last->sig_valid_until - (uint32_t) time(NULL)) <= 0))
+	{
+		VERBOSE("Signatures have to be checked again\n");
+
+		return 0;
+	}
+
+	/* Only hash the outputs if everything else is the same; one that is missing has changed too */
+	return ldns_mergezone_state_output_unchanged(&last->out, out_zone, "Output zone") &&
+	       ((diff_file == NULL) || ldns_mergezone_state_output_unchanged(&last->diff, diff_file, "Difference file")) &&
+	       ((zonemd_file == NULL) || ldns_mergezone_state_output_unchanged(&last->zonemd, zonemd_file, "ZONEMD file"));
+}
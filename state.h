@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_STATE_H
+#define _LDNS_MERGEZONE_STATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Exit status when the merge was skipped because nothing changed since the last run */
+#define STATE_UNCHANGED	3
+
+/* Fingerprint of the contents of a file */
+typedef struct
+{
+	uint64_t	size;
+	uint64_t	hash;
+}
+file_fingerprint;
+
+/* What went into a merge and what came out of it */
+typedef struct
+{
+	file_fingerprint	from;
+	file_fingerprint	to;
+	file_fingerprint	old;
+	file_fingerprint	out;
+	file_fingerprint	diff;
+	file_fingerprint	zonemd;
+	int			out_type;
+	int			sort_from;
+	int			check_output;
+	int			add_zonemd;
+	int			sig_days;
+	uint32_t		sig_valid_until;
+}
+merge_state;
+
+/* Compute the fingerprint of the contents of a file */
+int ldns_mergezone_state_fingerprint(const char* file, file_fingerprint* fp);
+
+/* Compute one fingerprint of several files; for a single file it is the fingerprint of that file */
+int ldns_mergezone_state_fingerprint_files(const char* const* files, const size_t count, file_fingerprint* fp);
+
+/* Read the state of the last run; returns 1 if there is no (valid) state */
+int ldns_mergezone_state_read(const char* state_file, merge_state* state);
+
+/* Write the state of this run, atomically replacing the specified file */
+int ldns_mergezone_state_write(const char* state_file, const merge_state* state);
+
+/* Check if the inputs are the same as in the last run and the outputs have not changed since (diff_file and zonemd_file may be NULL) */
+int ldns_mergezone_state_unchanged(const merge_state* last, const merge_state* cur, const char* out_zone, const char* diff_file, const char* zonemd_file);
+
+#endif /* !_LDNS_MERGEZONE_STATE_H */
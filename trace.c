@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+#include "trace.h"
+
+/*
+ * Timeline tracing in the trace event format that Perfetto and
+ * chrome://tracing can open. Each thread records its spans in a buffer of
+ * its own, so recording a span takes two clock reads and a store without
+ * any locking or sharing of cache lines between threads. A full buffer is
+ * simply followed by a new one; the global list of buffers is only locked
+ * when a buffer is added. When tracing is off, the TRACE_ macros cost no
+ * more than a test of a global flag. The buffers are written out as one
+ * JSON file once all threads have finished.
+ */
+
+/* Number of spans per buffer */
+#define TRACE_BUF_EVENTS	4096
+
+typedef struct
+{
+	const char*	cat;
+	const char*	name;
+	uint64_t	start;
+	uint64_t	end;
+}
+trace_event;
+
+typedef struct trace_buf
+{
+	struct trace_buf*	next;
+	int			tid;
+	const char*		thread_name;
+	size_t			count;
+	trace_event		events[TRACE_BUF_EVENTS];
+}
+trace_buf;
+
+int trace_enabled = 0;
+
+static pthread_mutex_t		trace_lock	= PTHREAD_MUTEX_INITIALIZER;
+static trace_buf*		trace_bufs	= NULL;
+static int			trace_next_tid	= 1;
+static uint64_t			trace_origin	= 0;
+static __thread trace_buf*	trace_local	= NULL;
+
+/* Start tracing */
+void ldns_mergezone_trace_start(void)
+{
+	trace_origin = ldns_mergezone_trace_now();
+	trace_enabled = 1;
+
+	ldns_mergezone_trace_thread("main");
+}
+
+/* Get the current time for a span */
+uint64_t ldns_mergezone_trace_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* Get a buffer with room for a span for the calling thread */
+static trace_buf* ldns_mergezone_trace_local(void)
+{
+	trace_buf*	buf	= trace_local;
+
+	if ((buf != NULL) && (buf->count < TRACE_BUF_EVENTS))
+	{
+		return buf;
+	}
+
+	trace_local = (trace_buf*) malloc(sizeof(trace_buf));
+
+	assert(trace_local != NULL);
+
+	trace_local->count = 0;
+	trace_local->thread_name = (buf != NULL) ? buf->thread_name : NULL;
+
+	pthread_mutex_lock(&trace_lock);
+
+	trace_local->tid = (buf != NULL) ? buf->tid : trace_next_tid++;
+	trace_local->next = trace_bufs;
+	trace_bufs = trace_local;
+
+	pthread_mutex_unlock(&trace_lock);
+
+	return trace_local;
+}
+
+/* Record a span of the calling thread */
+void ldns_mergezone_trace_span(const uint64_t start, const char* cat, const char* name)
+{
+	trace_buf*	buf	= ldns_mergezone_trace_local();
+	trace_event*	event	= &buf->events[buf->count++];
+
+	event->cat = cat;
+	event->name = name;
+	event->start = start;
+	event->end = ldns_mergezone_trace_now();
+}
+
+/* Name the calling thread */
+void ldns_mergezone_trace_thread(const char* name)
+{
+	ldns_mergezone_trace_local()->thread_name = name;
+}
+
+/* Stop tracing and write the trace in the trace event format; all traced threads must have finished */
+int ldns_mergezone_trace_write(const char* trace_file)
+{
+	assert(trace_file != NULL);
+
+	FILE*		fp	= fopen(trace_file, "w");
+	trace_buf*	buf	= NULL;
+	const char*	sep	= "";
+	int		pid	= (int) getpid();
+	int		rv	= 0;
+	size_t		i	= 0;
+
+	trace_enabled = 0;
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", trace_file);
+
+		rv = 1;
+	}
+	else
+	{
+		fprintf(fp, "{\"traceEvents\":[\n");
+
+		for (buf = trace_bufs; buf != NULL; buf = buf->next)
+		{
+			/* Threads with more than one buffer are named more than once, which does no harm */
+			if (buf->thread_name != NULL)
+			{
+				fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", sep, pid, buf->tid, buf->thread_name);
+
+				sep = ",\n";
+			}
+
+			for (i = 0; i < buf->count; i++)
+			{
+				const trace_event*	event	= &buf->events[i];
+
+				fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					sep, event->name, event->cat, pid, buf->tid,
+					(event->start - trace_origin) / 1e3, (event->end - event->start) / 1e3);
+
+				sep = ",\n";
+			}
+		}
+
+		fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+		if (fclose(fp) != 0)
+		{
+			fprintf(stderr, "Failed to write trace to %s\n", trace_file);
+
+			rv = 1;
+		}
+	}
+
+	while (trace_bufs != NULL)
+	{
+		buf = trace_bufs;
+		trace_bufs = buf->next;
+
+		free(buf);
+	}
+
+	trace_local = NULL;
+
+	return rv;
+}
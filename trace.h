@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_TRACE_H
+#define _LDNS_MERGEZONE_TRACE_H
+
+#include <stdint.h>
+
+extern int trace_enabled;
+
+/* Record the start of a span in a uint64_t */
+#define TRACE_BEGIN(start) { if (trace_enabled) (start) = ldns_mergezone_trace_now(); }
+
+/* Record a span that started at start; the category and name must be string constants */
+#define TRACE_END(start, cat, name) { if (trace_enabled) ldns_mergezone_trace_span((start), (cat), (name)); }
+
+/* Name the calling thread in the trace; the name must be a string constant */
+#define TRACE_THREAD(name) { if (trace_enabled) ldns_mergezone_trace_thread(name); }
+
+/* Start tracing */
+void ldns_mergezone_trace_start(void);
+
+/* Get the current time for a span */
+uint64_t ldns_mergezone_trace_now(void);
+
+/* Record a span of the calling thread */
+void ldns_mergezone_trace_span(const uint64_t start, const char* cat, const char* name);
+
+/* Name the calling thread */
+void ldns_mergezone_trace_thread(const char* name);
+
+/* Stop tracing and write the trace in the trace event format; all traced threads must have finished */
+int ldns_mergezone_trace_write(const char* trace_file);
+
+#endif /* !_LDNS_MERGEZONE_TRACE_H */
@@ -36,7 +36,9 @@
 #include <time.h>
 #include <assert.h>
 #include "verify.h"
+#include "dname.h"
 #include "verbose.h"
+#include "trace.h"
 
 /* Verify that the SOA serial and origin for the zones match */
 int ldns_mergezone_verify_soa_and_origin(ldns_zone* left, ldns_zone* right)
@@ -44,19 +46,21 @@ int ldns_mergezone_verify_soa_and_origin(ldns_zone* left, ldns_zone* right)
 	assert(left != NULL);
 	assert(right != NULL);
 
-	ldns_rr*	left_soa		= NULL;
-	uint32_t	left_soa_serial		= 0;
-	ldns_rr*	right_soa		= NULL;
-	uint32_t	right_soa_serial	= 0;
-	char*		left_soa_owner		= NULL;
-	char*		right_soa_owner		= NULL;
-
 	if ((left == NULL) || (right == NULL))
 	{
 		return 1;
 	}
 
-	left_soa = ldns_zone_soa(left);
+	return ldns_mergezone_verify_soa_records(ldns_zone_soa(left), ldns_zone_soa(right));
+}
+
+/* Verify that the serial and owner name of two SOA records match */
+int ldns_mergezone_verify_soa_records(ldns_rr* left_soa, ldns_rr* right_soa)
+{
+	uint32_t	left_soa_serial		= 0;
+	uint32_t	right_soa_serial	= 0;
+	char*		left_soa_owner		= NULL;
+	char*		right_soa_owner		= NULL;
 
 	if (left_soa == NULL)
 	{
@@ -70,8 +74,6 @@ int ldns_mergezone_verify_soa_and_origin(ldns_zone* left, ldns_zone* right)
 
 	VERBOSE("Left-hand zone has SOA serial %u\n", left_soa_serial);
 
-	right_soa = ldns_zone_soa(right);
-
 	if (right_soa == NULL)
 	{
 		fprintf(stderr, "Right-hand zone is missing an SOA record\n");
@@ -94,7 +96,7 @@ int ldns_mergezone_verify_soa_and_origin(ldns_zone* left, ldns_zone* right)
 	left_soa_owner = ldns_rdf2str(ldns_rr_owner(left_soa));
 	right_soa_owner = ldns_rdf2str(ldns_rr_owner(right_soa));
 
-	if (strcasecmp(left_soa_owner, right_soa_owner) != 0)
+	if (!ldns_mergezone_dname_rdf_equal(ldns_rr_owner(left_soa), ldns_rr_owner(right_soa)))
 	{
 		fprintf(stderr, "Owner name of left- and right-hand SOA record differs (%s != %s)\n", left_soa_owner, right_soa_owner);
 
@@ -165,6 +167,9 @@ int ldns_mergezone_verify_validate_dnskey_sig(ldns_rr_list* dnskey_set, ldns_rr_
 	size_t		i			= 0;
 	int 		all_rrsigs_valid	= 1;
 	ldns_rr_list*	valid_keys		= ldns_rr_list_new();
+	uint64_t	start			= 0;
+
+	TRACE_BEGIN(start);
 
 	for (i = 0; i < ldns_rr_list_rr_count(dnskey_rrsigs); i++)
 	{
@@ -183,6 +188,8 @@ int ldns_mergezone_verify_validate_dnskey_sig(ldns_rr_list* dnskey_set, ldns_rr_
 	/* Clean up */
 	ldns_rr_list_free(valid_keys);
 
+	TRACE_END(start, "validate", "validate DNSKEY RRset");
+
 	if (all_rrsigs_valid)
 	{
 		VERBOSE("Validation of provided signatures over provided DNSKEY RRset succeeded\n");
@@ -218,3 +225,355 @@ int ldns_mergezone_verify_dnskey_set_contains_algo(ldns_rr_list* dnskey_set, int
 	return 1;
 }
 
+
+/* Verify the DNSKEY RRsets of the input zones against the requirements for the output zone type */
+int ldns_mergezone_verify_output_dnskeys(const int out_type, ldns_rr_list* from_dnskeys, ldns_rr_list* from_dnskey_rrsigs, const int from_algo, ldns_rr_list* to_dnskeys, ldns_rr_list* to_dnskey_rrsigs, const int to_algo, ldns_rr_list** output_dnskeys)
+{
+	assert(from_dnskeys != NULL);
+	assert(from_dnskey_rrsigs != NULL);
+	assert(to_dnskeys != NULL);
+	assert(to_dnskey_rrsigs != NULL);
+	assert(output_dnskeys != NULL);
+
+	/* Validate correct content of DNSKEY RRsets based on the desired output zone */
+	switch(out_type)
+	{
+	case 1:
+		/* 
+		 * From zone must contain DNSKEYs with the 'from' algorithm,
+		 * but not with the 'to' algorithm.
+		 *
+		 * To zone must contain DNSKEYs with the 'from' algorithm,
+		 * and with the 'to' algorithm.
+		 */
+		{
+			VERBOSE("Verifying the \"From\" zone only contains DNSKEYs with the \"from\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, from_algo) != 0)
+			{
+				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, to_algo) == 0)
+			{
+				fprintf(stderr, "\"From\" zone contains DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+
+			VERBOSE("Verifying the \"To\" zone contains DNSKEYs for both the \"from\" and the \"to\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, from_algo) != 0)
+			{
+				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, to_algo) != 0)
+			{
+				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
+
+			*output_dnskeys = from_dnskeys;
+
+			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"From\" zone\n");
+
+			if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, from_dnskey_rrsigs) != 0)
+			{
+				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+				return 1;
+			}
+		}
+		break;
+	case 2:
+		/* 
+		 * From zone must contain DNSKEYs with the 'from' algorithm,
+		 * and with the 'to' algorithm.
+		 *
+		 * To zone must contain DNSKEYs with the 'from' algorithm,
+		 * and with the 'to' algorithm.
+		 */
+		{
+			VERBOSE("Verifying the \"From\" zone contains DNSKEYs with both the \"from\" and the \"to\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, from_algo) != 0)
+			{
+				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, to_algo) != 0)
+			{
+				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+
+			VERBOSE("Verifying the \"To\" zone contains DNSKEYs for both the \"from\" and the \"to\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, from_algo) != 0)
+			{
+				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, to_algo) != 0)
+			{
+				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
+
+			*output_dnskeys = to_dnskeys;
+
+			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"From\" and the \"To\" zone\n");
+
+			if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, from_dnskey_rrsigs) != 0)
+			{
+				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, to_dnskey_rrsigs) != 0)
+			{
+				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+				return 1;
+			}
+		}
+		break;
+	case 3:
+		/* 
+		 * From zone must contain DNSKEYs with the 'from' algorithm,
+		 * and with the 'to' algorithm.
+		 *
+		 * To zone must not contain DNSKEYs with the 'from' algorithm,
+		 * but only with the 'to' algorithm.
+		 */
+		{
+			VERBOSE("Verifying the \"From\" zone contains DNSKEYs with both the \"from\" and the \"to\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, from_algo) != 0)
+			{
+				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, to_algo) != 0)
+			{
+				fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+
+			VERBOSE("Verifying the \"To\" zone only contains DNSKEYs for the \"to\" algorithm\n");
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, from_algo) == 0)
+			{
+				fprintf(stderr, "\"To\" zone contains DNSKEYs with the \"from\" algorithm\n");
+
+				return 1;
+			}
+
+			if (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys, to_algo) != 0)
+			{
+				fprintf(stderr, "\"To\" zone does not contain DNSKEYs with the \"to\" algorithm\n");
+
+				return 1;
+			}
+
+			VERBOSE("Verification of \"To\" DNSKEY RRset successful\n");
+			
+			*output_dnskeys = to_dnskeys;
+
+			VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"To\" zone\n");
+
+			if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, to_dnskey_rrsigs) != 0)
+			{
+				fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+				return 1;
+			}
+		}
+		break;
+	default:
+		assert(0 == 1);	/* We should never get here, but hey... */
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Verify the DNSKEY RRsets of more than two input zones. The "to" zones
+ * take the place of the single "to" zone, with the keys of all "to"
+ * algorithms where that zone has the key of the "to" algorithm:
+ *
+ * 1: the "from" zone only contains keys of the "from" algorithm, and each
+ *    "to" zone contains keys of the "from" algorithm and its own algorithm.
+ *    The output DNSKEY RRset is that of the "from" zone.
+ * 2: every zone contains keys of all algorithms, and the output DNSKEY
+ *    RRset must validate against the signatures of every zone.
+ * 3: the "from" zone contains keys of all algorithms, and the "to" zones
+ *    contain keys of all "to" algorithms but not of the "from" algorithm.
+ *    The output DNSKEY RRset must validate against the signatures of every
+ *    "to" zone.
+ */
+int ldns_mergezone_verify_output_dnskeys_multi(const int out_type, ldns_rr_list* from_dnskeys, ldns_rr_list* from_dnskey_rrsigs, const int from_algo, ldns_rr_list** to_dnskeys, ldns_rr_list** to_dnskey_rrsigs, const int* to_algos, const size_t to_count, ldns_rr_list** output_dnskeys)
+{
+	assert(from_dnskeys != NULL);
+	assert(from_dnskey_rrsigs != NULL);
+	assert(to_dnskeys != NULL);
+	assert(to_dnskey_rrsigs != NULL);
+	assert(to_algos != NULL);
+	assert(to_count > 0);
+	assert(output_dnskeys != NULL);
+	assert((out_type >= 1) && (out_type <= 3));
+
+	size_t	i	= 0;
+	size_t	j	= 0;
+
+	/* The zones must each be signed with a different algorithm */
+	for (i = 0; i < to_count; i++)
+	{
+		if (to_algos[i] == from_algo)
+		{
+			fprintf(stderr, "\"To\" zone %zu is signed with the same algorithm (%d) as the \"From\" zone\n", i + 1, from_algo);
+
+			return 1;
+		}
+
+		for (j = 0; j < i; j++)
+		{
+			if (to_algos[i] == to_algos[j])
+			{
+				fprintf(stderr, "\"To\" zones %zu and %zu are signed with the same algorithm (%d)\n", j + 1, i + 1, to_algos[i]);
+
+				return 1;
+			}
+		}
+	}
+
+	VERBOSE("Verifying the DNSKEY RRset of the \"From\" zone for output type %d\n", out_type);
+
+	if (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, from_algo) != 0)
+	{
+		fprintf(stderr, "\"From\" zone does not contain DNSKEYs with the \"from\" algorithm\n");
+
+		return 1;
+	}
+
+	for (i = 0; i < to_count; i++)
+	{
+		int	found	= (ldns_mergezone_verify_dnskey_set_contains_algo(from_dnskeys, to_algos[i]) == 0);
+
+		if ((out_type == 1) && found)
+		{
+			fprintf(stderr, "\"From\" zone contains DNSKEYs with algorithm %d\n", to_algos[i]);
+
+			return 1;
+		}
+
+		if ((out_type != 1) && !found)
+		{
+			fprintf(stderr, "\"From\" zone does not contain DNSKEYs with algorithm %d\n", to_algos[i]);
+
+			return 1;
+		}
+	}
+
+	VERBOSE("Verification of \"From\" DNSKEY RRset successful\n");
+
+	for (i = 0; i < to_count; i++)
+	{
+		int	found	= (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys[i], from_algo) == 0);
+
+		VERBOSE("Verifying the DNSKEY RRset of \"To\" zone %zu for output type %d\n", i + 1, out_type);
+
+		if ((out_type == 3) && found)
+		{
+			fprintf(stderr, "\"To\" zone %zu contains DNSKEYs with the \"from\" algorithm\n", i + 1);
+
+			return 1;
+		}
+
+		if ((out_type != 3) && !found)
+		{
+			fprintf(stderr, "\"To\" zone %zu does not contain DNSKEYs with the \"from\" algorithm\n", i + 1);
+
+			return 1;
+		}
+
+		/* In the first output zone, only the zone's own "to" algorithm is required */
+		for (j = 0; j < to_count; j++)
+		{
+			if (((out_type != 1) || (j == i)) && (ldns_mergezone_verify_dnskey_set_contains_algo(to_dnskeys[i], to_algos[j]) != 0))
+			{
+				fprintf(stderr, "\"To\" zone %zu does not contain DNSKEYs with algorithm %d\n", i + 1, to_algos[j]);
+
+				return 1;
+			}
+		}
+
+		VERBOSE("Verification of \"To\" zone %zu DNSKEY RRset successful\n", i + 1);
+	}
+
+	if (out_type == 1)
+	{
+		*output_dnskeys = from_dnskeys;
+
+		VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from the \"From\" zone\n");
+
+		if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, from_dnskey_rrsigs) != 0)
+		{
+			fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+			return 1;
+		}
+
+		return 0;
+	}
+
+	*output_dnskeys = to_dnskeys[0];
+
+	VERBOSE("Verifying that the output DNSKEY RRset validates against the RRSIG(s) from %s\n", (out_type == 2) ? "all zones" : "all \"To\" zones");
+
+	if ((out_type == 2) && (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, from_dnskey_rrsigs) != 0))
+	{
+		fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+		return 1;
+	}
+
+	for (i = 0; i < to_count; i++)
+	{
+		if (ldns_mergezone_verify_validate_dnskey_sig(*output_dnskeys, to_dnskey_rrsigs[i]) != 0)
+		{
+			fprintf(stderr, "Output DNSKEY RRset RRSIG(s) validation failed\n");
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -40,6 +40,9 @@
 /* Verify that the SOA serial and origin for the zones match */
 int ldns_mergezone_verify_soa_and_origin(ldns_zone* left, ldns_zone* right);
 
+/* Verify that the serial and owner name of two SOA records match */
+int ldns_mergezone_verify_soa_records(ldns_rr* left_soa, ldns_rr* right_soa);
+
 /* Verify and retrieve the single signing algorithm in the zone */
 int ldns_mergezone_verify_and_fetch_single_algo(ldns_zone* zone_to_verify, int* algo_id);
 
@@ -49,5 +52,11 @@ int ldns_mergezone_verify_validate_dnskey_sig(ldns_rr_list* dnskey_set, ldns_rr_
 /* Verify if the specified DNSKEY set contains keys with the specified algorithm */
 int ldns_mergezone_verify_dnskey_set_contains_algo(ldns_rr_list* dnskey_set, int algo);
 
+/* Verify the DNSKEY RRsets of the input zones against the requirements for the output zone type */
+int ldns_mergezone_verify_output_dnskeys(const int out_type, ldns_rr_list* from_dnskeys, ldns_rr_list* from_dnskey_rrsigs, const int from_algo, ldns_rr_list* to_dnskeys, ldns_rr_list* to_dnskey_rrsigs, const int to_algo, ldns_rr_list** output_dnskeys);
+
+/* Verify the DNSKEY RRsets of the "from" zone and several "to" zones against the requirements for the output zone type */
+int ldns_mergezone_verify_output_dnskeys_multi(const int out_type, ldns_rr_list* from_dnskeys, ldns_rr_list* from_dnskey_rrsigs, const int from_algo, ldns_rr_list** to_dnskeys, ldns_rr_list** to_dnskey_rrsigs, const int* to_algos, const size_t to_count, ldns_rr_list** output_dnskeys);
+
 #endif /* !_LDNS_MERGEZONE_VERIFY_H */
 
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include "writer.h"
+#include "verbose.h"
+#include "trace.h"
+
+/*
+ * The output zone is written through large page-aligned buffers, instead
+ * of through stdio and its small buffer. Disk space for the expected size
+ * of the output is reserved up front with fallocate(), so the file does
+ * not grow a little with every write and a full disk is noticed before
+ * the merge starts instead of when it is nearly done. If the output turns
+ * out to be larger, more space is reserved in big steps; once everything
+ * has been written, the file is trimmed to its exact size. Where space
+ * cannot be reserved (e.g. not on Linux, or on a file system or file type
+ * that does not support it) the output is simply written.
+ *
+ * For regular files, full buffers are queued with io_uring and the next
+ * buffer is filled while they are written; the writer only waits when
+ * all buffers are in flight. Written ranges are handed to writeback
+ * straight away and dropped from the page cache a few buffers later. If
+ * io_uring is not available, buffers are written with plain write().
+ */
+
+/* Size of each write buffer */
+#define WRITER_BUF_SIZE		(4 * 1024 * 1024)
+
+/* Alignment of the write buffers */
+#define WRITER_BUF_ALIGN	4096
+
+/* Minimum amount of space reserved when the output grows beyond the reservation */
+#define WRITER_MIN_RESERVE	((off_t) 64 * 1024 * 1024)
+
+/* Reserve disk space up to the specified size */
+static int ldns_mergezone_writer_reserve(zone_writer* writer, const off_t size)
+{
+	off_t	new_size	= 0;
+
+	if (!writer->preallocate || (size <= writer->reserved))
+	{
+		return 0;
+	}
+
+	new_size = size;
+
+	/* Once past the expected size, grow in big steps */
+	if (writer->reserved > 0)
+	{
+		new_size = writer->reserved + ((writer->reserved / 8 > WRITER_MIN_RESERVE) ? writer->reserved / 8 : WRITER_MIN_RESERVE);
+
+		if (new_size < size)
+		{
+			new_size = size;
+		}
+	}
+
+#ifdef __linux__
+	if (fallocate(writer->fd, 0, writer->reserved, new_size - writer->reserved) == 0)
+	{
+		writer->reserved = new_size;
+
+		return 0;
+	}
+
+	if (errno == ENOSPC)
+	{
+		fprintf(stderr, "Not enough disk space for %s (%lld bytes needed)\n", writer->name, (long long) size);
+
+		return 1;
+	}
+#endif /* __linux__ */
+
+	/* Reserving space is not supported, just write */
+	writer->preallocate = 0;
+
+	return 0;
+}
+
+/* Write data synchronously, at the specified offset for regular files */
+static int ldns_mergezone_writer_write_sync(zone_writer* writer, const uint8_t* data, size_t len, off_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t	rv	= writer->regular ? pwrite(writer->fd, data, len, offset) : write(writer->fd, data, len);
+
+		if (rv < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			fprintf(stderr, "Failed to write to %s (%s)\n", writer->name, strerror(errno));
+
+			return 1;
+		}
+
+		data += rv;
+		len -= rv;
+		offset += rv;
+	}
+
+	return 0;
+}
+
+/* Keep the page cache from filling up with output that has been written */
+static void ldns_mergezone_writer_written(zone_writer* writer, const off_t offset, const size_t len)
+{
+	if (!writer->regular)
+	{
+		return;
+	}
+
+#ifdef __linux__
+	sync_file_range(writer->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+#endif /* __linux__ */
+
+	/* Drop what was handed to writeback a few buffers ago */
+	if ((offset - writer->dropped) >= (off_t) (WRITER_BUFS * WRITER_BUF_SIZE))
+	{
+		posix_fadvise(writer->fd, writer->dropped, offset - WRITER_BUF_SIZE - writer->dropped, POSIX_FADV_DONTNEED);
+
+		writer->dropped = offset - WRITER_BUF_SIZE;
+	}
+}
+
+/* Wait until the write of the specified buffer has completed */
+static int ldns_mergezone_writer_wait(zone_writer* writer, const int buf)
+{
+	int	rv	= 0;
+
+	while (writer->pending[buf])
+	{
+		uint64_t	done	= 0;
+		int		res	= 0;
+
+		if (ldns_mergezone_aio_wait(&writer->ring, &done, &res) != 0)
+		{
+			fprintf(stderr, "Failed to wait for writes to %s (%s)\n", writer->name, strerror(errno));
+
+			return 1;
+		}
+
+		assert(done < WRITER_BUFS);
+
+		writer->pending[done] = 0;
+
+		if (res < 0)
+		{
+			fprintf(stderr, "Failed to write to %s (%s)\n", writer->name, strerror(-res));
+
+			rv = 1;
+		}
+		else if ((rv == 0) &&
+		         (ldns_mergezone_writer_write_sync(writer, &writer->bufs[done][res], writer->iov[done].iov_len - res, writer->buf_offset[done] + res) != 0))
+		{
+			/* Completed a short write */
+			rv = 1;
+		}
+		else if (rv == 0)
+		{
+			ldns_mergezone_writer_written(writer, writer->buf_offset[done], writer->iov[done].iov_len);
+		}
+	}
+
+	return rv;
+}
+
+/* Write out the current buffer and switch to the next one */
+static int ldns_mergezone_writer_flush(zone_writer* writer)
+{
+	int		buf	= writer->cur;
+	uint64_t	start	= 0;
+	int		rv	= 0;
+
+	if (writer->buf_used == 0)
+	{
+		return 0;
+	}
+
+	TRACE_BEGIN(start);
+
+	writer->iov[buf].iov_base = writer->bufs[buf];
+	writer->iov[buf].iov_len = writer->buf_used;
+	writer->buf_offset[buf] = writer->written;
+
+	writer->written += writer->buf_used;
+	writer->buf_used = 0;
+
+	if (writer->use_ring)
+	{
+		if (ldns_mergezone_aio_submit(&writer->ring, AIO_OP_WRITE, writer->fd, &writer->iov[buf], writer->buf_offset[buf], buf) != 0)
+		{
+			fprintf(stderr, "Failed to queue write to %s\n", writer->name);
+
+			return 1;
+		}
+
+		writer->pending[buf] = 1;
+		writer->cur = (buf + 1) % WRITER_BUFS;
+
+		/* Waiting for the write that used the next buffer before is part of the flush */
+		rv = ldns_mergezone_writer_wait(writer, writer->cur);
+	}
+	else if ((rv = ldns_mergezone_writer_write_sync(writer, writer->bufs[buf], writer->iov[buf].iov_len, writer->buf_offset[buf])) == 0)
+	{
+		ldns_mergezone_writer_written(writer, writer->buf_offset[buf], writer->iov[buf].iov_len);
+	}
+
+	TRACE_END(start, "output", "flush");
+
+	return rv;
+}
+
+/* Release the resources of the writer */
+static void ldns_mergezone_writer_free(zone_writer* writer)
+{
+	int	i	= 0;
+
+	for (i = 0; i < WRITER_BUFS; i++)
+	{
+		if (writer->pending[i])
+		{
+			ldns_mergezone_writer_wait(writer, i);
+		}
+
+		/* The kernel may still read from a buffer whose write never completed */
+		if (!writer->pending[i])
+		{
+			free(writer->bufs[i]);
+		}
+
+		writer->bufs[i] = NULL;
+	}
+
+	if (writer->use_ring)
+	{
+		ldns_mergezone_aio_free(&writer->ring);
+	}
+}
+
+/* Create the output file, reserving disk space for the expected size (0 if not known) */
+int ldns_mergezone_writer_open(zone_writer* writer, const char* out_file, const off_t size_hint)
+{
+	assert(writer != NULL);
+	assert(out_file != NULL);
+
+	struct stat	st;
+	int		i	= 0;
+
+	memset(writer, 0, sizeof(zone_writer));
+
+	writer->name = out_file;
+	writer->fd = open(out_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if (writer->fd < 0)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", out_file);
+
+		return 1;
+	}
+
+	/* Only reserve space and write asynchronously for regular files, not for e.g. /dev/stdout */
+	writer->regular = (fstat(writer->fd, &st) == 0) && S_ISREG(st.st_mode);
+	writer->preallocate = writer->regular;
+	writer->use_ring = writer->regular && (ldns_mergezone_aio_init(&writer->ring, WRITER_BUFS) == 0);
+
+	for (i = 0; i < (writer->use_ring ? WRITER_BUFS : 1); i++)
+	{
+		if (posix_memalign((void**) &writer->bufs[i], WRITER_BUF_ALIGN, WRITER_BUF_SIZE) != 0)
+		{
+			fprintf(stderr, "Failed to allocate output buffer for %s\n", out_file);
+
+			writer->bufs[i] = NULL;
+
+			ldns_mergezone_writer_free(writer);
+			close(writer->fd);
+
+			return 1;
+		}
+	}
+
+	if (size_hint > 0)
+	{
+		VERBOSE("Reserving %lld bytes for %s\n", (long long) size_hint, out_file);
+
+		if (ldns_mergezone_writer_reserve(writer, size_hint) != 0)
+		{
+			ldns_mergezone_writer_free(writer);
+			close(writer->fd);
+			unlink(out_file);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Append data to the output file */
+int ldns_mergezone_writer_write(zone_writer* writer, const void* data, const size_t len)
+{
+	assert(writer != NULL);
+	assert(writer->bufs[writer->cur] != NULL);
+
+	const uint8_t*	in	= (const uint8_t*) data;
+	size_t		left	= len;
+
+	if (ldns_mergezone_writer_reserve(writer, writer->written + writer->buf_used + len) != 0)
+	{
+		return 1;
+	}
+
+	while (left > 0)
+	{
+		size_t	copy	= WRITER_BUF_SIZE - writer->buf_used;
+
+		if (copy > left)
+		{
+			copy = left;
+		}
+
+		memcpy(&writer->bufs[writer->cur][writer->buf_used], in, copy);
+
+		writer->buf_used += copy;
+		in += copy;
+		left -= copy;
+
+		if ((writer->buf_used == WRITER_BUF_SIZE) && (ldns_mergezone_writer_flush(writer) != 0))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Write out buffered data, trim the file to the size written and close it */
+int ldns_mergezone_writer_close(zone_writer* writer)
+{
+	assert(writer != NULL);
+
+	int	rv	= 0;
+	int	i	= 0;
+
+	if (ldns_mergezone_writer_flush(writer) != 0)
+	{
+		rv = 1;
+	}
+
+	for (i = 0; i < WRITER_BUFS; i++)
+	{
+		if (ldns_mergezone_writer_wait(writer, i) != 0)
+		{
+			rv = 1;
+		}
+	}
+
+	/* Give back the space that was reserved but not used */
+	if ((rv == 0) && (writer->reserved > writer->written) && (ftruncate(writer->fd, writer->written) != 0))
+	{
+		fprintf(stderr, "Failed to truncate %s (%s)\n", writer->name, strerror(errno));
+
+		rv = 1;
+	}
+
+	ldns_mergezone_writer_free(writer);
+
+	if ((close(writer->fd) != 0) && (rv == 0))
+	{
+		fprintf(stderr, "Failed to write %s (%s)\n", writer->name, strerror(errno));
+
+		rv = 1;
+	}
+
+	writer->fd = -1;
+
+	return rv;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_WRITER_H
+#define _LDNS_MERGEZONE_WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "aio.h"
+
+/* Number of output buffers, so that writes can be in progress while the next buffer is filled */
+#define WRITER_BUFS	4
+
+/* Output file writer */
+typedef struct
+{
+	int		fd;
+	const char*	name;
+	uint8_t*	bufs[WRITER_BUFS];
+	struct iovec	iov[WRITER_BUFS];
+	off_t		buf_offset[WRITER_BUFS];
+	int		pending[WRITER_BUFS];
+	int		cur;
+	size_t		buf_used;
+	off_t		written;
+	off_t		reserved;
+	off_t		dropped;
+	int		regular;
+	int		preallocate;
+	int		use_ring;
+	aio_ring	ring;
+}
+zone_writer;
+
+/* Create the output file, reserving disk space for the expected size (0 if not known) */
+int ldns_mergezone_writer_open(zone_writer* writer, const char* out_file, const off_t size_hint);
+
+/* Append data to the output file */
+int ldns_mergezone_writer_write(zone_writer* writer, const void* data, const size_t len);
+
+/* Write out buffered data, trim the file to the size written and close it */
+int ldns_mergezone_writer_close(zone_writer* writer);
+
+#endif /* !_LDNS_MERGEZONE_WRITER_H */
@@ -0,0 +1,1180 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ldns/ldns.h>
+#include <openssl/evp.h>
+#include <assert.h>
+#include "zonemd.h"
+#include "ring.h"
+#include "reader.h"
+#include "sort.h"
+#include "format.h"
+#include "threads.h"
+#include "verbose.h"
+#include "progress.h"
+#include "trace.h"
+#include "replace.h"
+
+/*
+ * The digest is computed over the zone file as written by the tool, which
+ * has one record per line. The file is mapped into memory and split into
+ * batches of lines in the calling thread. The batches are handed out in
+ * turn to a number of parser threads, and collected from them in the same
+ * turn by the thread that puts the records in canonical form, so they stay
+ * in the order of the file. That thread passes the canonical wire format
+ * on in large chunks to the thread that computes the SHA-384 hash.
+ *
+ * The records of each RRset are sorted and duplicates are left out, as
+ * RFC 8976 requires; the RRsets themselves must already be in canonical
+ * order, except for the SOA record that the tool writes first. As soon as
+ * an RRset turns up out of order, the digest is abandoned and computed
+ * over a sorted copy of the zone in a temporary file instead. The zone
+ * itself keeps its order: it is parsed once more only to find the lines
+ * to leave out, and the ZONEMD record goes right after its SOA record. The
+ * apex ZONEMD RRset and the signatures over it are left out of the digest
+ * and out of the new file.
+ *
+ * In a signed zone, the NSEC or NSEC3 record of the apex must already list
+ * the ZONEMD type, which means the signers must have been given a
+ * placeholder ZONEMD record; otherwise no record is added. The ZONEMD
+ * record is not signed here, as the tool does not have the private keys;
+ * it can be written to a separate file for signing, after which the
+ * signatures can be added to the zone.
+ *
+ * Finally, the file is copied to a temporary file next to it with the
+ * ZONEMD record inserted in its place, which replaces the original file.
+ */
+
+/* Number of lines per batch */
+#define ZONEMD_BATCH		256
+
+/* Number of batches or chunks each ring can hold */
+#define ZONEMD_RING_SIZE	64
+
+/* Size of the chunks of canonical wire format that are hashed */
+#define ZONEMD_CHUNK		(256 * 1024)
+
+/* Maximum number of parser threads */
+#define ZONEMD_MAX_PARSERS	8
+
+/* Lines of the zone file, and the records parsed from them */
+typedef struct
+{
+	size_t		count;
+	size_t		offsets[ZONEMD_BATCH];
+	size_t		ends[ZONEMD_BATCH];
+	ldns_rr*	rrs[ZONEMD_BATCH];
+}
+zonemd_batch;
+
+/* Canonical wire format to hash */
+typedef struct
+{
+	size_t		len;
+	uint8_t		data[ZONEMD_CHUNK];
+}
+zonemd_chunk;
+
+/* Part of the file that is left out */
+typedef struct
+{
+	size_t		offset;
+	size_t		end;
+}
+zonemd_range;
+
+/* Parser thread */
+typedef struct
+{
+	const uint8_t*	data;
+	int*		failed;
+	zone_reader	reader;
+	ring		in;
+	ring		out;
+	pthread_t	thread;
+	int		started;
+}
+zonemd_parser;
+
+/* State of the digest of one zone file */
+typedef struct
+{
+	const char*	name;
+	const uint8_t*	data;
+	size_t		size;
+	zonemd_parser	parsers[ZONEMD_MAX_PARSERS];
+	int		num_parsers;
+	ring		chunks;
+	zonemd_chunk*	chunk;
+	int		failed;
+	int		unsorted;
+	const ldns_rdf*	apex;
+	ldns_rdf*	nsec3_apex;
+	int		nsec_found;
+	int		nsec_zonemd;
+	ldns_rr*	soa;
+	ldns_buffer*	soa_wire;
+	ldns_rdf*	set_owner;
+	ldns_rr_type	set_type;
+	ldns_buffer*	set_wire;
+	size_t*		set_lens;
+	size_t		set_count;
+	size_t		set_alloc;
+	zonemd_range*	dropped;
+	size_t		dropped_count;
+	size_t		dropped_alloc;
+	size_t		insert_offset;
+	int		insert_found;
+	uint8_t		digest[ZONEMD_DIGEST_LEN];
+}
+zonemd_pass;
+
+static void ldns_mergezone_zonemd_fail(int* failed)
+{
+	__atomic_store_n(failed, 1, __ATOMIC_RELEASE);
+}
+
+static int ldns_mergezone_zonemd_failed(int* failed)
+{
+	return __atomic_load_n(failed, __ATOMIC_ACQUIRE);
+}
+
+static void ldns_mergezone_zonemd_free_batch(zonemd_batch* batch)
+{
+	size_t	i	= 0;
+
+	for (i = 0; i < batch->count; i++)
+	{
+		ldns_rr_free(batch->rrs[i]);
+	}
+
+	free(batch);
+}
+
+/* Length of a line without its comment and trailing white space */
+static size_t ldns_mergezone_zonemd_line_len(const char* line, const size_t len)
+{
+	size_t	i	= 0;
+	int	quoted	= 0;
+
+	for (i = 0; i < len; i++)
+	{
+		if (line[i] == '\\')
+		{
+			i++;
+		}
+		else if (line[i] == '"')
+		{
+			quoted = !quoted;
+		}
+		else if ((line[i] == ';') && !quoted)
+		{
+			break;
+		}
+	}
+
+	i = (i < len) ? i : len;
+
+	while ((i > 0) && ((line[i - 1] == ' ') || (line[i - 1] == '\t') || (line[i - 1] == '\r')))
+	{
+		i--;
+	}
+
+	return i;
+}
+
+/* Parser stage: parse the lines of each batch */
+static void* ldns_mergezone_zonemd_parse(void* arg)
+{
+	zonemd_parser*	parser	= (zonemd_parser*) arg;
+	zonemd_batch*	batch	= NULL;
+	char*		line	= (char*) malloc(LDNS_MAX_LINELEN + 1);
+	size_t		i	= 0;
+	uint64_t	start	= 0;
+
+	assert(line != NULL);
+
+	TRACE_THREAD("zonemd parse");
+
+	while ((batch = (zonemd_batch*) ldns_mergezone_ring_pop(&parser->in)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		for (i = 0; (i < batch->count) && !ldns_mergezone_zonemd_failed(parser->failed); i++)
+		{
+			const char*	text	= (const char*) parser->data + batch->offsets[i];
+			size_t		len	= ldns_mergezone_zonemd_line_len(text, batch->ends[i] - batch->offsets[i]);
+
+			if (len > LDNS_MAX_LINELEN)
+			{
+				fprintf(stderr, "Line too long in %s\n", parser->reader.name);
+
+				ldns_mergezone_zonemd_fail(parser->failed);
+
+				break;
+			}
+
+			memcpy(line, text, len);
+
+			line[len] = '\0';
+
+			if ((ldns_mergezone_reader_parse(&parser->reader, line, 0, &batch->rrs[i]) != 0) || (batch->rrs[i] == NULL))
+			{
+				fprintf(stderr, "Failed to parse record at offset %zd of %s\n", batch->offsets[i], parser->reader.name);
+
+				ldns_mergezone_zonemd_fail(parser->failed);
+			}
+		}
+
+		TRACE_END(start, "zonemd", "parse");
+
+		ldns_mergezone_ring_push(&parser->out, batch);
+	}
+
+	ldns_mergezone_ring_push(&parser->out, NULL);
+
+	free(line);
+
+	return NULL;
+}
+
+/* Append canonical wire format to the data to hash */
+static void ldns_mergezone_zonemd_hash_data(zonemd_pass* p, const uint8_t* data, const size_t len)
+{
+	if ((p->chunk != NULL) && (p->chunk->len + len > ZONEMD_CHUNK))
+	{
+		ldns_mergezone_ring_push(&p->chunks, p->chunk);
+
+		p->chunk = NULL;
+	}
+
+	if (p->chunk == NULL)
+	{
+		p->chunk = (zonemd_chunk*) malloc(sizeof(zonemd_chunk));
+
+		assert(p->chunk != NULL);
+
+		p->chunk->len = 0;
+	}
+
+	memcpy(p->chunk->data + p->chunk->len, data, len);
+
+	p->chunk->len += len;
+}
+
+/* Hash the records of the current RRset in canonical order, leaving out duplicates */
+static void ldns_mergezone_zonemd_flush_set(zonemd_pass* p)
+{
+	sort_rec*	recs	= NULL;
+	size_t		pos	= 0;
+	size_t		i	= 0;
+
+	if (p->set_count == 0)
+	{
+		return;
+	}
+
+	recs = (sort_rec*) malloc((p->set_count + 1) * sizeof(sort_rec));
+
+	assert(recs != NULL);
+
+	for (i = 0; i < p->set_count; i++)
+	{
+		recs[i].wire = ldns_buffer_at(p->set_wire, pos);
+		recs[i].len = p->set_lens[i];
+
+		pos += p->set_lens[i];
+	}
+
+	if (p->set_count > 1)
+	{
+		ldns_mergezone_sort_recs(recs, p->set_count);
+	}
+
+	for (i = 0; i < p->set_count; i++)
+	{
+		if ((i == 0) || (ldns_mergezone_sort_rec_compare(recs[i - 1].wire, recs[i - 1].len, recs[i].wire, recs[i].len) != 0))
+		{
+			ldns_mergezone_zonemd_hash_data(p, recs[i].wire, recs[i].len);
+		}
+	}
+
+	free(recs);
+
+	ldns_buffer_clear(p->set_wire);
+
+	p->set_count = 0;
+}
+
+/* Compare the owner and type of a record with those of the current RRset */
+static int ldns_mergezone_zonemd_compare_set(const zonemd_pass* p, const ldns_rdf* owner, const ldns_rr_type type)
+{
+	int	rv	= ldns_dname_compare(owner, p->set_owner);
+
+	if (rv != 0)
+	{
+		return rv;
+	}
+
+	return (type < p->set_type) ? -1 : (type > p->set_type);
+}
+
+/* Remember a line that is left out of the new file */
+static void ldns_mergezone_zonemd_drop(zonemd_pass* p, const size_t offset, const size_t end)
+{
+	if (p->dropped_count == p->dropped_alloc)
+	{
+		p->dropped_alloc = (p->dropped_alloc == 0) ? 4 : p->dropped_alloc * 2;
+		p->dropped = (zonemd_range*) realloc(p->dropped, p->dropped_alloc * sizeof(zonemd_range));
+
+		assert(p->dropped != NULL);
+	}
+
+	p->dropped[p->dropped_count].offset = offset;
+	p->dropped[p->dropped_count].end = end;
+	p->dropped_count++;
+}
+
+/* Check if a record is the apex ZONEMD record or a signature over it */
+static int ldns_mergezone_zonemd_is_apex_zonemd(const ldns_rr* rr, const ldns_rdf* apex)
+{
+	ldns_rr_type	type	= ldns_rr_get_type(rr);
+
+	if (ldns_dname_compare(ldns_rr_owner(rr), apex) != 0)
+	{
+		return 0;
+	}
+
+	return (type == ZONEMD_RR_TYPE) ||
+	       ((type == LDNS_RR_TYPE_RRSIG) && (ldns_rr_rd_count(rr) > 0) && (ldns_rdf2native_int16(ldns_rr_rdf(rr, 0)) == ZONEMD_RR_TYPE));
+}
+
+/* Note whether the NSEC or NSEC3 record of the apex lists the ZONEMD type; returns 1 on failure */
+static int ldns_mergezone_zonemd_check_nsec(zonemd_pass* p, const ldns_rr* rr)
+{
+	const ldns_rdf*	apex	= ldns_rr_owner(p->soa);
+
+	if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_NSEC3)
+	{
+		/* The hashed owner name of the apex is computed once, with the parameters of the first NSEC3 record */
+		if ((p->nsec3_apex == NULL) &&
+		    (((p->nsec3_apex = ldns_nsec3_hash_name_frm_nsec3(rr, apex)) == NULL) || (ldns_dname_cat(p->nsec3_apex, apex) != LDNS_STATUS_OK)))
+		{
+			fprintf(stderr, "Failed to compute the NSEC3 owner name of the apex of %s\n", p->name);
+
+			return 1;
+		}
+
+		if (ldns_dname_compare(ldns_rr_owner(rr), p->nsec3_apex) != 0)
+		{
+			return 0;
+		}
+	}
+	else if (ldns_dname_compare(ldns_rr_owner(rr), apex) != 0)
+	{
+		return 0;
+	}
+
+	p->nsec_found = 1;
+	p->nsec_zonemd = ldns_nsec_bitmap_covers_type(ldns_nsec_get_bitmap(rr), ZONEMD_RR_TYPE);
+
+	return 0;
+}
+
+/* Put a record in canonical form; returns 1 on failure */
+static int ldns_mergezone_zonemd_add_rr(zonemd_pass* p, const ldns_rr* rr, const size_t offset, const size_t end)
+{
+	ldns_rr_type	type	= ldns_rr_get_type(rr);
+	size_t		pos	= 0;
+	int		cmp	= 0;
+
+	/* A zone that is not in canonical order is only searched for the lines to leave out and its SOA record */
+	if (p->apex != NULL)
+	{
+		if (ldns_mergezone_zonemd_is_apex_zonemd(rr, p->apex))
+		{
+			ldns_mergezone_zonemd_drop(p, offset, end);
+		}
+		else if ((type == LDNS_RR_TYPE_SOA) && !p->insert_found)
+		{
+			p->insert_offset = end;
+			p->insert_found = 1;
+		}
+
+		return 0;
+	}
+
+	/* The SOA record comes first */
+	if (p->soa == NULL)
+	{
+		if (type != LDNS_RR_TYPE_SOA)
+		{
+			p->unsorted = 1;
+
+			return 1;
+		}
+
+		p->soa = ldns_rr_clone(rr);
+
+		assert(p->soa != NULL);
+
+		if (ldns_rr2buffer_wire_canonical(p->soa_wire, rr, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
+		{
+			fprintf(stderr, "Failed to convert record to canonical wire format\n");
+
+			return 1;
+		}
+
+		/* Records are compared with the RRset before them, the SOA RRset is hashed later on */
+		p->set_owner = ldns_rdf_clone(ldns_rr_owner(rr));
+		p->set_type = 0;
+
+		return 0;
+	}
+
+	if (type == LDNS_RR_TYPE_SOA)
+	{
+		p->unsorted = 1;
+
+		return 1;
+	}
+
+	/* Leave out the apex ZONEMD RRset and the signatures over it */
+	if (ldns_mergezone_zonemd_is_apex_zonemd(rr, ldns_rr_owner(p->soa)))
+	{
+		ldns_mergezone_zonemd_drop(p, offset, end);
+
+		return 0;
+	}
+
+	if (((type == LDNS_RR_TYPE_NSEC) || (type == LDNS_RR_TYPE_NSEC3)) && (ldns_mergezone_zonemd_check_nsec(p, rr) != 0))
+	{
+		return 1;
+	}
+
+	cmp = ldns_mergezone_zonemd_compare_set(p, ldns_rr_owner(rr), type);
+
+	if (cmp < 0)
+	{
+		p->unsorted = 1;
+
+		return 1;
+	}
+
+	if (cmp > 0)
+	{
+		ldns_mergezone_zonemd_flush_set(p);
+
+		ldns_rdf_deep_free(p->set_owner);
+
+		p->set_owner = ldns_rdf_clone(ldns_rr_owner(rr));
+		p->set_type = type;
+
+		assert(p->set_owner != NULL);
+
+		/* The SOA RRset and the ZONEMD record go before the first RRset that sorts after them */
+		if ((ldns_buffer_position(p->soa_wire) > 0) && (ldns_mergezone_zonemd_compare_set(p, ldns_rr_owner(p->soa), LDNS_RR_TYPE_SOA) < 0))
+		{
+			ldns_mergezone_zonemd_hash_data(p, ldns_buffer_begin(p->soa_wire), ldns_buffer_position(p->soa_wire));
+
+			ldns_buffer_clear(p->soa_wire);
+		}
+
+		if (!p->insert_found && (ldns_mergezone_zonemd_compare_set(p, ldns_rr_owner(p->soa), ZONEMD_RR_TYPE) < 0))
+		{
+			p->insert_offset = offset;
+			p->insert_found = 1;
+		}
+	}
+
+	if (p->set_count == p->set_alloc)
+	{
+		p->set_alloc = (p->set_alloc == 0) ? 16 : p->set_alloc * 2;
+		p->set_lens = (size_t*) realloc(p->set_lens, p->set_alloc * sizeof(size_t));
+
+		assert(p->set_lens != NULL);
+	}
+
+	pos = ldns_buffer_position(p->set_wire);
+
+	if (ldns_rr2buffer_wire_canonical(p->set_wire, rr, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK)
+	{
+		fprintf(stderr, "Failed to convert record to canonical wire format\n");
+
+		return 1;
+	}
+
+	p->set_lens[p->set_count++] = ldns_buffer_position(p->set_wire) - pos;
+
+	return 0;
+}
+
+/* Canonical stage: collect the parsed records in file order and put them in canonical form */
+static void* ldns_mergezone_zonemd_canonical(void* arg)
+{
+	zonemd_pass*	p	= (zonemd_pass*) arg;
+	zonemd_batch*	batch	= NULL;
+	size_t		turn	= 0;
+	size_t		i	= 0;
+	int		j	= 0;
+	uint64_t	start	= 0;
+
+	TRACE_THREAD("zonemd canonical");
+
+	while ((batch = (zonemd_batch*) ldns_mergezone_ring_pop(&p->parsers[turn].out)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		for (i = 0; (i < batch->count) && !ldns_mergezone_zonemd_failed(&p->failed); i++)
+		{
+			if (ldns_mergezone_zonemd_add_rr(p, batch->rrs[i], batch->offsets[i], batch->ends[i]) != 0)
+			{
+				ldns_mergezone_zonemd_fail(&p->failed);
+			}
+		}
+
+		ldns_mergezone_zonemd_free_batch(batch);
+
+		TRACE_END(start, "zonemd", "canonical");
+
+		turn = (turn + 1) % p->num_parsers;
+	}
+
+	/* The other parsers are done as well */
+	for (j = 0; j < p->num_parsers; j++)
+	{
+		if (j != (int) turn)
+		{
+			while ((batch = (zonemd_batch*) ldns_mergezone_ring_pop(&p->parsers[j].out)) != NULL)
+			{
+				ldns_mergezone_zonemd_free_batch(batch);
+			}
+		}
+	}
+
+	if (!ldns_mergezone_zonemd_failed(&p->failed) && (p->apex == NULL))
+	{
+		if (p->soa == NULL)
+		{
+			fprintf(stderr, "Zone %s does not contain an SOA record\n", p->name);
+
+			ldns_mergezone_zonemd_fail(&p->failed);
+		}
+		else
+		{
+			ldns_mergezone_zonemd_flush_set(p);
+
+			if (ldns_buffer_position(p->soa_wire) > 0)
+			{
+				ldns_mergezone_zonemd_hash_data(p, ldns_buffer_begin(p->soa_wire), ldns_buffer_position(p->soa_wire));
+			}
+		}
+	}
+
+	if (p->chunk != NULL)
+	{
+		ldns_mergezone_ring_push(&p->chunks, p->chunk);
+
+		p->chunk = NULL;
+	}
+
+	ldns_mergezone_ring_push(&p->chunks, NULL);
+
+	return NULL;
+}
+
+/* Hash stage: compute the SHA-384 digest */
+static void* ldns_mergezone_zonemd_hash(void* arg)
+{
+	zonemd_pass*	p	= (zonemd_pass*) arg;
+	zonemd_chunk*	chunk	= NULL;
+	EVP_MD_CTX*	ctx	= EVP_MD_CTX_create();
+	unsigned int	len	= 0;
+	uint64_t	start	= 0;
+
+	TRACE_THREAD("zonemd hash");
+
+	if ((ctx == NULL) || (EVP_DigestInit_ex(ctx, EVP_sha384(), NULL) != 1))
+	{
+		fprintf(stderr, "Failed to set up SHA-384\n");
+
+		ldns_mergezone_zonemd_fail(&p->failed);
+	}
+
+	while ((chunk = (zonemd_chunk*) ldns_mergezone_ring_pop(&p->chunks)) != NULL)
+	{
+		TRACE_BEGIN(start);
+
+		if (!ldns_mergezone_zonemd_failed(&p->failed) && (EVP_DigestUpdate(ctx, chunk->data, chunk->len) != 1))
+		{
+			ldns_mergezone_zonemd_fail(&p->failed);
+		}
+
+		free(chunk);
+
+		TRACE_END(start, "zonemd", "hash");
+	}
+
+	if (!ldns_mergezone_zonemd_failed(&p->failed) && ((EVP_DigestFinal_ex(ctx, p->digest, &len) != 1) || (len != ZONEMD_DIGEST_LEN)))
+	{
+		fprintf(stderr, "Failed to compute SHA-384 digest\n");
+
+		ldns_mergezone_zonemd_fail(&p->failed);
+	}
+
+	if (ctx != NULL)
+	{
+		EVP_MD_CTX_destroy(ctx);
+	}
+
+	return NULL;
+}
+
+/* Split the file into batches of lines and hand them out to the parsers in turn */
+static void ldns_mergezone_zonemd_split(zonemd_pass* p)
+{
+	zonemd_batch*	batch	= NULL;
+	size_t		pos	= 0;
+	size_t		turn	= 0;
+	int		i	= 0;
+
+	while ((pos < p->size) && !ldns_mergezone_zonemd_failed(&p->failed))
+	{
+		const uint8_t*	nl	= (const uint8_t*) memchr(p->data + pos, '\n', p->size - pos);
+		size_t		end	= (nl != NULL) ? (size_t) (nl - p->data) + 1 : p->size;
+		size_t		text	= pos;
+
+		while ((text < end) && ((p->data[text] == ' ') || (p->data[text] == '\t') || (p->data[text] == '\r') || (p->data[text] == '\n')))
+		{
+			text++;
+		}
+
+		/* Skip empty lines and comments */
+		if ((text < end) && (p->data[text] != ';'))
+		{
+			if (batch == NULL)
+			{
+				batch = (zonemd_batch*) malloc(sizeof(zonemd_batch));
+
+				assert(batch != NULL);
+
+				batch->count = 0;
+			}
+
+			batch->offsets[batch->count] = pos;
+			batch->ends[batch->count] = end;
+			batch->rrs[batch->count] = NULL;
+
+			if (++batch->count == ZONEMD_BATCH)
+			{
+				PROGRESS_RECORDS(ZONEMD_BATCH);
+				PROGRESS_BYTES(end - batch->offsets[0]);
+
+				ldns_mergezone_ring_push(&p->parsers[turn].in, batch);
+
+				turn = (turn + 1) % p->num_parsers;
+				batch = NULL;
+			}
+		}
+
+		pos = end;
+	}
+
+	if (batch != NULL)
+	{
+		PROGRESS_RECORDS(batch->count);
+		PROGRESS_BYTES(batch->ends[batch->count - 1] - batch->offsets[0]);
+
+		ldns_mergezone_ring_push(&p->parsers[turn].in, batch);
+	}
+
+	for (i = 0; i < p->num_parsers; i++)
+	{
+		ldns_mergezone_ring_push(&p->parsers[i].in, NULL);
+	}
+}
+
+/* Compute the digest of a mapped zone file */
+static int ldns_mergezone_zonemd_digest(zonemd_pass* p)
+{
+	pthread_t	canonical_thread;
+	pthread_t	hash_thread;
+	int		canonical_started	= 0;
+	int		hash_started		= 0;
+	int		i			= 0;
+
+	p->num_parsers = (get_threads() < ZONEMD_MAX_PARSERS) ? get_threads() : ZONEMD_MAX_PARSERS;
+
+	if (p->num_parsers < 1)
+	{
+		p->num_parsers = 1;
+	}
+
+	p->soa_wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+	p->set_wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+
+	assert((p->soa_wire != NULL) && (p->set_wire != NULL));
+
+	if (ldns_mergezone_ring_init(&p->chunks, ZONEMD_RING_SIZE) != 0)
+	{
+		fprintf(stderr, "Failed to set up ZONEMD pipeline\n");
+
+		return 1;
+	}
+
+	for (i = 0; i < p->num_parsers; i++)
+	{
+		zonemd_parser*	parser	= &p->parsers[i];
+
+		parser->data = p->data;
+		parser->failed = &p->failed;
+		parser->reader.name = p->name;
+		parser->reader.default_ttl = 3600;
+
+		if ((ldns_mergezone_ring_init(&parser->in, ZONEMD_RING_SIZE) != 0) || (ldns_mergezone_ring_init(&parser->out, ZONEMD_RING_SIZE) != 0))
+		{
+			fprintf(stderr, "Failed to set up ZONEMD pipeline\n");
+
+			return 1;
+		}
+	}
+
+	/* A stage that cannot be started is run in this thread when its input is complete */
+	hash_started = (pthread_create(&hash_thread, NULL, ldns_mergezone_zonemd_hash, p) == 0);
+	canonical_started = hash_started && (pthread_create(&canonical_thread, NULL, ldns_mergezone_zonemd_canonical, p) == 0);
+
+	for (i = 0; canonical_started && (i < p->num_parsers); i++)
+	{
+		p->parsers[i].started = (pthread_create(&p->parsers[i].thread, NULL, ldns_mergezone_zonemd_parse, &p->parsers[i]) == 0);
+
+		if (!p->parsers[i].started)
+		{
+			break;
+		}
+	}
+
+	if (!canonical_started || !p->parsers[p->num_parsers - 1].started)
+	{
+		fprintf(stderr, "Failed to start ZONEMD pipeline thread\n");
+
+		ldns_mergezone_zonemd_fail(&p->failed);
+
+		/* Let the threads that did start run to the end */
+		for (i = 0; i < p->num_parsers; i++)
+		{
+			ldns_mergezone_ring_push(&p->parsers[i].in, NULL);
+
+			if (!p->parsers[i].started)
+			{
+				ldns_mergezone_ring_push(&p->parsers[i].out, NULL);
+			}
+		}
+
+		if (hash_started && !canonical_started)
+		{
+			ldns_mergezone_ring_push(&p->chunks, NULL);
+		}
+	}
+	else
+	{
+		ldns_mergezone_zonemd_split(p);
+	}
+
+	for (i = 0; i < p->num_parsers; i++)
+	{
+		if (p->parsers[i].started)
+		{
+			pthread_join(p->parsers[i].thread, NULL);
+		}
+	}
+
+	if (canonical_started)
+	{
+		pthread_join(canonical_thread, NULL);
+	}
+
+	if (hash_started)
+	{
+		pthread_join(hash_thread, NULL);
+	}
+
+	return ldns_mergezone_zonemd_failed(&p->failed);
+}
+
+/* Clean up */
+static void ldns_mergezone_zonemd_pass_free(zonemd_pass* p)
+{
+	int	i	= 0;
+
+	for (i = 0; i < p->num_parsers; i++)
+	{
+		ldns_mergezone_reader_close(&p->parsers[i].reader);
+		ldns_mergezone_ring_free(&p->parsers[i].in);
+		ldns_mergezone_ring_free(&p->parsers[i].out);
+	}
+
+	ldns_mergezone_ring_free(&p->chunks);
+
+	ldns_rr_free(p->soa);
+	ldns_rdf_deep_free(p->set_owner);
+	ldns_rdf_deep_free(p->nsec3_apex);
+
+	if (p->soa_wire != NULL)
+	{
+		ldns_buffer_free(p->soa_wire);
+	}
+
+	if (p->set_wire != NULL)
+	{
+		ldns_buffer_free(p->set_wire);
+	}
+
+	free(p->set_lens);
+	free(p->dropped);
+}
+
+/* Write part of the mapped file, leaving out the dropped lines */
+static int ldns_mergezone_zonemd_write_range(FILE* fp, const zonemd_pass* p, size_t pos, const size_t end, size_t* next_dropped)
+{
+	while (pos < end)
+	{
+		size_t	stop	= end;
+
+		if ((*next_dropped < p->dropped_count) && (p->dropped[*next_dropped].offset < end))
+		{
+			stop = p->dropped[*next_dropped].offset;
+		}
+
+		if ((stop > pos) && (fwrite(p->data + pos, 1, stop - pos, fp) != stop - pos))
+		{
+			return 1;
+		}
+
+		if (stop == end)
+		{
+			break;
+		}
+
+		pos = p->dropped[(*next_dropped)++].end;
+	}
+
+	return 0;
+}
+
+/* Write the zone with the ZONEMD record inserted to a temporary file, which then replaces the zone file */
+static int ldns_mergezone_zonemd_rewrite(const zonemd_pass* p, const char* zone_file, const ldns_buffer* zonemd_text)
+{
+	replace_file	rf;
+	int		rv		= 0;
+	size_t		next_dropped	= 0;
+	size_t		insert_offset	= p->insert_found ? p->insert_offset : p->size;
+	struct stat	st;
+
+	if (ldns_mergezone_replace_open(&rf, zone_file) != 0)
+	{
+		return 1;
+	}
+
+	if (stat(zone_file, &st) == 0)
+	{
+		fchmod(rf.fd, st.st_mode & 0777);
+	}
+
+	rv = ldns_mergezone_zonemd_write_range(rf.fp, p, 0, insert_offset, &next_dropped);
+
+	if ((rv == 0) && (insert_offset > 0) && (p->data[insert_offset - 1] != '\n') && (fputc('\n', rf.fp) == EOF))
+	{
+		rv = 1;
+	}
+
+	if ((rv == 0) && (fwrite(ldns_buffer_begin(zonemd_text), 1, ldns_buffer_position(zonemd_text), rf.fp) != ldns_buffer_position(zonemd_text)))
+	{
+		rv = 1;
+	}
+
+	if (rv == 0)
+	{
+		rv = ldns_mergezone_zonemd_write_range(rf.fp, p, insert_offset, p->size, &next_dropped);
+	}
+
+	if (ldns_mergezone_replace_close(&rf, rv) != 0)
+	{
+		fprintf(stderr, "Failed to write %s with ZONEMD record\n", zone_file);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Create the ZONEMD record and format it */
+static ldns_buffer* ldns_mergezone_zonemd_record(const zonemd_pass* p, const char* zone_file)
+{
+	ldns_buffer*	text	= ldns_buffer_new(LDNS_MAX_LINELEN);
+	char*		owner	= ldns_rdf2str(ldns_rr_owner(p->soa));
+	char		str[LDNS_MAX_DOMAINLEN * 4 + 256];
+	int		len	= 0;
+	ldns_rr*	rr	= NULL;
+	int		i	= 0;
+
+	assert(text != NULL);
+	assert(owner != NULL);
+
+	/* In a signed zone, a ZONEMD record that the NSEC or NSEC3 record of the apex does not list makes the zone bogus */
+	if (p->nsec_found && !p->nsec_zonemd)
+	{
+		fprintf(stderr, "The NSEC or NSEC3 record at the apex of %s does not list the ZONEMD type; have the signers add a placeholder ZONEMD record to the zone (RFC 8976, section 3.1)\n", zone_file);
+
+		ldns_buffer_free(text);
+		free(owner);
+
+		return NULL;
+	}
+
+	/* Written in the generic form (RFC 3597), so it is accepted by versions of ldns that do not know the type */
+	len = snprintf(str, sizeof(str), "%s %u IN TYPE%d \\# %d %08x%02x%02x", owner, ldns_rr_ttl(p->soa), ZONEMD_RR_TYPE, 6 + ZONEMD_DIGEST_LEN,
+	               ldns_rdf2native_int32(ldns_rr_rdf(p->soa, 2)), ZONEMD_SCHEME_SIMPLE, ZONEMD_HASH_SHA384);
+
+	for (i = 0; i < ZONEMD_DIGEST_LEN; i++)
+	{
+		len += snprintf(str + len, sizeof(str) - len, "%02x", p->digest[i]);
+	}
+
+	free(owner);
+
+	if ((ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) != LDNS_STATUS_OK) || (ldns_mergezone_format_rr(text, rr) != LDNS_STATUS_OK))
+	{
+		fprintf(stderr, "Failed to create ZONEMD record\n");
+
+		ldns_buffer_free(text);
+
+		text = NULL;
+	}
+
+	ldns_rr_free(rr);
+
+	return text;
+}
+
+/* Map a zone file and compute its digest, or if apex is not NULL only find the lines to leave out; p->unsorted is set if it is not in canonical order */
+static int ldns_mergezone_zonemd_pass_file(zonemd_pass* p, const char* zone_file, const ldns_rdf* apex, void** data, size_t* size)
+{
+	int		fd	= open(zone_file, O_RDONLY);
+	struct stat	st;
+
+	memset(p, 0, sizeof(zonemd_pass));
+
+	p->apex = apex;
+
+	*data = NULL;
+	*size = 0;
+
+	if ((fd < 0) || (fstat(fd, &st) != 0))
+	{
+		fprintf(stderr, "Failed to open %s for reading\n", zone_file);
+
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+
+		return 1;
+	}
+
+	if (st.st_size > 0)
+	{
+		*data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		*size = st.st_size;
+	}
+
+	close(fd);
+
+	if (*data == MAP_FAILED)
+	{
+		fprintf(stderr, "Failed to map %s into memory\n", zone_file);
+
+		*data = NULL;
+
+		return 1;
+	}
+
+	if (*data != NULL)
+	{
+		madvise(*data, *size, MADV_SEQUENTIAL);
+	}
+
+	p->name = zone_file;
+	p->data = (const uint8_t*) *data;
+	p->size = *size;
+
+	ldns_mergezone_progress_phase("zonemd", *size, 0);
+
+	return ldns_mergezone_zonemd_digest(p);
+}
+
+/* Compute the ZONEMD record of a zone that is not in canonical order over a sorted copy of it */
+static ldns_buffer* ldns_mergezone_zonemd_sorted_record(const char* zone_file, const size_t mem_limit, ldns_rdf** apex)
+{
+	zonemd_pass	p;
+	void*		data		= NULL;
+	size_t		size		= 0;
+	char*		sorted_file	= NULL;
+	ldns_buffer*	text		= NULL;
+
+	if (ldns_mergezone_sort_zone_tmpfile(zone_file, mem_limit, &sorted_file) != 0)
+	{
+		return NULL;
+	}
+
+	if (ldns_mergezone_zonemd_pass_file(&p, sorted_file, NULL, &data, &size) == 0)
+	{
+		text = ldns_mergezone_zonemd_record(&p, zone_file);
+
+		*apex = ldns_rdf_clone(ldns_rr_owner(p.soa));
+
+		assert(*apex != NULL);
+	}
+	else if (p.unsorted)
+	{
+		fprintf(stderr, "Sorted zone is not in canonical order\n");
+	}
+
+	ldns_mergezone_zonemd_pass_free(&p);
+
+	if (data != NULL)
+	{
+		munmap(data, size);
+	}
+
+	unlink(sorted_file);
+	free(sorted_file);
+
+	return text;
+}
+
+/* Compute the ZONEMD digest of a zone file and insert a ZONEMD record at the apex */
+int ldns_mergezone_zonemd_add(const char* zone_file, const size_t mem_limit, const char* record_file)
+{
+	zonemd_pass	p;
+	void*		data		= NULL;
+	size_t		size		= 0;
+	ldns_rdf*	apex		= NULL;
+	ldns_buffer*	text		= NULL;
+	FILE*		fp		= NULL;
+	int		rv		= 0;
+
+	assert(zone_file != NULL);
+
+	rv = ldns_mergezone_zonemd_pass_file(&p, zone_file, NULL, &data, &size);
+
+	if ((rv != 0) && p.unsorted)
+	{
+		VERBOSE("Zone %s is not in canonical order, computing the ZONEMD digest over a sorted copy of it\n", zone_file);
+
+		ldns_mergezone_zonemd_pass_free(&p);
+
+		if (data != NULL)
+		{
+			munmap(data, size);
+		}
+
+		if ((text = ldns_mergezone_zonemd_sorted_record(zone_file, mem_limit, &apex)) == NULL)
+		{
+			ldns_rdf_deep_free(apex);
+
+			return 1;
+		}
+
+		/* The zone keeps its order, with the ZONEMD record after the SOA record */
+		rv = ldns_mergezone_zonemd_pass_file(&p, zone_file, apex, &data, &size);
+	}
+	else if ((rv == 0) && ((text = ldns_mergezone_zonemd_record(&p, zone_file)) == NULL))
+	{
+		rv = 1;
+	}
+
+	if (rv == 0)
+	{
+		rv = ldns_mergezone_zonemd_rewrite(&p, zone_file, text);
+	}
+
+	if ((rv == 0) && (record_file != NULL))
+	{
+		if ((fp = fopen(record_file, "w")) == NULL)
+		{
+			rv = 1;
+		}
+		else
+		{
+			rv = (fwrite(ldns_buffer_begin(text), 1, ldns_buffer_position(text), fp) != ldns_buffer_position(text));
+
+			if (fclose(fp) != 0)
+			{
+				rv = 1;
+			}
+		}
+
+		if (rv != 0)
+		{
+			fprintf(stderr, "Failed to write ZONEMD record to %s\n", record_file);
+		}
+	}
+
+	if (rv == 0)
+	{
+		VERBOSE("Added ZONEMD record to %s%s\n", zone_file, (p.dropped_count > 0) ? ", replacing the existing one" : "");
+	}
+
+	if (text != NULL)
+	{
+		ldns_buffer_free(text);
+	}
+
+	ldns_mergezone_zonemd_pass_free(&p);
+
+	if (data != NULL)
+	{
+		munmap(data, size);
+	}
+
+	ldns_rdf_deep_free(apex);
+
+	return rv;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2017 SURFnet bv
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * 
+ * - Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _LDNS_MERGEZONE_ZONEMD_H
+#define _LDNS_MERGEZONE_ZONEMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ldns/ldns.h>
+
+/* ZONEMD record type (RFC 8976), older versions of ldns do not know it */
+#define ZONEMD_RR_TYPE		63
+
+/* Scheme and hash algorithm used */
+#define ZONEMD_SCHEME_SIMPLE	1
+#define ZONEMD_HASH_SHA384	1
+#define ZONEMD_DIGEST_LEN	48
+
+/*
+ * Compute the ZONEMD digest of a zone file written by the tool and insert
+ * a ZONEMD record at the apex, replacing any ZONEMD record and signatures
+ * over it that were already there. The digest of a zone that is not in
+ * canonical order is computed over a sorted copy of it, using at most
+ * mem_limit bytes of memory; the zone itself keeps its order and gets the
+ * ZONEMD record after its SOA record. If record_file is not NULL, the
+ * ZONEMD record is also written to that file so that it can be signed.
+ */
+int ldns_mergezone_zonemd_add(const char* zone_file, const size_t mem_limit, const char* record_file);
+
+#endif /* !_LDNS_MERGEZONE_ZONEMD_H */